@@ -0,0 +1,253 @@
+/**
+ * @file DiagnosticConsumers.h
+ * @brief Defines diagnostic consumers that write diagnostics to a stream as
+ * text, JSON Lines or SARIF.
+ *
+ * The consumers format into one large buffer of their own and write it to
+ * the stream only when it fills up and when they finish, rather than once
+ * per diagnostic, so that a flood of diagnostics costs little more than
+ * formatting them.
+ */
+
+#ifndef SWIFT_DIAGNOSTIC_DIAGNOSTICCONSUMERS_H
+#define SWIFT_DIAGNOSTIC_DIAGNOSTICCONSUMERS_H
+
+#include "swift/Diagnostic/DiagnosticEngine.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace swift {
+    /**
+     * @enum DiagnosticOutputFormat
+     * @brief The formats the streaming consumers write.
+     */
+    enum class DiagnosticOutputFormat {
+        Text, ///< "file:line:column: severity: message", then the source line
+        JSONLines, ///< One JSON object per diagnostic and line
+        SARIF ///< A SARIF 2.1.0 log with one run
+    };
+
+    /**
+     * @class StreamingDiagnosticConsumer
+     * @brief Base class of the consumers that write diagnostics to a stream
+     * through a buffer.
+     *
+     * Subclasses format each diagnostic, with its location and source line
+     * resolved, into the buffer. The buffer is written out once it holds
+     * BufferSize bytes, by flush(), and when the consumer finishes; nothing
+     * flushes the stream itself.
+     */
+    class StreamingDiagnosticConsumer : public DiagnosticConsumer {
+    public:
+        /// The default size of the output buffer.
+        static constexpr size_t DefaultBufferSize = 64 * 1024;
+
+        /// The most bytes of a source line quoted; a longer line, e.g. in a
+        /// binary file, is quoted around the column.
+        static constexpr unsigned MaxSnippetLength = 160;
+
+        ~StreamingDiagnosticConsumer() override;
+
+        void handleDiagnostic(const Diagnostic &Diag, const SourceManager &SM) override;
+
+        void handleDiagnostics(llvm::ArrayRef<Diagnostic> Diags, const SourceManager &SM) override;
+
+        /**
+         * @brief Writes whatever the format needs after the last diagnostic,
+         * then the buffer. Nothing is written after this.
+         */
+        void finishProcessing() override;
+
+        /**
+         * @brief Writes the buffer to the stream.
+         */
+        void flush();
+
+        /**
+         * @brief Returns the number of errors written.
+         */
+        [[nodiscard]] unsigned getErrorCount() const { return NumErrors; }
+
+    protected:
+        /**
+         * @brief Where a diagnostic is, resolved through the source manager.
+         */
+        struct ResolvedLocation {
+            /// The buffer's identifier, empty if the diagnostic has no
+            /// location in a buffer, in which case nothing else is set
+            llvm::StringRef File;
+
+            /// Byte offset in the buffer
+            unsigned Offset = 0;
+
+            /// 1-based line and column; columns count bytes
+            unsigned Line = 0;
+            unsigned Column = 0;
+
+            /// The whole line, without its line break
+            llvm::StringRef LineText;
+
+            /// The quoted part of the line: all of it, unless it is longer
+            /// than MaxSnippetLength
+            llvm::StringRef Snippet;
+
+            /// The byte offset of the column in Snippet
+            unsigned SnippetColumn = 0;
+        };
+
+        /**
+         * @brief Constructs a consumer writing to a stream.
+         * @param OS The stream, which must outlive the consumer
+         * @param BufferSize How many bytes to gather before writing them
+         */
+        explicit StreamingDiagnosticConsumer(std::ostream &OS, size_t BufferSize = DefaultBufferSize);
+
+        /**
+         * @brief Formats a diagnostic into Out.
+         * @param Diag The diagnostic
+         * @param Loc Where it is
+         */
+        virtual void writeDiagnostic(const Diagnostic &Diag, const ResolvedLocation &Loc) = 0;
+
+        /**
+         * @brief Formats whatever the format needs after the last
+         * diagnostic into Out.
+         */
+        virtual void writeEnd() {
+        }
+
+        /**
+         * @brief Appends a string to Out as the contents of a JSON string,
+         * escaping it and replacing invalid UTF-8 with U+FFFD.
+         * @param String The string
+         */
+        void appendJSONString(llvm::StringRef String);
+
+        /**
+         * @brief Appends an unsigned integer to Out in decimal.
+         * @param Value The value
+         */
+        void appendUnsigned(uint64_t Value);
+
+        /// The buffered output.
+        std::string Out;
+
+    private:
+        std::ostream &OS;
+        const size_t BufferSize;
+        unsigned NumErrors = 0;
+        bool Finished = false;
+
+        /**
+         * @brief Resolves a diagnostic's location and formats it, then
+         * writes the buffer if it is full.
+         * @param Diag The diagnostic
+         * @param SM The source manager for location information
+         */
+        void handle(const Diagnostic &Diag, const SourceManager &SM);
+    };
+
+    /**
+     * @class TextDiagnosticConsumer
+     * @brief Writes diagnostics for people to read, as
+     * "file:line:column: severity: message", followed by the source line and
+     * a caret under the column.
+     */
+    class TextDiagnosticConsumer : public StreamingDiagnosticConsumer {
+    public:
+        /**
+         * @brief Constructs a consumer writing to a stream.
+         * @param OS The stream, which must outlive the consumer
+         * @param ShowSnippets Whether to quote the source line
+         * @param BufferSize How many bytes to gather before writing them
+         */
+        explicit TextDiagnosticConsumer(std::ostream &OS, bool ShowSnippets = true,
+                                        size_t BufferSize = DefaultBufferSize)
+            : StreamingDiagnosticConsumer(OS, BufferSize), ShowSnippets(ShowSnippets) {
+        }
+
+    protected:
+        void writeDiagnostic(const Diagnostic &Diag, const ResolvedLocation &Loc) override;
+
+    private:
+        const bool ShowSnippets;
+    };
+
+    /**
+     * @class JSONLinesDiagnosticConsumer
+     * @brief Writes each diagnostic as a JSON object on a line of its own.
+     *
+     * The object has "severity", "id" (the DiagnosticKinds.def name),
+     * "message" and "count" members, and, for a location in a buffer,
+     * "file", "line", "column", "offset" and "snippet".
+     */
+    class JSONLinesDiagnosticConsumer : public StreamingDiagnosticConsumer {
+    public:
+        /**
+         * @brief Constructs a consumer writing to a stream.
+         * @param OS The stream, which must outlive the consumer
+         * @param BufferSize How many bytes to gather before writing them
+         */
+        explicit JSONLinesDiagnosticConsumer(std::ostream &OS, size_t BufferSize = DefaultBufferSize)
+            : StreamingDiagnosticConsumer(OS, BufferSize) {
+        }
+
+    protected:
+        void writeDiagnostic(const Diagnostic &Diag, const ResolvedLocation &Loc) override;
+    };
+
+    /**
+     * @class SARIFDiagnosticConsumer
+     * @brief Writes diagnostics as a SARIF 2.1.0 log, one result each.
+     *
+     * Results are streamed as they come; the log is only complete once the
+     * consumer finishes. Each result's rule is the diagnostic's
+     * DiagnosticKinds.def name, and a collapsed run sets occurrenceCount.
+     * Columns count UTF-16 code units, as SARIF expects by default; the
+     * region also gives the byte offset.
+     */
+    class SARIFDiagnosticConsumer : public StreamingDiagnosticConsumer {
+    public:
+        /**
+         * @brief Constructs a consumer writing to a stream.
+         * @param OS The stream, which must outlive the consumer
+         * @param BufferSize How many bytes to gather before writing them
+         */
+        explicit SARIFDiagnosticConsumer(std::ostream &OS, size_t BufferSize = DefaultBufferSize);
+
+        /**
+         * @brief Completes the log, unless the consumer has finished.
+         */
+        ~SARIFDiagnosticConsumer() override;
+
+    protected:
+        void writeDiagnostic(const Diagnostic &Diag, const ResolvedLocation &Loc) override;
+
+        void writeEnd() override;
+
+    private:
+        bool FirstResult = true;
+
+        /// How far into the line of the last result its column was counted
+        /// in UTF-16 code units, so that the results on one long line are
+        /// not each counted from its start.
+        const char *CountedLine = nullptr;
+        unsigned CountedBytes = 0;
+        unsigned CountedUnits = 0;
+    };
+
+    /**
+     * @brief Creates the streaming consumer for a format.
+     * @param Format The format to write
+     * @param OS The stream, which must outlive the consumer
+     */
+    std::unique_ptr<StreamingDiagnosticConsumer> createStreamingDiagnosticConsumer(DiagnosticOutputFormat Format,
+                                                                                   std::ostream &OS);
+} // namespace swift
+
+#endif // SWIFT_DIAGNOSTIC_DIAGNOSTICCONSUMERS_H
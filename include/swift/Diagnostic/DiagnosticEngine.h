@@ -11,8 +11,17 @@
 
 #include "swift/Source/SourceLocation.h"
 #include "swift/Source/SourceManager.h"
-
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace swift {
@@ -27,12 +36,81 @@ namespace swift {
         Remark ///< Informational remark not indicating a problem
     };
 
+    /**
+     * @enum DiagID
+     * @brief Identifies a kind of diagnostic listed in DiagnosticKinds.def.
+     */
+    enum class DiagID : uint32_t {
+#define DIAG(KIND, ID, Text, Signature) ID,
+#include "swift/Diagnostic/DiagnosticKinds.def"
+    };
+
+    /// The number of kinds of diagnostic.
+    inline constexpr unsigned NumDiagIDs = 0
+#define DIAG(KIND, ID, Text, Signature) +1
+#include "swift/Diagnostic/DiagnosticKinds.def"
+        ;
+
+    /**
+     * @brief Returns the severity of a kind of diagnostic.
+     * @param ID The kind of diagnostic
+     */
+    [[nodiscard]] DiagnosticSeverity getDiagnosticSeverity(DiagID ID);
+
+    /**
+     * @brief Returns the format string of a kind of diagnostic.
+     * @param ID The kind of diagnostic
+     */
+    [[nodiscard]] llvm::StringRef getDiagnosticFormat(DiagID ID);
+
+    /**
+     * @brief Returns the name of a kind of diagnostic, e.g.
+     * "lex_unterminated_string".
+     * @param ID The kind of diagnostic
+     */
+    [[nodiscard]] llvm::StringRef getDiagnosticName(DiagID ID);
+
+    /**
+     * @struct Diag
+     * @brief A DiagID that also carries the types of its diagnostic's
+     * arguments, so that diagnosing with the wrong arguments does not compile.
+     */
+    template <typename... ArgTypes>
+    struct Diag {
+        /// The number of arguments the diagnostic takes.
+        static constexpr unsigned NumArguments = sizeof...(ArgTypes);
+
+        DiagID ID;
+    };
+
+    namespace detail {
+        /// Maps the signature of a DiagnosticKinds.def entry to its Diag type.
+        template <typename Signature>
+        struct DiagWithArguments;
+
+        template <typename... ArgTypes>
+        struct DiagWithArguments<void(ArgTypes...)> {
+            using type = Diag<ArgTypes...>;
+        };
+    } // namespace detail
+
+    /// The typed ID of every diagnostic, e.g. diag::lex_unterminated_string.
+    namespace diag {
+#define DIAG(KIND, ID, Text, Signature) \
+        inline constexpr detail::DiagWithArguments<void Signature>::type ID = {DiagID::ID};
+#include "swift/Diagnostic/DiagnosticKinds.def"
+    } // namespace diag
+
     /**
      * @class Diagnostic
      * @brief Represents a single diagnostic message.
      */
     class Diagnostic {
     public:
+        /// The kind of diagnostic, for telling diagnostics apart without
+        /// comparing messages
+        DiagID ID;
+
         /// The severity level of this diagnostic
         DiagnosticSeverity Severity;
 
@@ -42,24 +120,111 @@ namespace swift {
         /// The diagnostic message
         std::string Message;
 
+        /// The location of the last diagnostic in a run of identical ones
+        /// collapsed into this one; Location if there was no run
+        SourceLocation LastLocation;
+
+        /// The number of diagnostics collapsed into this one
+        unsigned Count = 1;
+
         /**
          * @brief Constructs a diagnostic with the specified parameters.
-         * @param Severity The severity level
+         * @param ID The kind of diagnostic, which determines its severity
          * @param Location Source location of the issue
          * @param Message The diagnostic message text
          */
-        Diagnostic(DiagnosticSeverity Severity, SourceLocation Location, std::string Message)
-            : Severity(Severity), Location(Location), Message(std::move(Message)) {
+        Diagnostic(DiagID ID, SourceLocation Location, std::string Message)
+            : ID(ID), Severity(getDiagnosticSeverity(ID)), Location(Location), Message(std::move(Message)),
+              LastLocation(Location) {
+        }
+    };
+
+    /**
+     * @class DiagnosticArgument
+     * @brief A value substituted for a %N placeholder in a diagnostic's format
+     * string.
+     *
+     * Arguments are small and trivially copyable so that diagnostics can be
+     * queued without allocating. A string argument refers to its characters
+     * rather than copying them, so they must outlive the diagnostic, as the
+     * source text a lexer diagnostic quotes does.
+     */
+    class DiagnosticArgument {
+    public:
+        /**
+         * @enum ArgumentKind
+         * @brief The type of value an argument holds.
+         */
+        enum class ArgumentKind : uint8_t {
+            String, ///< A string, printed as is
+            Unsigned ///< An unsigned integer, printed in decimal
+        };
+
+        /**
+         * @brief Constructs the unsigned argument 0.
+         */
+        constexpr DiagnosticArgument() = default;
+
+        /**
+         * @brief Constructs a string argument.
+         * @param String The string, which must outlive the argument
+         */
+        DiagnosticArgument(llvm::StringRef String)
+            : Data(String.data()), SizeOrValue(String.size()), Kind(ArgumentKind::String) {
+        }
+
+        /**
+         * @brief Constructs an unsigned integer argument.
+         * @param Value The value
+         */
+        constexpr DiagnosticArgument(unsigned Value) : SizeOrValue(Value) {
+        }
+
+        /**
+         * @brief Returns the type of value this argument holds.
+         */
+        [[nodiscard]] ArgumentKind getKind() const { return Kind; }
+
+        /**
+         * @brief Returns the value of a string argument.
+         */
+        [[nodiscard]] llvm::StringRef getAsString() const {
+            assert(Kind == ArgumentKind::String && "not a string argument");
+            return {Data, SizeOrValue};
         }
+
+        /**
+         * @brief Returns the value of an unsigned integer argument.
+         */
+        [[nodiscard]] unsigned getAsUnsigned() const {
+            assert(Kind == ArgumentKind::Unsigned && "not an unsigned argument");
+            return SizeOrValue;
+        }
+
+    private:
+        const char *Data = nullptr;
+        uint32_t SizeOrValue = 0;
+        ArgumentKind Kind = ArgumentKind::Unsigned;
     };
 
+    /**
+     * @brief Builds a diagnostic message from a format string.
+     * @param Format The format string, where %N stands for argument N and %%
+     *        for a percent sign
+     * @param Args The arguments
+     * @return The message
+     */
+    std::string formatDiagnosticMessage(llvm::StringRef Format,
+                                        llvm::ArrayRef<DiagnosticArgument> Args);
+
     /**
      * @class DiagnosticConsumer
      * @brief Abstract base class for diagnostic consumers.
      *
      * Diagnostic consumers receive diagnostics from the DiagnosticEngine
      * and handle them in an implementation-specific way (e.g., print to console,
-     * write to a file, etc.).
+     * write to a file, etc.). See DiagnosticConsumers.h for buffered writers
+     * of text, JSON Lines and SARIF.
      */
     class DiagnosticConsumer {
     public:
@@ -71,6 +236,54 @@ namespace swift {
          * @param SM The source manager for location information
          */
         virtual void handleDiagnostic(const Diagnostic &Diag, const SourceManager &SM) = 0;
+
+        /**
+         * @brief Handles diagnostics in the order given, as if each were
+         * passed to handleDiagnostic().
+         * @param Diags The diagnostics to handle
+         * @param SM The source manager for location information
+         *
+         * The engine passes diagnostics it has many of at once, e.g. when it
+         * merges those of concurrent mode, through this call. Override it to
+         * handle them with one virtual call rather than one per diagnostic.
+         */
+        virtual void handleDiagnostics(llvm::ArrayRef<Diagnostic> Diags, const SourceManager &SM) {
+            for (const Diagnostic &Diag : Diags)
+                handleDiagnostic(Diag, SM);
+        }
+
+        /**
+         * @brief Called when no more diagnostics will follow, e.g. to write
+         * out what a consumer has buffered.
+         */
+        virtual void finishProcessing() {
+        }
+    };
+
+    /**
+     * @struct DiagnosticLimits
+     * @brief Bounds how much a DiagnosticEngine reports, so that a binary
+     * file or a broken encoding, which can draw a diagnostic from every
+     * byte, does not flood the consumers.
+     */
+    struct DiagnosticLimits {
+        /// The most errors to report, 0 for no limit. The error that reaches
+        /// the limit is followed by error_limit_reached, and every diagnostic
+        /// after it is suppressed.
+        unsigned MaxErrors = 0;
+
+        /// The most diagnostics of any one kind to report, 0 for no limit.
+        /// The last one is followed by diagnostic_kind_limit_reached. The
+        /// free-form *_message kinds are not limited, as each stands for
+        /// many different messages.
+        unsigned MaxPerKind = 0;
+
+        /// Whether to collapse a run of diagnostics of the same kind, one
+        /// character apart in the same buffer, into a single diagnostic
+        /// whose LastLocation and Count describe the run. Only kinds without
+        /// arguments collapse; the last diagnostic is held back until the
+        /// next one shows whether it continues the run.
+        bool CollapseAdjacent = false;
     };
 
     /**
@@ -82,6 +295,9 @@ namespace swift {
      * - Formatting diagnostic messages
      * - Routing diagnostics to consumers
      * - Tracking diagnostics statistics
+     *
+     * An engine is used from one thread at a time, except in concurrent mode,
+     * see beginConcurrentDiagnostics().
      */
     class DiagnosticEngine {
     public:
@@ -91,6 +307,78 @@ namespace swift {
          */
         explicit DiagnosticEngine(const SourceManager &SM);
 
+        /**
+         * @brief Passes on the diagnostics still recorded in concurrent mode
+         * or held back for collapsing, if any, and finishes the consumers.
+         */
+        ~DiagnosticEngine();
+
+        /**
+         * @brief Sets the limits on what is reported from now on.
+         * @param NewLimits The limits
+         */
+        void setLimits(const DiagnosticLimits &NewLimits);
+
+        /**
+         * @brief Returns the limits on what is reported.
+         */
+        [[nodiscard]] const DiagnosticLimits &getLimits() const { return Limits; }
+
+        /**
+         * @brief Passes on the diagnostic held back for collapsing, if any.
+         */
+        void flush();
+
+        /**
+         * @brief Passes on the diagnostic held back for collapsing, if any,
+         * and tells the consumers that no more diagnostics will follow.
+         *
+         * The destructor calls this too.
+         */
+        void finishProcessing();
+
+        /**
+         * @brief Enters concurrent mode, in which any number of threads may
+         * diagnose at once until mergeConcurrentDiagnostics().
+         *
+         * Each thread records its diagnostics in a buffer of its own, which
+         * it registers without locking the first time it diagnoses, and
+         * counts them in counters of its own. Consumers see nothing until
+         * the merge, and the limits apply only then, with two exceptions
+         * that look at each source buffer on its own. Runs collapse and
+         * MaxPerKind applies to each buffer as diagnostics are recorded, so
+         * that a flood is neither formatted nor kept until the merge. And a
+         * lexer stops once the buffer it is lexing has MaxErrors errors of
+         * its own, see hasReachedErrorLimit(unsigned).
+         * Neither, unlike the diagnostics of all threads together, depends
+         * on how the work is spread over the threads.
+         *
+         * Must be called while no other thread is using the engine.
+         */
+        void beginConcurrentDiagnostics();
+
+        /**
+         * @brief Leaves concurrent mode, passing the recorded diagnostics on
+         * sorted by buffer and offset.
+         *
+         * Each note stays after the diagnostic it was reported with, and
+         * diagnostics at the same place are ordered by kind and message, so
+         * the consumers see the same thing whatever the number of threads,
+         * as long as each buffer was diagnosed by a single thread. They see
+         * it in batches, through DiagnosticConsumer::handleDiagnostics().
+         *
+         * Must be called once no other thread is using the engine.
+         */
+        void mergeConcurrentDiagnostics();
+
+        /**
+         * @brief Returns whether the engine is in concurrent mode.
+         */
+        [[nodiscard]] bool isConcurrent() const { return Concurrent; }
+
+        /// A thread's diagnostics in concurrent mode, defined with the engine.
+        struct ConcurrentBuffer;
+
         /**
          * @brief Adds a diagnostic consumer.
          * @param Consumer The consumer to add (ownership is transferred)
@@ -125,6 +413,40 @@ namespace swift {
          */
         void remark(SourceLocation Loc, const std::string &Message);
 
+        /**
+         * @brief Emits a diagnostic listed in DiagnosticKinds.def.
+         * @param Loc The source location of the diagnostic
+         * @param ID The kind of diagnostic
+         * @param Args The arguments for its format string
+         *
+         * The message is only formatted if there is a consumer to receive it.
+         */
+        void diagnose(SourceLocation Loc, DiagID ID, llvm::ArrayRef<DiagnosticArgument> Args = {});
+
+        /**
+         * @brief Emits a diagnostic listed in DiagnosticKinds.def, checking
+         * its arguments against the types the entry lists.
+         * @param Loc The source location of the diagnostic
+         * @param ID The kind of diagnostic, e.g. diag::lex_invalid_character
+         * @param Args The arguments for its format string
+         *
+         * The arguments are kept on the stack; nothing is allocated unless the
+         * message is formatted for a consumer.
+         */
+        template <typename... ArgTypes>
+        void diagnose(SourceLocation Loc, Diag<ArgTypes...> ID, std::type_identity_t<ArgTypes>... Args) {
+            // One more element than needed, so that the array is never empty.
+            const DiagnosticArgument Arguments[] = {DiagnosticArgument(Args)..., DiagnosticArgument()};
+            diagnose(Loc, ID.ID, llvm::ArrayRef<DiagnosticArgument>(Arguments, sizeof...(Args)));
+        }
+
+        /**
+         * @brief Emits a diagnostic that has already been built, e.g. one
+         * another engine collected.
+         * @param Diag The diagnostic
+         */
+        void diagnose(const Diagnostic &Diag);
+
         /**
          * @brief Returns whether any errors have been reported.
          * @return True if any errors have been reported
@@ -149,6 +471,34 @@ namespace swift {
          */
         [[nodiscard]] unsigned getWarningCount() const;
 
+        /**
+         * @brief Returns the number of diagnostics of one kind emitted; a
+         * collapsed run counts once.
+         * @param ID The kind of diagnostic
+         */
+        [[nodiscard]] unsigned getDiagnosticCount(DiagID ID) const { return KindCounts[unsigned(ID)]; }
+
+        /**
+         * @brief Returns the number of diagnostics the limits suppressed.
+         */
+        [[nodiscard]] unsigned getSuppressedCount() const { return NumSuppressed; }
+
+        /**
+         * @brief Returns whether the error limit has been reached, after
+         * which nothing more is reported.
+         */
+        [[nodiscard]] bool hasReachedErrorLimit() const { return ErrorLimitReached; }
+
+        /**
+         * @brief Returns whether a lexer of a buffer should stop: whether
+         * the error limit has been reached or, in concurrent mode, whether
+         * the calling thread has recorded MaxErrors errors in the buffer.
+         * @param BufferID The buffer being lexed
+         */
+        [[nodiscard]] bool hasReachedErrorLimit(unsigned BufferID) const {
+            return ErrorLimitReached || (Concurrent && hasConcurrentBufferReachedErrorLimit(BufferID));
+        }
+
     private:
         /// The source manager used for location information
         const SourceManager &SM;
@@ -168,37 +518,206 @@ namespace swift {
         /// Count of remark diagnostics
         unsigned NumRemarks = 0;
 
+        /// The limits on what is reported
+        DiagnosticLimits Limits;
+
+        /// Count of diagnostics of each kind
+        std::array<unsigned, NumDiagIDs> KindCounts{};
+
+        /// Count of diagnostics the limits suppressed
+        unsigned NumSuppressed = 0;
+
+        /// Whether MaxErrors errors have been reported
+        bool ErrorLimitReached = false;
+
+        /// Whether the last error, warning or remark was suppressed, and so
+        /// the notes attached to it are too
+        bool SuppressingNotes = false;
+
+        /// The diagnostic held back in case the next one continues its run
+        std::optional<Diagnostic> Pending;
+
+        /// The buffer containing Pending's location
+        unsigned PendingBufferID = ~0U;
+
+        /// Whether the engine is in concurrent mode
+        bool Concurrent = false;
+
+        /// Identifies the current concurrent mode session among all
+        /// engines', so that threads can cache their buffer for it
+        uint64_t ConcurrentSession = 0;
+
+        /// The buffers of the threads that diagnosed in concurrent mode
+        std::atomic<ConcurrentBuffer *> ConcurrentBuffers{nullptr};
+
+        /// Whether emitted diagnostics are gathered in Batch rather than
+        /// passed on one by one
+        bool Batching = false;
+
+        /// The diagnostics gathered for the consumers' next batch
+        std::vector<Diagnostic> Batch;
+
+        /**
+         * @brief Returns the calling thread's buffer for this session,
+         * registering one if it has none.
+         */
+        ConcurrentBuffer &getConcurrentBuffer();
+
+        /**
+         * @brief Records a diagnostic in the calling thread's buffer, unless
+         * it continues the last one's run or MaxPerKind drops it.
+         * @param ID The kind of diagnostic
+         * @param Loc The location of the diagnostic
+         * @param LastLoc The location of the last diagnostic it stands for
+         * @param Count The number of diagnostics it stands for
+         * @param MakeDiagnostic Builds the diagnostic, if it is recorded
+         */
+        void recordConcurrentDiagnostic(DiagID ID, SourceLocation Loc, SourceLocation LastLoc, unsigned Count,
+                                        llvm::function_ref<Diagnostic()> MakeDiagnostic);
+
+        /**
+         * @brief Returns whether the calling thread has recorded MaxErrors
+         * errors in a buffer since it started diagnosing it.
+         * @param BufferID The buffer
+         */
+        [[nodiscard]] bool hasConcurrentBufferReachedErrorLimit(unsigned BufferID) const;
+
+        /**
+         * @brief Returns the number of diagnostics of a severity recorded in
+         * concurrent mode and not yet merged.
+         * @param Severity The severity level
+         */
+        [[nodiscard]] unsigned getConcurrentCount(DiagnosticSeverity Severity) const;
+
+        /**
+         * @brief Emits a free-form diagnostic.
+         * @param ID The *_message kind of the diagnostic
+         * @param Loc The source location of the diagnostic
+         * @param Message The message
+         */
+        void diagnoseMessage(DiagID ID, SourceLocation Loc, const std::string &Message);
+
+        /**
+         * @brief Adds a diagnostic to the held-back run if it continues it.
+         * @param ID The kind of diagnostic
+         * @param Loc The location of the diagnostic
+         * @param LastLoc The location of the last diagnostic it stands for
+         * @param Count The number of diagnostics it stands for
+         * @return True if the diagnostic was collapsed into the run
+         */
+        bool collapseIntoPending(DiagID ID, SourceLocation Loc, SourceLocation LastLoc, unsigned Count);
+
+        /**
+         * @brief Decides whether the limits let a diagnostic through.
+         * @param ID The kind of diagnostic
+         * @return True if the diagnostic should be reported
+         */
+        bool admitDiagnostic(DiagID ID);
+
+        /**
+         * @brief Counts a diagnostic the limits let through and hands it to
+         * the consumers, or holds it back to collapse the next ones into.
+         * @param Diag The diagnostic
+         */
+        void reportDiagnostic(Diagnostic Diag);
+
+        /**
+         * @brief Counts a diagnostic of the given severity.
+         * @param Severity The severity level
+         */
+        void countDiagnostic(DiagnosticSeverity Severity);
+
         /**
-         * @brief Emits a diagnostic to all consumers.
+         * @brief Emits a diagnostic to all consumers, or adds it to the
+         * batch while batching.
          * @param Diag The diagnostic to emit
          */
-        void emitDiagnostic(const Diagnostic &Diag) const;
+        void emitDiagnostic(const Diagnostic &Diag);
+
+        /**
+         * @brief Passes the batch to all consumers and empties it.
+         */
+        void emitBatch();
     };
 
+    /**
+     * @class DiagnosticQueue
+     * @brief Holds diagnostics back until the code that produced them commits
+     * to them.
+     *
+     * The lexer queues the diagnostics of the token it has lexed ahead and
+     * emits them only once that token is consumed, so that a token lexed
+     * again after backtracking is not diagnosed twice. Queued entries are
+     * fixed-size records kept inline: queueing does not allocate, no message
+     * is formatted until emit() hands the entries to the engine, and clear()
+     * only resets a count.
+     */
     class DiagnosticQueue {
-        std::vector<Diagnostic> Diagnostics;
+    public:
+        /// The most arguments a queued diagnostic can have.
+        static constexpr unsigned MaxArguments = 3;
+
+    private:
+        /// A diagnostic waiting to be emitted.
+        struct QueuedDiagnostic {
+            DiagID ID;
+            SourceLocation Location;
+            uint8_t NumArguments;
+            DiagnosticArgument Arguments[MaxArguments];
+        };
+
+        llvm::SmallVector<QueuedDiagnostic, 4> Diagnostics;
         DiagnosticEngine &Engine;
+        bool EmitOnDestruction;
 
     public:
-        explicit DiagnosticQueue(DiagnosticEngine &engine, bool emitOnDestruction = true)
-            : Engine(engine) {
+        /**
+         * @brief Constructs an empty queue.
+         * @param Engine The engine emit() passes diagnostics to
+         * @param EmitOnDestruction Whether to emit what is still queued when
+         *        the queue is destroyed, rather than dropping it
+         */
+        explicit DiagnosticQueue(DiagnosticEngine &Engine, bool EmitOnDestruction = true)
+            : Engine(Engine), EmitOnDestruction(EmitOnDestruction) {
         }
 
-        void diagnose(const Diagnostic &diag) {
-            Diagnostics.push_back(diag);
+        /// Moving a queue leaves the source empty.
+        DiagnosticQueue(DiagnosticQueue &&) = default;
+
+        ~DiagnosticQueue() {
+            if (EmitOnDestruction)
+                emit();
         }
 
-        void emit() {
-            for (const auto &diag: Diagnostics) {
-                // Engine.diagnose(diag);
-                // TODO: Implement the actual emission logic
-            }
-            Diagnostics.clear();
+        /**
+         * @brief Queues a diagnostic.
+         * @param Loc The source location of the diagnostic
+         * @param ID The kind of diagnostic
+         * @param Args Up to MaxArguments arguments for its format string
+         */
+        template <typename... ArgTypes>
+        void diagnose(SourceLocation Loc, Diag<ArgTypes...> ID, std::type_identity_t<ArgTypes>... Args) {
+            static_assert(sizeof...(Args) <= MaxArguments, "too many diagnostic arguments");
+            Diagnostics.push_back({ID.ID, Loc, uint8_t(sizeof...(Args)), {DiagnosticArgument(Args)...}});
         }
 
+        /**
+         * @brief Passes the queued diagnostics to the engine, in the order
+         * they were queued, and empties the queue.
+         */
+        void emit();
+
         [[nodiscard]] DiagnosticEngine &getDiags() const { return Engine; }
         [[nodiscard]] DiagnosticEngine &getUnderlyingDiags() const { return Engine; }
 
+        /**
+         * @brief Returns the number of queued diagnostics.
+         */
+        [[nodiscard]] size_t size() const { return Diagnostics.size(); }
+
+        /**
+         * @brief Drops the queued diagnostics.
+         */
         void clear() {
             Diagnostics.clear();
         }
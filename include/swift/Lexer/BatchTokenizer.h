@@ -0,0 +1,55 @@
+#ifndef SWIFT_BATCH_TOKENIZER_H
+#define SWIFT_BATCH_TOKENIZER_H
+
+#include "swift/Lexer/Lexer.h"
+#include "swift/Lexer/TokenBuffer.h"
+#include "llvm/ADT/ArrayRef.h"
+
+#include <string>
+#include <vector>
+
+namespace swift {
+  /// Options for tokenizing many buffers at once.
+  struct BatchTokenizeOptions {
+    /// Worker threads to use; 0 means one per hardware thread.
+    unsigned Threads = 0;
+
+    /// As for tokenize().
+    bool KeepComments = true;
+    bool TokenizeInterpolatedString = true;
+  };
+
+  /// The tokens of one file of a batch.
+  struct BatchTokenizeResult {
+    std::string Path;
+    /// ~0U if the file could not be read.
+    unsigned BufferID = ~0U;
+    TokenBuffer Tokens{llvm::StringRef()};
+  };
+
+  /// Lex every buffer in \p BufferIDs into its own TokenBuffer, spreading the
+  /// buffers over a pool of worker threads.
+  ///
+  /// Buffers are handed out largest first so that a single big buffer does
+  /// not end up lexed last, and an idle worker steals work queued for the
+  /// others. The workers diagnose into \p Diags in concurrent mode; once all
+  /// of them are done, the diagnostics are passed on sorted by buffer and
+  /// offset, so the output does not depend on scheduling. If \p Diags is
+  /// already in concurrent mode, that is left to the caller. The result is
+  /// in the order of \p BufferIDs.
+  std::vector<TokenBuffer> tokenizeBuffers(const LangOptions &LangOpts,
+                                           const SourceManager &SM,
+                                           llvm::ArrayRef<unsigned> BufferIDs,
+                                           DiagnosticEngine *Diags = nullptr,
+                                           const BatchTokenizeOptions &Options = {});
+
+  /// Load \p Paths into \p SM and lex them with tokenizeBuffers(). A file
+  /// that cannot be read is reported to \p Diags and gets an empty result.
+  std::vector<BatchTokenizeResult> tokenizeFiles(const LangOptions &LangOpts,
+                                                 SourceManager &SM,
+                                                 llvm::ArrayRef<std::string> Paths,
+                                                 DiagnosticEngine *Diags = nullptr,
+                                                 const BatchTokenizeOptions &Options = {});
+}
+
+#endif // SWIFT_BATCH_TOKENIZER_H
@@ -0,0 +1,73 @@
+#ifndef SWIFT_INCREMENTAL_LEXER_H
+#define SWIFT_INCREMENTAL_LEXER_H
+
+#include "swift/Lexer/Lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace swift {
+  /// IncrementalLexer - Keeps the tokens of a buffer up to date as it is
+  /// edited, lexing only the part of the text an edit can affect.
+  ///
+  /// After an edit, lexing restarts at the last token that starts on a line
+  /// before the edited one, and stops at the first token past the edit that
+  /// matches an old token shifted by the change in length. An edit that
+  /// opens or closes a multi-line string or block comment keeps going until
+  /// the tokens line up again, however far downstream that is.
+  ///
+  /// SourceManager buffers are immutable, so each edit registers the new
+  /// text as a new buffer, named after the original one with the first
+  /// revision number not already in use in the SourceManager appended. The
+  /// buffer of the revision an edit replaces is removed, as is the last one
+  /// when the lexer goes away; the original buffer is left alone. Tokens are
+  /// those Lexer::lex() returns, without the EOF token; string literals are
+  /// not split.
+  class IncrementalLexer {
+  public:
+    IncrementalLexer(const LangOptions &LangOpts, SourceManager &SM,
+                     unsigned BufferID,
+                     CommentRetentionMode RetainComments =
+                         CommentRetentionMode::ReturnAsTokens);
+
+    ~IncrementalLexer();
+
+    IncrementalLexer(const IncrementalLexer &) = delete;
+    IncrementalLexer &operator=(const IncrementalLexer &) = delete;
+
+    /// The buffer the current tokens point into.
+    unsigned getBufferID() const { return BufferID; }
+    llvm::StringRef getBufferText() const { return Text; }
+    llvm::ArrayRef<Token> getTokens() const { return Tokens; }
+
+    /// Which tokens the last edit replaced: [FirstToken, FirstToken +
+    /// RemovedTokens) of the old tokens became [FirstToken, FirstToken +
+    /// InsertedTokens) of the new ones. Every other token kept its kind and
+    /// flags and only moved.
+    struct EditResult {
+      size_t FirstToken = 0;
+      size_t RemovedTokens = 0;
+      size_t InsertedTokens = 0;
+    };
+
+    /// Replaces the \p RemovedLength bytes at \p Offset with \p InsertedText
+    /// and updates the tokens.
+    EditResult applyEdit(unsigned Offset, unsigned RemovedLength,
+                         llvm::StringRef InsertedText);
+
+  private:
+    const LangOptions &LangOpts;
+    SourceManager &SM;
+    const CommentRetentionMode RetainComments;
+    std::string BufferName;
+    unsigned Revision = 0;
+    const unsigned OriginalBufferID;
+    unsigned BufferID;
+    llvm::StringRef Text;
+    std::vector<Token> Tokens;
+  };
+}
+
+#endif // SWIFT_INCREMENTAL_LEXER_H
@@ -12,7 +12,10 @@
 #include "swift/Lexer/CharInfo.h"
 #include "swift/Lexer/LangOptions.h"
 #include "swift/Lexer/Token.h"
+#include "swift/Lexer/TokenBuffer.h"
 #include "swift/Lexer/LexerState.h"
+#include "swift/Lexer/StringSegmentTable.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/SaveAndRestore.h"
 #include "llvm/ADT/SmallString.h"
@@ -93,11 +96,20 @@ namespace swift {
     /// Points to BufferStart or past the end of UTF-8 BOM sequence if it exists.
     const char *ContentStart{};
 
+    /// The runs of bytes the SourceManager found not to be valid UTF-8 when it
+    /// registered the buffer. Characters outside them need decoding but not
+    /// validation.
+    llvm::ArrayRef<std::pair<unsigned, unsigned>> InvalidUTF8Ranges;
+
     /// Pointer to the next not consumed character.
     const char *CurPtr{};
 
     Token NextToken;
 
+    /// The kind NextToken would have had if formToken() had not replaced it
+    /// with tok::eof for starting at or past ArtificialEOF.
+    tok NextTokenKind = tok::NUM_TOKENS;
+
     /// The kind of source we're lexing. This either enables special behavior for
     /// module interfaces, or enables things like the 'sil' keyword if lexing
     /// a .sil file.
@@ -125,6 +137,10 @@ namespace swift {
     /// deep.
     const char *LexerCutOffPoint = nullptr;
 
+    /// If set, every string literal lexed is recorded here with its
+    /// interpolations.
+    StringSegmentTable *SegmentTable = nullptr;
+
     Lexer(const Lexer &) = delete;
 
     void operator=(const Lexer &) = delete;
@@ -208,9 +224,14 @@ namespace swift {
     void lex(Token &Result) {
       Result = NextToken;
 
-      // Emit any diagnostics recorded for this token.
-      if (DiagQueue)
+      // Emit any diagnostics recorded for this token, and stop once the
+      // engine has given up reporting errors; there is no point lexing the
+      // rest of a binary file.
+      if (DiagQueue) {
         DiagQueue->emit();
+        if (DiagQueue->getDiags().hasReachedErrorLimit(BufferID))
+          cutOffLexing();
+      }
 
       if (Result.isNot(tok::eof)) {
         lexImpl();
@@ -258,6 +279,10 @@ namespace swift {
     /// actually lexing it.
     const Token &peekNextToken() const { return NextToken; }
 
+    /// Returns the kind of \c peekNextToken() as lexed, even when it is an
+    /// EOF token because it starts at or past the end of a subrange.
+    tok getNextTokenKindBeforeEOF() const { return NextTokenKind; }
+
     /// Returns the lexer state for the beginning of the given token
     /// location. After restoring the state, lexer will return this token and
     /// continue from there.
@@ -305,6 +330,33 @@ namespace swift {
       restoreState(S);
     }
 
+    /// The position of a lexer before beginSubrange().
+    struct SubrangeState {
+      const char *CurPtr;
+      const char *ArtificialEOF;
+      Token NextToken;
+      std::optional<DiagnosticQueue> DiagQueue;
+    };
+
+    /// Points the lexer at the bytes [Offset, EndOffset) of its buffer, such
+    /// as the expression of a string interpolation, without constructing
+    /// another lexer. lex() returns tok::eof at \p EndOffset, and nothing is
+    /// diagnosed until endSubrange() puts the lexer back where it was.
+    /// Subranges may nest.
+    SubrangeState beginSubrange(unsigned Offset, unsigned EndOffset);
+    void endSubrange(SubrangeState &&Saved);
+
+    /// Records every string literal lexed from now on in \p Table, which
+    /// must be for this lexer's buffer, or stops recording if it is null.
+    ///
+    /// The token the lexer has already lexed ahead is not recorded; to
+    /// record from the start, attach the table and then resetToOffset().
+    void setStringSegmentTable(StringSegmentTable *Table) {
+      assert((!Table || Table->getBufferText().data() == BufferStart) &&
+             "table for the wrong buffer");
+      SegmentTable = Table;
+    }
+
     /// Retrieve the Token referred to by \c Loc.
     ///
     /// \param SM The source manager in which the given source location
@@ -495,14 +547,19 @@ namespace swift {
 
     /// Given a string literal token, separate it into string/expr segments
     /// of a potentially interpolated string.
+    ///
+    /// If \p Table recorded the literal, the segments are built from it;
+    /// otherwise the literal is scanned for interpolations.
     static void getStringLiteralSegments(
       const Token &Str,
       llvm::SmallVectorImpl<StringSegment> &Segments,
-      DiagnosticEngine *Diags);
+      DiagnosticEngine *Diags,
+      const StringSegmentTable *Table = nullptr);
 
     void getStringLiteralSegments(const Token &Str,
                                   llvm::SmallVectorImpl<StringSegment> &Segments) {
-      return getStringLiteralSegments(Str, Segments, getTokenDiags());
+      return getStringLiteralSegments(Str, Segments, getTokenDiags(),
+                                      SegmentTable);
     }
 
     static SourceLocation getSourceLocation(const char *Loc) {
@@ -572,14 +629,15 @@ namespace swift {
 
     void lexImpl();
 
-    // TODO: Remove this when we have a better way to handle diagnostics.
-    // InFlightDiagnostic diagnose(const char *Loc, Diagnostic Diag);
-    //
-    // template<typename ...DiagArgTypes, typename ...ArgTypes>
-    // InFlightDiagnostic diagnose(const char *Loc, Diag<DiagArgTypes...> DiagID,
-    //                             ArgTypes &&...Args) {
-    //   return diagnose(Loc, Diagnostic(DiagID, std::forward<ArgTypes>(Args)...));
-    // }
+    /// Queues the diagnostic \p ID at \p Loc for the token being lexed. Its
+    /// message is formatted with \p Args only if the token is consumed.
+    /// Does nothing if the lexer has no DiagnosticEngine.
+    template <typename... ArgTypes>
+    void diagnose(const char *Loc, Diag<ArgTypes...> ID,
+                  std::type_identity_t<ArgTypes>... Args) {
+      if (DiagQueue)
+        DiagQueue->diagnose(getSourceLocation(Loc), ID, Args...);
+    }
 
     void formToken(tok Kind, const char *TokStart);
 
@@ -588,6 +646,11 @@ namespace swift {
     void formStringLiteralToken(const char *TokStart, bool IsMultilineString,
                                 unsigned CustomDelimiterLen);
 
+    /// Returns the end of the text from \p Ptr on that is known to be valid
+    /// UTF-8: the start of the next invalid run, \p Ptr itself if it is in
+    /// one, or BufferEnd.
+    const char *getValidUTF8End(const char *Ptr) const;
+
     /// Advance to the end of the line.
     /// If EatNewLine is true, CurPtr will be at end of newline character.
     /// Otherwise, CurPtr will be at newline character.
@@ -678,6 +741,31 @@ namespace swift {
                               bool KeepComments = true,
                               bool TokenizeInterpolatedString = true,
                               llvm::ArrayRef<Token> SplitTokens = llvm::ArrayRef<Token>());
+
+  /// Lex the given buffer like tokenize(), storing the tokens in a compact
+  /// TokenBuffer instead of a vector of Tokens.
+  TokenBuffer tokenizeToBuffer(const LangOptions &LangOpts,
+                               const SourceManager &SM, unsigned BufferID,
+                               unsigned Offset = 0, unsigned EndOffset = 0,
+                               DiagnosticEngine *Diags = nullptr,
+                               bool KeepComments = true,
+                               bool TokenizeInterpolatedString = true,
+                               llvm::ArrayRef<Token> SplitTokens = llvm::ArrayRef<Token>());
+
+  /// Lex the given buffer like tokenize(), splitting it into chunks at line
+  /// boundaries that are lexed concurrently on up to \p Threads threads, or
+  /// one per hardware thread if \p Threads is 0.
+  ///
+  /// Chunk boundaries are guesses: a chunk whose first token differs from
+  /// where the previous chunk stopped, because the guess fell inside a
+  /// multi-line string or comment, is lexed again from the end of the
+  /// previous chunk. The result is identical to tokenize(). No diagnostics
+  /// are emitted.
+  std::vector<Token> tokenizeParallel(const LangOptions &LangOpts,
+                                      const SourceManager &SM, unsigned BufferID,
+                                      unsigned Threads = 0,
+                                      bool KeepComments = true,
+                                      bool TokenizeInterpolatedString = true);
 }
 
 #endif //LEXER_H
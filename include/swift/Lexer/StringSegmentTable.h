@@ -0,0 +1,75 @@
+#ifndef SWIFT_STRING_SEGMENT_TABLE_H
+#define SWIFT_STRING_SEGMENT_TABLE_H
+
+#include "swift/Lexer/Token.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace swift {
+  /// StringSegmentTable - Where the interpolations of the string literals in
+  /// one source buffer are, recorded by the lexer while it lexes them.
+  ///
+  /// Attach a table with Lexer::setStringSegmentTable(). Consumers that need
+  /// the segments of a literal the lexer has seen, such as
+  /// Lexer::getStringLiteralSegments(), then look them up here instead of
+  /// scanning the literal again.
+  class StringSegmentTable {
+  public:
+    /// Creates an empty table for literals lexed from \p BufferText, which
+    /// must be the complete text of a single source buffer.
+    explicit StringSegmentTable(llvm::StringRef BufferText)
+      : BufferText(BufferText) {}
+
+    /// Creates an empty table for literals lexed from \p BufferID.
+    StringSegmentTable(const SourceManager &SM, unsigned BufferID)
+      : StringSegmentTable(SM.getBufferContent(BufferID)) {}
+
+    /// An interpolated expression, as byte offsets into the buffer from its
+    /// '(' to just past the matching ')'.
+    struct Interpolation {
+      uint32_t Begin;
+      uint32_t End;
+    };
+
+    /// Records the interpolations, possibly none, of the string literal that
+    /// starts at \p TokenOffset. Recording a literal that is already in the
+    /// table, as happens when the lexer backtracks, leaves the table
+    /// unchanged.
+    void record(unsigned TokenOffset, llvm::ArrayRef<Interpolation> Interpolations);
+
+    /// Returns the interpolations of the string literal that starts at
+    /// \p TokenOffset, in source order, or std::nullopt if the literal was
+    /// not lexed with this table attached.
+    std::optional<llvm::ArrayRef<Interpolation>> lookup(unsigned TokenOffset) const;
+
+    /// Returns the interpolations of the string literal token \p Str.
+    std::optional<llvm::ArrayRef<Interpolation>> lookup(const Token &Str) const {
+      return lookup(Str.getRawText().data() - BufferText.data());
+    }
+
+    llvm::StringRef getBufferText() const { return BufferText; }
+
+    /// The number of string literals recorded.
+    size_t size() const { return Strings.size(); }
+    bool empty() const { return Strings.empty(); }
+    void clear();
+
+  private:
+    struct Entry {
+      uint32_t TokenOffset;
+      uint32_t First;
+      uint32_t Count;
+    };
+
+    llvm::StringRef BufferText;
+    /// Sorted by TokenOffset; literals are almost always recorded in order.
+    std::vector<Entry> Strings;
+    std::vector<Interpolation> Interpolations;
+  };
+}
+
+#endif // SWIFT_STRING_SEGMENT_TABLE_H
@@ -289,6 +289,9 @@ namespace swift {
       return CommentLength != 0;
     }
 
+    /// The length of the raw comment text that precedes the token.
+    unsigned getCommentLength() const { return CommentLength; }
+
     CharSourceRange getCommentRange() const {
       if (CommentLength == 0)
         return CharSourceRange(SourceLocation(llvm::SMLoc::getFromPointer(Text.begin())),
@@ -0,0 +1,130 @@
+#ifndef SWIFT_TOKEN_BUFFER_H
+#define SWIFT_TOKEN_BUFFER_H
+
+#include "swift/Lexer/Token.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace swift {
+  /// TokenBuffer - A compact, column-oriented array of the tokens of one
+  /// source buffer.
+  ///
+  /// Each token costs ten bytes: its kind, its 32-bit offset and length in
+  /// the buffer, and a byte of flags. The rarely used comment length and
+  /// custom delimiter length live in a side table that is only consulted for
+  /// tokens that have one. Full Token values are rebuilt on demand, and the
+  /// kinds are a plain byte array, so scanning for a kind is a memchr.
+  class TokenBuffer {
+  public:
+    /// Creates an empty buffer for tokens lexed from \p BufferText, which
+    /// must be the complete text of a single source buffer.
+    explicit TokenBuffer(llvm::StringRef BufferText) : BufferText(BufferText) {}
+
+    /// Creates an empty buffer for tokens lexed from \p BufferID.
+    TokenBuffer(const SourceManager &SM, unsigned BufferID)
+      : TokenBuffer(SM.getBufferContent(BufferID)) {}
+
+    /// The value returned by find() when there is no match.
+    static constexpr size_t npos = ~size_t(0);
+
+    /// Appends \p Tok, whose text must lie within the buffer.
+    void push_back(const Token &Tok);
+
+    void reserve(size_t N);
+    void clear();
+    /// Releases spare capacity once the buffer is complete.
+    void shrink_to_fit();
+
+    size_t size() const { return Kinds.size(); }
+    bool empty() const { return Kinds.empty(); }
+
+    /// Rebuilds the token at \p Index.
+    Token operator[](size_t Index) const;
+    Token front() const { return (*this)[0]; }
+    Token back() const { return (*this)[size() - 1]; }
+
+    tok getKind(size_t Index) const { return Kinds[Index]; }
+    unsigned getOffset(size_t Index) const { return Offsets[Index]; }
+    unsigned getLength(size_t Index) const { return Lengths[Index]; }
+    bool isAtStartOfLine(size_t Index) const {
+      return Flags[Index] & AtStartOfLineFlag;
+    }
+
+    /// The raw text of the token at \p Index, including the backticks of an
+    /// escaped identifier.
+    llvm::StringRef getRawText(size_t Index) const {
+      return BufferText.substr(Offsets[Index], Lengths[Index]);
+    }
+
+    SourceLocation getLoc(size_t Index) const {
+      return SourceLocation(
+          llvm::SMLoc::getFromPointer(BufferText.data() + Offsets[Index]));
+    }
+
+    /// All token kinds, in order.
+    llvm::ArrayRef<tok> getKinds() const { return Kinds; }
+
+    /// Returns the index of the first token of kind \p Kind at or after
+    /// \p From, or npos.
+    size_t find(tok Kind, size_t From = 0) const;
+
+    /// Returns the number of bytes of heap storage the buffer uses.
+    size_t getMemoryUsage() const;
+
+    /// Iterates over rebuilt Token values.
+    class const_iterator {
+      const TokenBuffer *Buffer;
+      size_t Index;
+
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using value_type = Token;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = Token;
+
+      const_iterator(const TokenBuffer *Buffer, size_t Index)
+        : Buffer(Buffer), Index(Index) {}
+
+      Token operator*() const { return (*Buffer)[Index]; }
+      const_iterator &operator++() { ++Index; return *this; }
+      const_iterator operator++(int) { const_iterator Old = *this; ++Index; return Old; }
+      bool operator==(const const_iterator &Other) const { return Index == Other.Index; }
+      bool operator!=(const const_iterator &Other) const { return Index != Other.Index; }
+      size_t getIndex() const { return Index; }
+    };
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, size()}; }
+
+  private:
+    enum : uint8_t {
+      AtStartOfLineFlag = 1 << 0,
+      EscapedIdentifierFlag = 1 << 1,
+      MultilineStringFlag = 1 << 2,
+      /// The token has an entry in Extras.
+      HasExtraFlag = 1 << 3,
+    };
+
+    /// The fields of a Token that are zero for almost every token.
+    struct Extra {
+      unsigned Index;
+      unsigned CommentLength;
+      unsigned CustomDelimiterLen;
+    };
+
+    llvm::StringRef BufferText;
+    std::vector<tok> Kinds;
+    std::vector<uint32_t> Offsets;
+    std::vector<uint32_t> Lengths;
+    std::vector<uint8_t> Flags;
+    /// Sorted by Index, since tokens are only ever appended.
+    std::vector<Extra> Extras;
+  };
+}
+
+#endif // SWIFT_TOKEN_BUFFER_H
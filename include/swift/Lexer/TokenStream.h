@@ -0,0 +1,131 @@
+#ifndef SWIFT_TOKEN_STREAM_H
+#define SWIFT_TOKEN_STREAM_H
+
+#include "swift/Lexer/Lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <cstddef>
+#include <iterator>
+
+namespace swift {
+  /// Options shared by TokenStream, tokenize() and tokenizeToBuffer().
+  struct TokenizeOptions {
+    /// Byte range of the buffer to lex; 0, 0 lexes the whole buffer.
+    unsigned Offset = 0;
+    unsigned EndOffset = 0;
+
+    DiagnosticEngine *Diags = nullptr;
+
+    /// Return comments as tokens instead of attaching them to the next token.
+    bool KeepComments = true;
+
+    /// Split string literals with interpolations into the literal segments
+    /// and the tokens of the interpolated expressions.
+    bool TokenizeInterpolatedString = true;
+
+    /// Tokens, sorted by location, that replace whatever the lexer produces
+    /// at their location. The parser uses these for tokens it split, such as
+    /// a '>>' that closes two generic argument lists.
+    llvm::ArrayRef<Token> SplitTokens;
+  };
+
+  /// TokenStream - Lexes a buffer lazily, one token at a time.
+  ///
+  /// This is what tokenize() is built on; use it directly when a single pass
+  /// is enough, since it never holds more than the tokens of one string
+  /// literal. The EOF token is not returned.
+  ///
+  /// Interpolated string literals are split without scanning them again:
+  /// the lexer records where their expressions are while lexing them, and
+  /// the expressions are then lexed by the same lexer.
+  ///
+  /// \code
+  ///   for (const Token &Tok : TokenStream(LangOpts, SM, BufferID))
+  ///     ...
+  /// \endcode
+  class TokenStream {
+  public:
+    TokenStream(const LangOptions &LangOpts, const SourceManager &SM,
+                unsigned BufferID, const TokenizeOptions &Options = {});
+
+    TokenStream(const TokenStream &) = delete;
+    TokenStream &operator=(const TokenStream &) = delete;
+
+    /// Stores the next token in \p Result. Returns false, leaving \p Result
+    /// unchanged, once the end of the range has been reached.
+    bool next(Token &Result);
+
+    /// Once next() has returned false, the token the lexer stopped at. At
+    /// the end of a subrange of the buffer, this is the first token that
+    /// starts at or after the end of the range, with the kind and length the
+    /// lexer found for it rather than tok::eof. Its other flags, such as
+    /// those of string literals, are not set.
+    const Token &getStopToken() const {
+      assert(ReachedEOF && "stream has not ended");
+      return StopToken;
+    }
+
+    class iterator {
+      TokenStream *Stream = nullptr;
+      Token Current;
+
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using value_type = Token;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const Token *;
+      using reference = const Token &;
+
+      iterator() = default;
+      explicit iterator(TokenStream &S) : Stream(&S) { ++*this; }
+
+      const Token &operator*() const { return Current; }
+      const Token *operator->() const { return &Current; }
+      iterator &operator++() {
+        if (!Stream->next(Current))
+          Stream = nullptr;
+        return *this;
+      }
+      void operator++(int) { ++*this; }
+
+      /// Only an exhausted iterator compares equal to end().
+      bool operator==(const iterator &Other) const { return Stream == Other.Stream; }
+      bool operator!=(const iterator &Other) const { return Stream != Other.Stream; }
+    };
+
+    /// Starts iterating from the current position; the stream can only be
+    /// traversed once.
+    iterator begin() { return iterator(*this); }
+    iterator end() { return iterator(); }
+
+  private:
+    const bool TokenizeInterpolatedString;
+    /// The string literals the lexer has seen, when splitting them.
+    StringSegmentTable Segments;
+    Lexer L;
+    bool ReachedEOF = false;
+    Token StopToken;
+
+    /// The split tokens that have not been reached yet. Lexed tokens only
+    /// move forward, so a single cursor over the sorted list is enough.
+    llvm::ArrayRef<Token> SplitTokens;
+
+    /// The remaining pieces of a split string literal.
+    llvm::SmallVector<Token, 8> Pending;
+    size_t PendingIndex = 0;
+
+    bool isInterpolated(const Token &Tok) const {
+      if (!TokenizeInterpolatedString || Tok.isNot(tok::string_literal))
+        return false;
+      auto Interpolations = Segments.lookup(Tok);
+      return Interpolations && !Interpolations->empty();
+    }
+
+    /// Appends the literal pieces of \p Str and the tokens of its
+    /// interpolated expressions to Pending.
+    void splitStringLiteral(const Token &Str);
+  };
+}
+
+#endif // SWIFT_TOKEN_STREAM_H
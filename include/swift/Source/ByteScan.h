@@ -0,0 +1,90 @@
+/**
+ * @file ByteScan.h
+ * @brief Vectorized scanners over raw source bytes.
+ *
+ * These routines locate the next "interesting" byte in a source buffer a
+ * block at a time. They use SSE2 on x86-64 (with AVX2 selected at runtime
+ * where it pays off), NEON on AArch64, and a portable scalar loop elsewhere.
+ * Every scanner reads only within [Ptr, End); no padding past End is
+ * required.
+ */
+
+#ifndef SWIFT_SOURCE_BYTE_SCAN_H
+#define SWIFT_SOURCE_BYTE_SCAN_H
+
+#include <cstdint>
+#include <vector>
+
+namespace swift::bytescan {
+    /**
+     * @brief Skips a run of whitespace characters.
+     * @param Ptr Start of the run
+     * @param End End of the readable range
+     * @param SawNewline Set to true if a '\n' or '\r' was skipped; left
+     *        untouched otherwise
+     * @return Pointer to the first byte in [Ptr, End) that is not one of
+     *         ' ', '\t', '\v', '\f', '\n' or '\r', or End if there is none
+     */
+    const char *skipWhitespace(const char *Ptr, const char *End, bool &SawNewline);
+
+    /**
+     * @brief Skips the body of a '//' comment.
+     * @param Ptr Current position inside the comment
+     * @param End End of the readable range
+     * @param StopAtNonASCII Whether bytes >= 0x80 stop the scan; pass false
+     *        when the text is already known to be valid UTF-8
+     * @return Pointer to the first '\n', '\r', NUL or byte >= 0x80 in
+     *         [Ptr, End), or End if there is none
+     */
+    const char *skipLineCommentBody(const char *Ptr, const char *End,
+                                    bool StopAtNonASCII = true);
+
+    /**
+     * @brief Skips the body of a '/' '*' comment.
+     * @param Ptr Current position inside the comment
+     * @param End End of the readable range
+     * @param StopAtNonASCII Whether bytes >= 0x80 stop the scan
+     * @return Pointer to the first '\n', '\r', '*', '/', NUL or byte >= 0x80
+     *         in [Ptr, End), or End if there is none
+     */
+    const char *skipBlockCommentBody(const char *Ptr, const char *End,
+                                     bool StopAtNonASCII = true);
+
+    /**
+     * @brief Skips the ASCII characters of an identifier body.
+     * @param Ptr Current position inside the identifier
+     * @param End End of the readable range
+     * @return Pointer to the first byte in [Ptr, End) that is not one of
+     *         [a-zA-Z0-9_$], or End if there is none. Bytes >= 0x80 always
+     *         stop the scan; the caller decides whether they continue the
+     *         identifier.
+     */
+    const char *skipIdentifierBody(const char *Ptr, const char *End);
+
+    /**
+     * @brief Finds the first byte that is not 7-bit ASCII.
+     * @param Ptr Start of the range
+     * @param End End of the range
+     * @return Pointer to the first byte >= 0x80 in [Ptr, End), or End if the
+     *         range is pure ASCII
+     */
+    const char *findNonASCII(const char *Ptr, const char *End);
+
+    /**
+     * @brief Collects the offsets at which lines start.
+     * @param Ptr Start of the text
+     * @param End End of the text
+     * @param LineStarts Receives, in order, the offset from Ptr of the byte
+     *        after every '\n' in [Ptr, End)
+     */
+    void appendLineStarts(const char *Ptr, const char *End,
+                          std::vector<uint32_t> &LineStarts);
+
+    /**
+     * @brief Returns the name of the instruction set the scanners use on this
+     *        machine, e.g. "avx2", "sse2", "neon" or "scalar".
+     */
+    const char *getImplementationName();
+} // namespace swift::bytescan
+
+#endif // SWIFT_SOURCE_BYTE_SCAN_H
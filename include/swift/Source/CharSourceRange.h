@@ -48,10 +48,7 @@ namespace swift {
          * Start and end must either both be valid or both be invalid.
          */
         CharSourceRange(SourceLocation Start, SourceLocation End)
-            : Start(Start), Length(End.isValid()
-                                       ? End.Value.getPointer() -
-                                         Start.Value.getPointer()
-                                       : 0) {
+            : Start(Start), Length(End.isValid() ? End.getOffsetFrom(Start) : 0) {
             assert(Start.isValid() == End.isValid() &&
                 "Start and end should either both be valid or both be invalid!");
         }
@@ -112,8 +109,7 @@ namespace swift {
         [[nodiscard]] SourceLocation getEnd() const {
             if (Length == 0)
                 return Start;
-            return SourceLocation(llvm::SMLoc::getFromPointer(
-                Start.Value.getPointer() + Length - 1));
+            return Start.getAdvancedLoc(Length - 1);
         }
 
         /**
@@ -0,0 +1,34 @@
+/**
+ * @file MappedSourceBuffer.h
+ * @brief Memory-mapped loading of source files.
+ *
+ * The lexer needs a NUL just past the end of every buffer. A mapped file
+ * gets one for free when its size is not a multiple of the page size, since
+ * the rest of the last page reads as zeros. Otherwise one extra zero page is
+ * mapped right after the file. Either way no byte of the file is copied.
+ */
+
+#ifndef SWIFT_SOURCE_MAPPED_SOURCE_BUFFER_H
+#define SWIFT_SOURCE_MAPPED_SOURCE_BUFFER_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+
+namespace swift {
+    /**
+     * @brief Maps a source file read-only and NUL-terminated.
+     * @param Path Path to the file
+     * @return The buffer, or null if the file could not be mapped
+     *
+     * The kernel is told the file will be read front to back and soon, so it
+     * can start reading ahead before the lexer touches the first page. Only
+     * non-empty regular files on POSIX systems are mapped; for anything else
+     * this returns null and the caller should read the file instead. As with
+     * any mapping, truncating the file while the buffer is alive is not safe.
+     */
+    std::unique_ptr<llvm::MemoryBuffer> mapSourceFile(llvm::StringRef Path);
+} // namespace swift
+
+#endif // SWIFT_SOURCE_MAPPED_SOURCE_BUFFER_H
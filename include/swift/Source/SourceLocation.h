@@ -11,7 +11,63 @@
 
 #include "llvm/Support/SMLoc.h"
 
+#include <cstddef>
+#include <cstdint>
+
+/// When set, a SourceLocation is a 32-bit offset into one process-wide
+/// location space instead of a pointer. Set by the
+/// SWIFT_COMPACT_SOURCE_LOCATIONS CMake option.
+#ifndef SWIFT_COMPACT_SOURCE_LOCATIONS
+#define SWIFT_COMPACT_SOURCE_LOCATIONS 0
+#endif
+
 namespace swift {
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+    /**
+     * @class SourceLocationSpace
+     * @brief The 32-bit offset space compact source locations live in.
+     *
+     * Each registered buffer gets a contiguous range of offsets, one per byte
+     * plus one for its end, so a location can be advanced within its buffer
+     * by plain addition. Offset 0 is never handed out and stands for an
+     * invalid location. The offsets of removed ranges are reused only once
+     * fresh ones run out, so a stale location rarely aliases a new buffer;
+     * running out of both is a fatal error.
+     *
+     * All members are thread-safe. Each thread remembers the last range it
+     * looked up, so consecutive lookups in one buffer take no lock.
+     */
+    class SourceLocationSpace {
+    public:
+        /**
+         * @brief Assigns offsets to the bytes in [Start, End].
+         * @param Start First byte of the buffer
+         * @param End End of the buffer, which also gets an offset
+         */
+        static void addRange(const char *Start, const char *End);
+
+        /**
+         * @brief Releases the range of the buffer starting at Start.
+         * @param Start First byte of a buffer passed to addRange()
+         */
+        static void removeRange(const char *Start);
+
+        /**
+         * @brief Returns the offset of a byte.
+         * @param Ptr Pointer into a registered buffer
+         * @return The offset, or 0 if no registered buffer contains Ptr
+         */
+        [[nodiscard]] static uint32_t getOffset(const char *Ptr);
+
+        /**
+         * @brief Returns the byte at an offset.
+         * @param Offset An offset returned by getOffset()
+         * @return Pointer to the byte, or nullptr if no buffer has the offset
+         */
+        [[nodiscard]] static const char *getPointer(uint32_t Offset);
+    };
+#endif
+
     /**
      * @class SourceLocation
      * @brief Represents a specific location in source code.
@@ -19,11 +75,22 @@ namespace swift {
      * SourceLocation is a lightweight wrapper around LLVM's SMLoc class.
      * It represents a specific position in a source file and provides
      * utilities for working with these positions.
+     *
+     * With SWIFT_COMPACT_SOURCE_LOCATIONS it is instead a 4-byte offset into
+     * SourceLocationSpace. Converting to and from a pointer then costs a
+     * lookup, while arithmetic and comparisons within a buffer do not.
      */
     class SourceLocation {
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+        /// Offset in SourceLocationSpace, or 0 if invalid.
+        uint32_t Offset = 0;
+
+    public:
+#else
     public:
         /// The underlying LLVM source location value
         llvm::SMLoc Value;
+#endif
 
         /// Default constructor creates an invalid location
         SourceLocation() = default;
@@ -32,14 +99,24 @@ namespace swift {
          * @brief Constructs a SourceLocation from an LLVM SMLoc.
          * @param Value The SMLoc value to wrap
          */
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+        explicit SourceLocation(llvm::SMLoc Value)
+            : Offset(Value.isValid() ? SourceLocationSpace::getOffset(Value.getPointer()) : 0) {
+        }
+#else
         explicit SourceLocation(llvm::SMLoc Value) : Value(Value) {
         }
+#endif
 
         /**
          * @brief Checks if this location is valid.
          * @return True if the location is valid
          */
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+        [[nodiscard]] bool isValid() const { return Offset != 0; }
+#else
         [[nodiscard]] bool isValid() const { return Value.isValid(); }
+#endif
         
         /**
          * @brief Checks if this location is invalid.
@@ -60,7 +137,9 @@ namespace swift {
          * @param RHS Right-hand side to compare with
          * @return True if locations are equal
          */
-        bool operator==(const SourceLocation &RHS) const { return RHS.Value == Value; }
+        bool operator==(const SourceLocation &RHS) const {
+            return RHS.getOpaquePointerValue() == getOpaquePointerValue();
+        }
         
         /**
          * @brief Inequality comparison operator.
@@ -76,8 +155,14 @@ namespace swift {
          */
         [[nodiscard]] SourceLocation getAdvancedLoc(const int ByteOffset) const {
             assert(isValid() && "Can't advance an invalid location");
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+            SourceLocation Result;
+            Result.Offset = Offset + ByteOffset;
+            return Result;
+#else
             return SourceLocation(
                 llvm::SMLoc::getFromPointer(Value.getPointer() + ByteOffset));
+#endif
         }
 
         /**
@@ -91,12 +176,50 @@ namespace swift {
             return {};
         }
 
+        /**
+         * @brief Returns the number of bytes from Base to this location.
+         * @param Base A location in the same buffer
+         * @return The byte offset, negative if this location is before Base
+         */
+        [[nodiscard]] ptrdiff_t getOffsetFrom(const SourceLocation Base) const {
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+            return ptrdiff_t(Offset) - ptrdiff_t(Base.Offset);
+#else
+            return Value.getPointer() - Base.Value.getPointer();
+#endif
+        }
+
+        /**
+         * @brief Returns the character this location points to.
+         * @return Pointer into the source buffer, or nullptr if invalid
+         */
+        [[nodiscard]] const char *getPointer() const {
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+            return isValid() ? SourceLocationSpace::getPointer(Offset) : nullptr;
+#else
+            return Value.getPointer();
+#endif
+        }
+
         /**
          * @brief Returns the opaque pointer value of this location.
          * @return Opaque pointer value
+         *
+         * Values of locations in the same buffer are ordered as the
+         * locations are.
          */
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+        [[nodiscard]] const void *getOpaquePointerValue() const {
+            return reinterpret_cast<const void *>(uintptr_t(Offset));
+        }
+#else
         [[nodiscard]] const void *getOpaquePointerValue() const { return Value.getPointer(); }
+#endif
     };
+
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+    static_assert(sizeof(SourceLocation) == 4, "compact source locations should be 4 bytes");
+#endif
 } // namespace swift
 
 #endif // SWIFT_SOURCE_SOURCELOCATION_H
@@ -19,7 +19,72 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/VirtualFileSystem.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+
 namespace swift {
+    /**
+     * @brief What a source buffer's bytes are known to contain.
+     *
+     * Computed once when the buffer is registered so the lexer can skip
+     * per-character UTF-8 validation on text that is already known to be
+     * clean.
+     */
+    struct BufferTextInfo {
+        enum class EncodingKind : uint8_t {
+            /// Every byte is below 0x80.
+            ASCII,
+            /// Contains multi-byte sequences, all of them valid UTF-8.
+            ValidUTF8,
+            /// Contains bytes that are not part of a valid UTF-8 sequence.
+            InvalidUTF8
+        };
+
+        EncodingKind Encoding = EncodingKind::ASCII;
+
+        /// Sorted, non-overlapping [begin, end) byte offsets of every run of
+        /// bytes that is not part of a valid UTF-8 sequence.
+        std::vector<std::pair<unsigned, unsigned>> InvalidRanges;
+
+        /**
+         * @brief Returns true if the whole buffer is valid UTF-8.
+         */
+        [[nodiscard]] bool isValidUTF8() const { return Encoding != EncodingKind::InvalidUTF8; }
+
+        /**
+         * @brief Returns true if no invalid byte lies in [Begin, End).
+         * @param Begin Start offset of the range
+         * @param End End offset of the range
+         */
+        [[nodiscard]] bool isRangeValidUTF8(unsigned Begin, unsigned End) const;
+    };
+
+    /**
+     * @brief How SourceManager::getOrOpenBuffer() reads files.
+     */
+    enum class FileLoadMode {
+        /// Let LLVM decide for each file whether to map or read it.
+        Default,
+        /// Map files with mapSourceFile(), reading only those that cannot be
+        /// mapped.
+        Mapped
+    };
+
+    /**
+     * @brief Counts of the files SourceManager::getOrOpenBuffer() loaded,
+     * split by whether their bytes were mapped or copied into memory.
+     */
+    struct FileLoadStats {
+        unsigned FilesMapped = 0;
+        unsigned FilesCopied = 0;
+        uint64_t BytesMapped = 0;
+        uint64_t BytesCopied = 0;
+    };
+
     /**
      * @class SourceManager
      * @brief Manages source buffers and provides utilities for working with source locations.
@@ -37,23 +102,75 @@ namespace swift {
          */
         SourceManager();
 
+        /**
+         * @brief Destructor. Releases the buffers' location ranges.
+         */
+        ~SourceManager();
+
         /**
          * @brief Adds a memory buffer to the SourceManager.
          * @param Buffer Memory buffer to add
+         * @param IsNullTerminated Whether the buffer is known to have a NUL
+         * at getBufferEnd(), as buffers created with RequiresNullTerminator
+         * or by getMemBufferCopy() do
          * @return Buffer ID for the added buffer
+         *
+         * Every registered buffer is NUL-terminated: unless IsNullTerminated
+         * is set, the buffer is replaced by a terminated copy. The byte at
+         * getBufferEnd() is never read to find out, as it may lie outside
+         * the buffer's memory.
+         *
+         * Callers opt in because llvm::MemoryBuffer does not record whether
+         * it is terminated: a view from getMemBuffer() with
+         * RequiresNullTerminator=false looks the same as one from getFile().
+         * Pass true for buffers from getFile(), getFileOrSTDIN(),
+         * getMemBufferCopy() or a file system's getBufferForFile() with the
+         * default RequiresNullTerminator, which all guarantee the NUL, to
+         * avoid the copy.
          */
-        unsigned addNewSourceBuffer(std::unique_ptr<llvm::MemoryBuffer> Buffer);
+        unsigned addNewSourceBuffer(std::unique_ptr<llvm::MemoryBuffer> Buffer, bool IsNullTerminated = false);
 
         /**
          * @brief Returns a buffer ID for the specified file path.
          * @param FilePath Path to the file
+         * @param Error Set to why the file could not be read, if not null
          * @return Buffer ID if successful, ~0U otherwise
          *
          * If the buffer is not already added, it gets added.
          * If the buffer cannot be read, or already exists with different contents,
          * this returns ~0U.
          */
-        unsigned getOrOpenBuffer(llvm::StringRef FilePath);
+        unsigned getOrOpenBuffer(llvm::StringRef FilePath, std::error_code *Error = nullptr);
+
+        /**
+         * @brief Sets the file system getOrOpenBuffer() reads files from.
+         * @param FS The file system
+         */
+        void setFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS) { FileSystem = std::move(FS); }
+
+        /**
+         * @brief Returns the file system getOrOpenBuffer() reads files from.
+         */
+        [[nodiscard]] llvm::vfs::FileSystem &getFileSystem() const { return *FileSystem; }
+
+        /**
+         * @brief Sets how getOrOpenBuffer() reads files it has not loaded yet.
+         * @param Mode The new load mode
+         *
+         * Files are only mapped from the real file system; with any other,
+         * they are read through it whatever the mode.
+         */
+        void setFileLoadMode(FileLoadMode Mode) { LoadMode = Mode; }
+
+        /**
+         * @brief Returns how getOrOpenBuffer() reads files.
+         */
+        [[nodiscard]] FileLoadMode getFileLoadMode() const { return LoadMode; }
+
+        /**
+         * @brief Returns how the files loaded so far were read.
+         */
+        [[nodiscard]] const FileLoadStats &getFileLoadStats() const { return LoadStats; }
 
         /**
          * @brief Returns the buffer ID for an existing buffer if it exists.
@@ -78,6 +195,15 @@ namespace swift {
             return getMemoryBuffer(BufferID)->getBuffer();
         }
 
+        /**
+         * @brief Returns what is known about the encoding of a buffer's contents.
+         * @param BufferID ID of the buffer
+         * @return The information computed when the buffer was added
+         */
+        [[nodiscard]] const BufferTextInfo &getBufferTextInfo(unsigned BufferID) const {
+            return BufferInfos[BufferID - 1];
+        }
+
         /**
          * @brief Returns the source location for the beginning of the specified buffer.
          * @param BufferID ID of the buffer
@@ -88,7 +214,10 @@ namespace swift {
         /**
          * @brief Returns the source buffer ID for the given location.
          * @param Loc Source location to find buffer for
-         * @return ID of the buffer containing the location
+         * @return ID of the buffer containing the location, or ~0U
+         *
+         * A lookup in the same buffer as the previous one takes constant
+         * time; any other is a binary search over the buffer address ranges.
          */
         [[nodiscard]] unsigned findBufferContainingLoc(SourceLocation Loc) const;
 
@@ -118,6 +247,47 @@ namespace swift {
             return getLocForBufferStart(BufferID).getAdvancedLoc(Offset);
         }
 
+        /**
+         * @brief Returns the line and column of a location.
+         * @param Loc A valid location in one of the buffers
+         * @return The 1-based line and column; columns count bytes
+         *
+         * Lines end at '\n'. The line starts of a buffer are collected the
+         * first time one of its locations is looked up; every lookup after
+         * that is a binary search.
+         */
+        [[nodiscard]] std::pair<unsigned, unsigned> getLineAndColumn(SourceLocation Loc) const;
+
+        /**
+         * @brief Returns the line and column of a location in a known buffer.
+         * @param Loc A valid location in the buffer
+         * @param BufferID ID of the buffer containing the location
+         * @return The 1-based line and column; columns count bytes
+         */
+        [[nodiscard]] std::pair<unsigned, unsigned> getLineAndColumnInBuffer(SourceLocation Loc,
+                                                                             unsigned BufferID) const;
+
+        /**
+         * @brief Returns the location of a line and column.
+         * @param BufferID ID of the buffer
+         * @param Line 1-based line number
+         * @param Col 1-based column, in bytes
+         * @return The location, or an invalid location if the buffer has no
+         *         such line or the line no such column. The column just past
+         *         the end of a line, at its '\n', is valid.
+         */
+        [[nodiscard]] SourceLocation getLocForLineCol(unsigned BufferID, unsigned Line, unsigned Col) const;
+
+        /**
+         * @brief Returns the text of a line, without its line break.
+         * @param BufferID ID of the buffer
+         * @param Line 1-based line number
+         * @return The text, or an empty string if the buffer has no such line
+         *
+         * Looks the line up in the same line table as getLineAndColumn().
+         */
+        [[nodiscard]] llvm::StringRef getLineText(unsigned BufferID, unsigned Line) const;
+
         /**
          * @brief Returns a buffer identifier suitable for display to the user.
          * @param Loc Source location to get display name for
@@ -132,7 +302,7 @@ namespace swift {
          * @return True if LHS is before RHS
          */
         [[nodiscard]] static bool isBeforeInBuffer(const SourceLocation LHS, const SourceLocation RHS) {
-            return LHS.Value.getPointer() < RHS.Value.getPointer();
+            return LHS.getOffsetFrom(RHS) < 0;
         }
 
         /**
@@ -166,19 +336,85 @@ namespace swift {
          */
         [[nodiscard]] CharSourceRange getRangeForBuffer(unsigned BufferID) const;
 
+        /**
+         * @brief Adds a NUL-terminated copy of a memory buffer.
+         * @param Buffer Memory buffer to copy
+         * @return Buffer ID for the added buffer
+         */
         unsigned addMemBufferCopy(const llvm::MemoryBuffer *Buffer);
 
+        /**
+         * @brief Adds a NUL-terminated copy of the given text.
+         * @param InputData Contents of the new buffer
+         * @param BufIdentifier Identifier for the new buffer
+         * @return Buffer ID for the added buffer
+         */
         unsigned addMemBufferCopy(llvm::StringRef InputData, llvm::StringRef BufIdentifier);
 
+        /**
+         * @brief Frees a buffer that is no longer needed.
+         * @param BufferID ID of the buffer
+         *
+         * The buffer's memory is released and its identifier may be used
+         * again. Its ID is not reused and must not be passed to the source
+         * manager again; locations and text in the buffer become dangling.
+         */
+        void removeSourceBuffer(unsigned BufferID);
+
     private:
-        /// LLVM SourceMgr that handles the raw source buffers.
-        llvm::SourceMgr LLVMSourceMgr;
+        /// The source buffers, indexed by buffer ID - 1; null once removed.
+        std::vector<std::unique_ptr<llvm::MemoryBuffer>> Buffers;
 
         /// Virtual file system for accessing source files.
         llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileSystem;
 
+        /// How getOrOpenBuffer() reads files.
+        FileLoadMode LoadMode = FileLoadMode::Default;
+
+        /// How the files loaded so far were read.
+        FileLoadStats LoadStats;
+
         /// Associates buffer identifiers to buffer IDs.
         llvm::DenseMap<llvm::StringRef, unsigned> BufIdentIDMap;
+
+        /// Encoding information for each buffer, indexed by buffer ID - 1.
+        std::vector<BufferTextInfo> BufferInfos;
+
+        /// The offsets at which the lines of a buffer start, collected on
+        /// first use. The first entry is always 0.
+        struct LineTable {
+            std::once_flag Built;
+            std::vector<uint32_t> LineStarts;
+        };
+
+        /// The opaque values of the locations of one buffer, from its first
+        /// byte to its end inclusive, so that a location at the end of a
+        /// buffer belongs to it.
+        struct BufferRange {
+            uintptr_t Start;
+            uintptr_t End;
+            unsigned BufferID;
+        };
+
+        /// The ranges of all buffers, sorted by start.
+        std::vector<BufferRange> BufferRanges;
+
+        /// The location of the start of each buffer, indexed by buffer ID - 1.
+        std::vector<SourceLocation> BufferStarts;
+
+        /// Index in BufferRanges of the buffer found by the last lookup;
+        /// consecutive lookups are usually in the same buffer.
+        mutable std::atomic<size_t> LastBufferRange{0};
+
+        /// Line tables for each buffer, indexed by buffer ID - 1.
+        std::vector<std::unique_ptr<LineTable>> LineTables;
+
+        /**
+         * @brief Returns the line starts of a buffer, collecting them if this
+         *        is the first lookup.
+         * @param BufferID ID of the buffer
+         */
+        const std::vector<uint32_t> &getLineStarts(unsigned BufferID) const;
     };
 } // namespace swift
 
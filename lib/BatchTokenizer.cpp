@@ -0,0 +1,136 @@
+#include "swift/Lexer/BatchTokenizer.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace swift;
+
+namespace {
+  /// One queue of work per worker. A worker takes from the front of its own
+  /// queue and, once that is empty, steals from the back of the others'.
+  /// All work is queued before the workers start.
+  class WorkStealingQueues {
+    struct Queue {
+      std::mutex Lock;
+      std::deque<size_t> Items;
+    };
+    std::vector<Queue> Queues;
+
+  public:
+    explicit WorkStealingQueues(unsigned Workers) : Queues(Workers) {}
+
+    void push(unsigned Worker, size_t Item) {
+      Queues[Worker].Items.push_back(Item);
+    }
+
+    /// Stores the next item for \p Worker in \p Item. Returns false once
+    /// every queue is empty.
+    bool pop(unsigned Worker, size_t &Item) {
+      {
+        Queue &Own = Queues[Worker];
+        std::lock_guard<std::mutex> Guard(Own.Lock);
+        if (!Own.Items.empty()) {
+          Item = Own.Items.front();
+          Own.Items.pop_front();
+          return true;
+        }
+      }
+      for (unsigned I = 1; I != Queues.size(); ++I) {
+        Queue &Victim = Queues[(Worker + I) % Queues.size()];
+        std::lock_guard<std::mutex> Guard(Victim.Lock);
+        if (!Victim.Items.empty()) {
+          Item = Victim.Items.back();
+          Victim.Items.pop_back();
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+}
+
+std::vector<TokenBuffer> swift::tokenizeBuffers(const LangOptions &LangOpts,
+                                                const SourceManager &SM,
+                                                llvm::ArrayRef<unsigned> BufferIDs,
+                                                DiagnosticEngine *Diags,
+                                                const BatchTokenizeOptions &Options) {
+  std::vector<TokenBuffer> Results;
+  Results.reserve(BufferIDs.size());
+  for (unsigned BufferID : BufferIDs)
+    Results.emplace_back(SM, BufferID);
+
+  // Largest first, dealt round-robin so every worker starts on a big one.
+  std::vector<size_t> Order(BufferIDs.size());
+  for (size_t I = 0; I != Order.size(); ++I)
+    Order[I] = I;
+  std::stable_sort(Order.begin(), Order.end(), [&](size_t A, size_t B) {
+    return SM.getBufferContent(BufferIDs[A]).size() >
+           SM.getBufferContent(BufferIDs[B]).size();
+  });
+
+  unsigned Threads = Options.Threads;
+  if (Threads == 0)
+    Threads = std::max(1u, std::thread::hardware_concurrency());
+  Threads = std::max<size_t>(1, std::min<size_t>(Threads, BufferIDs.size()));
+  WorkStealingQueues Queues(Threads);
+  for (size_t I = 0; I != Order.size(); ++I)
+    Queues.push(I % Threads, Order[I]);
+
+  // The workers share the engine in concurrent mode, unless the caller has
+  // already put it in that mode and merges later.
+  const bool MergeDiagnostics = Diags && !Diags->isConcurrent();
+  if (MergeDiagnostics)
+    Diags->beginConcurrentDiagnostics();
+
+  auto Worker = [&](unsigned WorkerIndex) {
+    size_t Index;
+    while (Queues.pop(WorkerIndex, Index))
+      Results[Index] = tokenizeToBuffer(LangOpts, SM, BufferIDs[Index], 0, 0,
+                                        Diags, Options.KeepComments,
+                                        Options.TokenizeInterpolatedString);
+  };
+  std::vector<std::thread> Workers;
+  for (unsigned I = 1; I < Threads; ++I)
+    Workers.emplace_back(Worker, I);
+  Worker(0);
+  for (std::thread &T : Workers)
+    T.join();
+
+  if (MergeDiagnostics) {
+    Diags->mergeConcurrentDiagnostics();
+    // Runs do not span buffers, so nothing else will collapse into the last.
+    Diags->flush();
+  }
+  return Results;
+}
+
+std::vector<BatchTokenizeResult> swift::tokenizeFiles(const LangOptions &LangOpts,
+                                                      SourceManager &SM,
+                                                      llvm::ArrayRef<std::string> Paths,
+                                                      DiagnosticEngine *Diags,
+                                                      const BatchTokenizeOptions &Options) {
+  std::vector<BatchTokenizeResult> Results(Paths.size());
+  std::vector<unsigned> BufferIDs;
+  std::vector<size_t> Loaded;
+  for (size_t I = 0; I != Paths.size(); ++I) {
+    Results[I].Path = Paths[I];
+    unsigned BufferID = SM.getOrOpenBuffer(Paths[I]);
+    if (BufferID == ~0U) {
+      if (Diags)
+        Diags->diagnose(SourceLocation(), diag::error_open_input_file, Paths[I]);
+      continue;
+    }
+    Results[I].BufferID = BufferID;
+    BufferIDs.push_back(BufferID);
+    Loaded.push_back(I);
+  }
+
+  std::vector<TokenBuffer> Tokens =
+      tokenizeBuffers(LangOpts, SM, BufferIDs, Diags, Options);
+  for (size_t I = 0; I != Loaded.size(); ++I)
+    Results[Loaded[I]].Tokens = std::move(Tokens[I]);
+  return Results;
+}
@@ -0,0 +1,411 @@
+/**
+ * @file ByteScan.cpp
+ * @brief Implementation of the vectorized byte scanners.
+ *
+ * Each scanner is written once against a small set of 16-byte block
+ * primitives (SSE2 or NEON) plus a scalar loop for the tail of the range and
+ * for targets without either instruction set. Vector loads never extend past
+ * the end of the range being scanned.
+ */
+
+#include "swift/Source/ByteScan.h"
+
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SWIFT_BYTESCAN_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define SWIFT_BYTESCAN_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define SWIFT_BYTESCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace swift;
+
+namespace {
+
+//===----------------------------------------------------------------------===//
+// 16-byte block primitives
+//===----------------------------------------------------------------------===//
+
+#if SWIFT_BYTESCAN_SSE2
+using Block = __m128i;
+
+/// Number of bits each byte lane contributes to a mask from toMask().
+constexpr unsigned LaneBits = 1;
+constexpr uint64_t AllLanes = 0xFFFF;
+
+inline Block loadBlock(const char *Ptr) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr));
+}
+inline Block splat(char C) { return _mm_set1_epi8(C); }
+inline Block matchByte(Block B, char C) {
+  return _mm_cmpeq_epi8(B, _mm_set1_epi8(C));
+}
+/// Lanes whose unsigned value lies in [Lo, Hi].
+inline Block matchRange(Block B, uint8_t Lo, uint8_t Hi) {
+  Block Shifted = _mm_sub_epi8(B, _mm_set1_epi8(char(Lo)));
+  return _mm_cmpeq_epi8(_mm_min_epu8(Shifted, _mm_set1_epi8(char(Hi - Lo))),
+                        Shifted);
+}
+inline Block blockOr(Block A, Block B) { return _mm_or_si128(A, B); }
+inline uint64_t toMask(Block B) { return uint32_t(_mm_movemask_epi8(B)); }
+#elif SWIFT_BYTESCAN_NEON
+using Block = uint8x16_t;
+
+/// NEON has no movemask; narrowing each 16-bit pair to a nibble gives a
+/// 64-bit mask with four bits per lane.
+constexpr unsigned LaneBits = 4;
+constexpr uint64_t AllLanes = ~uint64_t(0);
+
+inline Block loadBlock(const char *Ptr) {
+  return vld1q_u8(reinterpret_cast<const uint8_t *>(Ptr));
+}
+inline Block splat(char C) { return vdupq_n_u8(uint8_t(C)); }
+inline Block matchByte(Block B, char C) {
+  return vceqq_u8(B, vdupq_n_u8(uint8_t(C)));
+}
+inline Block matchRange(Block B, uint8_t Lo, uint8_t Hi) {
+  return vandq_u8(vcgeq_u8(B, vdupq_n_u8(Lo)), vcleq_u8(B, vdupq_n_u8(Hi)));
+}
+inline Block blockOr(Block A, Block B) { return vorrq_u8(A, B); }
+inline uint64_t toMask(Block B) {
+  return vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(B), 4)), 0);
+}
+#endif
+
+#if SWIFT_BYTESCAN_SSE2 || SWIFT_BYTESCAN_NEON
+#define SWIFT_BYTESCAN_BLOCKS 1
+constexpr unsigned BlockSize = 16;
+
+/// Index of the first lane set in a non-zero mask.
+inline unsigned firstLane(uint64_t Mask) {
+  return unsigned(std::countr_zero(Mask)) / LaneBits;
+}
+
+/// Mask covering the lanes before \p Lane.
+inline uint64_t lanesBefore(unsigned Lane) {
+  return Lane * LaneBits >= 64 ? AllLanes
+                               : (uint64_t(1) << (Lane * LaneBits)) - 1;
+}
+#endif
+
+//===----------------------------------------------------------------------===//
+// Whitespace
+//===----------------------------------------------------------------------===//
+
+const char *skipWhitespaceScalar(const char *Ptr, const char *End,
+                                 bool &SawNewline) {
+  for (; Ptr < End; ++Ptr) {
+    switch (*Ptr) {
+    case '\n':
+    case '\r':
+      SawNewline = true;
+      continue;
+    case ' ':
+    case '\t':
+    case '\v':
+    case '\f':
+      continue;
+    default:
+      return Ptr;
+    }
+  }
+  return Ptr;
+}
+
+#if SWIFT_BYTESCAN_BLOCKS
+const char *skipWhitespaceBlocks(const char *Ptr, const char *End,
+                                 bool &SawNewline) {
+  for (; End - Ptr >= BlockSize; Ptr += BlockSize) {
+    Block B = loadBlock(Ptr);
+    // '\t', '\n', '\v', '\f' and '\r' are the contiguous range 9...13.
+    Block Space = blockOr(matchByte(B, ' '), matchRange(B, '\t', '\r'));
+    Block Newline = blockOr(matchByte(B, '\n'), matchByte(B, '\r'));
+    uint64_t Stop = ~toMask(Space) & AllLanes;
+    uint64_t Newlines = toMask(Newline);
+    if (Stop == 0) {
+      SawNewline |= Newlines != 0;
+      continue;
+    }
+    unsigned Lane = firstLane(Stop);
+    SawNewline |= (Newlines & lanesBefore(Lane)) != 0;
+    return Ptr + Lane;
+  }
+  return skipWhitespaceScalar(Ptr, End, SawNewline);
+}
+#endif
+
+#if SWIFT_BYTESCAN_AVX2
+__attribute__((target("avx2"))) const char *
+skipWhitespaceAVX2(const char *Ptr, const char *End, bool &SawNewline) {
+  const __m256i Blank = _mm256_set1_epi8(' ');
+  const __m256i Tab = _mm256_set1_epi8('\t');
+  const __m256i ControlSpan = _mm256_set1_epi8('\r' - '\t');
+  const __m256i LF = _mm256_set1_epi8('\n');
+  const __m256i CR = _mm256_set1_epi8('\r');
+  for (; End - Ptr >= 32; Ptr += 32) {
+    __m256i B = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr));
+    __m256i Shifted = _mm256_sub_epi8(B, Tab);
+    __m256i Control =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(Shifted, ControlSpan), Shifted);
+    __m256i Space = _mm256_or_si256(_mm256_cmpeq_epi8(B, Blank), Control);
+    __m256i Newline = _mm256_or_si256(_mm256_cmpeq_epi8(B, LF),
+                                      _mm256_cmpeq_epi8(B, CR));
+    uint32_t Stop = ~uint32_t(_mm256_movemask_epi8(Space));
+    uint32_t Newlines = uint32_t(_mm256_movemask_epi8(Newline));
+    if (Stop == 0) {
+      SawNewline |= Newlines != 0;
+      continue;
+    }
+    unsigned Lane = unsigned(std::countr_zero(Stop));
+    SawNewline |= (Newlines & ((uint32_t(1) << Lane) - 1)) != 0;
+    return Ptr + Lane;
+  }
+  return skipWhitespaceBlocks(Ptr, End, SawNewline);
+}
+
+bool hasAVX2() {
+  static const bool Supported = __builtin_cpu_supports("avx2");
+  return Supported;
+}
+#endif
+
+using SkipWhitespaceFn = const char *(*)(const char *, const char *, bool &);
+
+SkipWhitespaceFn selectSkipWhitespace() {
+#if SWIFT_BYTESCAN_AVX2
+  if (hasAVX2())
+    return skipWhitespaceAVX2;
+#endif
+#if SWIFT_BYTESCAN_BLOCKS
+  return skipWhitespaceBlocks;
+#else
+  return skipWhitespaceScalar;
+#endif
+}
+
+//===----------------------------------------------------------------------===//
+// Comment bodies
+//===----------------------------------------------------------------------===//
+
+/// True for the bytes a line comment body cannot skip blindly: line
+/// terminators, NUL and, unless the text is known to be valid, the lead or
+/// continuation bytes of UTF-8 sequences.
+inline bool isLineCommentStop(char C, bool StopAtNonASCII) {
+  return C == '\n' || C == '\r' || C == '\0' ||
+         (StopAtNonASCII && (signed char)C < 0);
+}
+
+/// Block comments additionally stop at the '*' and '/' that may open or
+/// close a nested comment.
+inline bool isBlockCommentStop(char C, bool StopAtNonASCII) {
+  return isLineCommentStop(C, StopAtNonASCII) || C == '*' || C == '/';
+}
+
+#if SWIFT_BYTESCAN_BLOCKS
+inline Block matchLineCommentStop(Block B, bool StopAtNonASCII) {
+  Block Stops = blockOr(blockOr(matchByte(B, '\n'), matchByte(B, '\r')),
+                        matchByte(B, '\0'));
+  return StopAtNonASCII ? blockOr(Stops, matchRange(B, 0x80, 0xFF)) : Stops;
+}
+#endif
+
+//===----------------------------------------------------------------------===//
+// Identifiers
+//===----------------------------------------------------------------------===//
+
+/// True for [a-zA-Z0-9_$]. Setting bit 5 folds upper case onto lower case
+/// without moving any other byte into 'a'...'z'.
+inline bool isIdentifierBodyByte(char C) {
+  auto U = (unsigned char)C;
+  return (unsigned char)((U | 0x20) - 'a') < 26 ||
+         (unsigned char)(U - '0') < 10 || U == '_' || U == '$';
+}
+
+#if SWIFT_BYTESCAN_BLOCKS
+inline Block matchIdentifierBody(Block B) {
+  Block Letters = matchRange(blockOr(B, splat(0x20)), 'a', 'z');
+  return blockOr(blockOr(Letters, matchRange(B, '0', '9')),
+                 blockOr(matchByte(B, '_'), matchByte(B, '$')));
+}
+#endif
+
+//===----------------------------------------------------------------------===//
+// Line starts
+//===----------------------------------------------------------------------===//
+
+void appendLineStartsScalar(const char *Begin, const char *Ptr,
+                            const char *End,
+                            std::vector<uint32_t> &LineStarts) {
+  for (; Ptr < End; ++Ptr)
+    if (*Ptr == '\n')
+      LineStarts.push_back(uint32_t(Ptr - Begin) + 1);
+}
+
+#if SWIFT_BYTESCAN_BLOCKS
+void appendLineStartsBlocks(const char *Begin, const char *Ptr,
+                            const char *End,
+                            std::vector<uint32_t> &LineStarts) {
+  for (; End - Ptr >= BlockSize; Ptr += BlockSize) {
+    uint64_t Newlines = toMask(matchByte(loadBlock(Ptr), '\n'));
+    while (Newlines) {
+      unsigned Lane = firstLane(Newlines);
+      LineStarts.push_back(uint32_t(Ptr - Begin) + Lane + 1);
+      Newlines &= ~lanesBefore(Lane + 1);
+    }
+  }
+  appendLineStartsScalar(Begin, Ptr, End, LineStarts);
+}
+#endif
+
+#if SWIFT_BYTESCAN_AVX2
+__attribute__((target("avx2"))) void
+appendLineStartsAVX2(const char *Begin, const char *Ptr, const char *End,
+                     std::vector<uint32_t> &LineStarts) {
+  const __m256i LF = _mm256_set1_epi8('\n');
+  for (; End - Ptr >= 32; Ptr += 32) {
+    __m256i B = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr));
+    uint32_t Newlines = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(B, LF)));
+    for (; Newlines; Newlines &= Newlines - 1)
+      LineStarts.push_back(uint32_t(Ptr - Begin) +
+                           unsigned(std::countr_zero(Newlines)) + 1);
+  }
+  appendLineStartsBlocks(Begin, Ptr, End, LineStarts);
+}
+#endif
+
+using AppendLineStartsFn = void (*)(const char *, const char *, const char *,
+                                    std::vector<uint32_t> &);
+
+AppendLineStartsFn selectAppendLineStarts() {
+#if SWIFT_BYTESCAN_AVX2
+  if (hasAVX2())
+    return appendLineStartsAVX2;
+#endif
+#if SWIFT_BYTESCAN_BLOCKS
+  return appendLineStartsBlocks;
+#else
+  return appendLineStartsScalar;
+#endif
+}
+
+} // end anonymous namespace
+
+/**
+ * Skips whitespace, using the widest block scanner the CPU supports.
+ */
+const char *bytescan::skipWhitespace(const char *Ptr, const char *End,
+                                     bool &SawNewline) {
+  static const SkipWhitespaceFn Impl = selectSkipWhitespace();
+  return Impl(Ptr, End, SawNewline);
+}
+
+/**
+ * Skips line comment text up to the next byte that needs attention.
+ */
+const char *bytescan::skipLineCommentBody(const char *Ptr, const char *End,
+                                          bool StopAtNonASCII) {
+#if SWIFT_BYTESCAN_BLOCKS
+  for (; End - Ptr >= BlockSize; Ptr += BlockSize) {
+    Block B = loadBlock(Ptr);
+    if (uint64_t Stop = toMask(matchLineCommentStop(B, StopAtNonASCII)))
+      return Ptr + firstLane(Stop);
+  }
+#endif
+  while (Ptr < End && !isLineCommentStop(*Ptr, StopAtNonASCII))
+    ++Ptr;
+  return Ptr;
+}
+
+/**
+ * Skips block comment text up to the next byte that needs attention.
+ */
+const char *bytescan::skipBlockCommentBody(const char *Ptr, const char *End,
+                                           bool StopAtNonASCII) {
+#if SWIFT_BYTESCAN_BLOCKS
+  for (; End - Ptr >= BlockSize; Ptr += BlockSize) {
+    Block B = loadBlock(Ptr);
+    Block Stops = blockOr(matchLineCommentStop(B, StopAtNonASCII),
+                          blockOr(matchByte(B, '*'), matchByte(B, '/')));
+    if (uint64_t Stop = toMask(Stops))
+      return Ptr + firstLane(Stop);
+  }
+#endif
+  while (Ptr < End && !isBlockCommentStop(*Ptr, StopAtNonASCII))
+    ++Ptr;
+  return Ptr;
+}
+
+/**
+ * Skips identifier characters. Most identifiers end within the first block,
+ * so there is no wider variant.
+ */
+const char *bytescan::skipIdentifierBody(const char *Ptr, const char *End) {
+#if SWIFT_BYTESCAN_BLOCKS
+  for (; End - Ptr >= BlockSize; Ptr += BlockSize) {
+    Block B = loadBlock(Ptr);
+    if (uint64_t Stop = ~toMask(matchIdentifierBody(B)) & AllLanes)
+      return Ptr + firstLane(Stop);
+  }
+#endif
+  while (Ptr < End && isIdentifierBodyByte(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+/**
+ * Finds the first non-ASCII byte, testing four blocks per iteration since
+ * most source buffers contain none at all.
+ */
+const char *bytescan::findNonASCII(const char *Ptr, const char *End) {
+#if SWIFT_BYTESCAN_BLOCKS
+  for (; End - Ptr >= 4 * BlockSize; Ptr += 4 * BlockSize) {
+    Block Any = blockOr(blockOr(loadBlock(Ptr), loadBlock(Ptr + BlockSize)),
+                        blockOr(loadBlock(Ptr + 2 * BlockSize),
+                                loadBlock(Ptr + 3 * BlockSize)));
+    if (toMask(matchRange(Any, 0x80, 0xFF)))
+      break;
+  }
+  for (; End - Ptr >= BlockSize; Ptr += BlockSize) {
+    if (uint64_t High = toMask(matchRange(loadBlock(Ptr), 0x80, 0xFF)))
+      return Ptr + firstLane(High);
+  }
+#endif
+  while (Ptr < End && (signed char)*Ptr >= 0)
+    ++Ptr;
+  return Ptr;
+}
+
+/**
+ * Collects line starts, using the widest block scanner the CPU supports.
+ */
+void bytescan::appendLineStarts(const char *Ptr, const char *End,
+                                std::vector<uint32_t> &LineStarts) {
+  static const AppendLineStartsFn Impl = selectAppendLineStarts();
+  Impl(Ptr, Ptr, End, LineStarts);
+}
+
+/**
+ * Returns the name of the instruction set selected at runtime.
+ */
+const char *bytescan::getImplementationName() {
+#if SWIFT_BYTESCAN_AVX2
+  if (hasAVX2())
+    return "avx2";
+#endif
+#if SWIFT_BYTESCAN_SSE2
+  return "sse2";
+#elif SWIFT_BYTESCAN_NEON
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,346 @@
+/**
+ * @file DiagnosticConsumers.cpp
+ * @brief Implementation of the streaming diagnostic consumers.
+ */
+
+#include "swift/Diagnostic/DiagnosticConsumers.h"
+#include "llvm/Support/ConvertUTF.h"
+
+#include <algorithm>
+#include <charconv>
+#include <tuple>
+
+namespace swift {
+    namespace {
+        /// Returns the name a severity is written with in text and JSON Lines.
+        llvm::StringRef getSeverityName(DiagnosticSeverity Severity) {
+            switch (Severity) {
+                case DiagnosticSeverity::Error:
+                    return "error";
+                case DiagnosticSeverity::Warning:
+                    return "warning";
+                case DiagnosticSeverity::Note:
+                    return "note";
+                case DiagnosticSeverity::Remark:
+                    return "remark";
+            }
+            return "error";
+        }
+
+        /// Returns the SARIF level of a severity; SARIF has no remarks.
+        llvm::StringRef getSARIFLevel(DiagnosticSeverity Severity) {
+            switch (Severity) {
+                case DiagnosticSeverity::Error:
+                    return "error";
+                case DiagnosticSeverity::Warning:
+                    return "warning";
+                case DiagnosticSeverity::Note:
+                    return "note";
+                case DiagnosticSeverity::Remark:
+                    return "none";
+            }
+            return "error";
+        }
+
+        /// Whether a byte continues a UTF-8 sequence rather than starting a
+        /// character.
+        bool isUTF8Continuation(char C) {
+            return (static_cast<unsigned char>(C) & 0xC0) == 0x80;
+        }
+
+        /// Percent-encodes the bytes of a path that may not appear as they
+        /// are in a URI reference.
+        std::string getURIForPath(llvm::StringRef Path) {
+            static constexpr char Hex[] = "0123456789ABCDEF";
+            std::string URI;
+            URI.reserve(Path.size());
+            for (const char C : Path) {
+                const auto Byte = static_cast<unsigned char>(C);
+                if ((Byte >= 'a' && Byte <= 'z') || (Byte >= 'A' && Byte <= 'Z') || (Byte >= '0' && Byte <= '9') ||
+                    llvm::StringRef("-._~/:@!$&'()*+,;=").contains(C)) {
+                    URI += C;
+                } else {
+                    URI += '%';
+                    URI += Hex[Byte >> 4];
+                    URI += Hex[Byte & 0xF];
+                }
+            }
+            return URI;
+        }
+    } // namespace
+
+    StreamingDiagnosticConsumer::StreamingDiagnosticConsumer(std::ostream &OS, size_t BufferSize)
+        : OS(OS), BufferSize(BufferSize) {
+        // Room for the diagnostic that fills the buffer, so that it rarely
+        // has to grow.
+        Out.reserve(BufferSize + 1024);
+    }
+
+    StreamingDiagnosticConsumer::~StreamingDiagnosticConsumer() {
+        finishProcessing();
+    }
+
+    void StreamingDiagnosticConsumer::handleDiagnostic(const Diagnostic &Diag, const SourceManager &SM) {
+        handle(Diag, SM);
+    }
+
+    void StreamingDiagnosticConsumer::handleDiagnostics(llvm::ArrayRef<Diagnostic> Diags, const SourceManager &SM) {
+        for (const Diagnostic &Diag : Diags)
+            handle(Diag, SM);
+    }
+
+    void StreamingDiagnosticConsumer::finishProcessing() {
+        if (Finished)
+            return;
+        Finished = true;
+        writeEnd();
+        flush();
+    }
+
+    void StreamingDiagnosticConsumer::flush() {
+        if (Out.empty())
+            return;
+        OS.write(Out.data(), static_cast<std::streamsize>(Out.size()));
+        Out.clear();
+    }
+
+    void StreamingDiagnosticConsumer::handle(const Diagnostic &Diag, const SourceManager &SM) {
+        assert(!Finished && "diagnostic after the consumer finished");
+        if (Diag.Severity == DiagnosticSeverity::Error)
+            ++NumErrors;
+
+        ResolvedLocation Loc;
+        const unsigned BufferID = Diag.Location.isValid() ? SM.findBufferContainingLoc(Diag.Location) : ~0U;
+        if (BufferID != ~0U) {
+            Loc.File = SM.getMemoryBuffer(BufferID)->getBufferIdentifier();
+            Loc.Offset = SM.getLocOffsetInBuffer(Diag.Location, BufferID);
+            std::tie(Loc.Line, Loc.Column) = SM.getLineAndColumnInBuffer(Diag.Location, BufferID);
+            Loc.LineText = SM.getLineText(BufferID, Loc.Line);
+
+            // Quote a long line around the column, starting on a character.
+            const unsigned Column = std::min<size_t>(Loc.Column - 1, Loc.LineText.size());
+            size_t Start = 0;
+            if (Loc.LineText.size() > MaxSnippetLength) {
+                Start = std::min<size_t>(Column - std::min(Column, MaxSnippetLength / 2),
+                                         Loc.LineText.size() - MaxSnippetLength);
+                while (Start != 0 && isUTF8Continuation(Loc.LineText[Start]))
+                    --Start;
+            }
+            Loc.Snippet = Loc.LineText.substr(Start, MaxSnippetLength);
+            Loc.SnippetColumn = Column - Start;
+        }
+
+        writeDiagnostic(Diag, Loc);
+        if (Out.size() >= BufferSize)
+            flush();
+    }
+
+    void StreamingDiagnosticConsumer::appendJSONString(llvm::StringRef String) {
+        static constexpr char Hex[] = "0123456789abcdef";
+        const char *Ptr = String.begin();
+        const char *const End = String.end();
+        while (Ptr != End) {
+            // Copy the run of characters that need no escaping at once.
+            const char *Run = Ptr;
+            while (Run != End && static_cast<unsigned char>(*Run) >= 0x20 && static_cast<unsigned char>(*Run) < 0x80 &&
+                   *Run != '"' && *Run != '\\')
+                ++Run;
+            Out.append(Ptr, Run);
+            Ptr = Run;
+            if (Ptr == End)
+                break;
+
+            const auto Byte = static_cast<unsigned char>(*Ptr);
+            if (Byte >= 0x80) {
+                const unsigned Length = llvm::getNumBytesForUTF8(Byte);
+                const auto *Sequence = reinterpret_cast<const llvm::UTF8 *>(Ptr);
+                if (Length <= unsigned(End - Ptr) && llvm::isLegalUTF8Sequence(Sequence, Sequence + Length)) {
+                    Out.append(Ptr, Length);
+                    Ptr += Length;
+                } else {
+                    Out += "\\ufffd";
+                    ++Ptr;
+                }
+                continue;
+            }
+
+            switch (Byte) {
+                case '"':
+                    Out += "\\\"";
+                    break;
+                case '\\':
+                    Out += "\\\\";
+                    break;
+                case '\n':
+                    Out += "\\n";
+                    break;
+                case '\r':
+                    Out += "\\r";
+                    break;
+                case '\t':
+                    Out += "\\t";
+                    break;
+                default:
+                    Out += "\\u00";
+                    Out += Hex[Byte >> 4];
+                    Out += Hex[Byte & 0xF];
+                    break;
+            }
+            ++Ptr;
+        }
+    }
+
+    void StreamingDiagnosticConsumer::appendUnsigned(uint64_t Value) {
+        char Digits[20];
+        const auto Result = std::to_chars(std::begin(Digits), std::end(Digits), Value);
+        Out.append(Digits, Result.ptr);
+    }
+
+    void TextDiagnosticConsumer::writeDiagnostic(const Diagnostic &Diag, const ResolvedLocation &Loc) {
+        if (!Loc.File.empty()) {
+            Out += Loc.File;
+            Out += ':';
+            appendUnsigned(Loc.Line);
+            Out += ':';
+            appendUnsigned(Loc.Column);
+            Out += ": ";
+        }
+        Out += getSeverityName(Diag.Severity);
+        Out += ": ";
+        Out += Diag.Message;
+        if (Diag.Count > 1) {
+            Out += " (";
+            appendUnsigned(Diag.Count);
+            Out += " times)";
+        }
+        Out += '\n';
+
+        if (!ShowSnippets || Loc.File.empty())
+            return;
+        Out += Loc.Snippet;
+        Out += '\n';
+        // Line the caret up with the column, keeping tabs and counting each
+        // UTF-8 character as one column.
+        for (const char C : Loc.Snippet.substr(0, Loc.SnippetColumn)) {
+            if (C == '\t')
+                Out += '\t';
+            else if (!isUTF8Continuation(C))
+                Out += ' ';
+        }
+        Out += "^\n";
+    }
+
+    void JSONLinesDiagnosticConsumer::writeDiagnostic(const Diagnostic &Diag, const ResolvedLocation &Loc) {
+        Out += '{';
+        if (!Loc.File.empty()) {
+            Out += "\"file\":\"";
+            appendJSONString(Loc.File);
+            Out += "\",\"line\":";
+            appendUnsigned(Loc.Line);
+            Out += ",\"column\":";
+            appendUnsigned(Loc.Column);
+            Out += ",\"offset\":";
+            appendUnsigned(Loc.Offset);
+            Out += ',';
+        }
+        Out += "\"severity\":\"";
+        Out += getSeverityName(Diag.Severity);
+        Out += "\",\"id\":\"";
+        Out += getDiagnosticName(Diag.ID);
+        Out += "\",\"message\":\"";
+        appendJSONString(Diag.Message);
+        Out += "\",\"count\":";
+        appendUnsigned(Diag.Count);
+        if (!Loc.File.empty()) {
+            Out += ",\"snippet\":\"";
+            appendJSONString(Loc.Snippet);
+            Out += '"';
+        }
+        Out += "}\n";
+    }
+
+    SARIFDiagnosticConsumer::SARIFDiagnosticConsumer(std::ostream &OS, size_t BufferSize)
+        : StreamingDiagnosticConsumer(OS, BufferSize) {
+        Out += "{\"version\":\"2.1.0\","
+               "\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\","
+               "\"runs\":[{\"tool\":{\"driver\":{\"name\":\"swiftc\"}},"
+               "\"columnKind\":\"utf16CodeUnits\",\"results\":[";
+    }
+
+    SARIFDiagnosticConsumer::~SARIFDiagnosticConsumer() {
+        // The base class destructor cannot reach writeEnd().
+        finishProcessing();
+    }
+
+    void SARIFDiagnosticConsumer::writeDiagnostic(const Diagnostic &Diag, const ResolvedLocation &Loc) {
+        Out += FirstResult ? "\n" : ",\n";
+        FirstResult = false;
+
+        Out += "{\"ruleId\":\"";
+        Out += getDiagnosticName(Diag.ID);
+        Out += "\",\"level\":\"";
+        Out += getSARIFLevel(Diag.Severity);
+        Out += "\",\"message\":{\"text\":\"";
+        appendJSONString(Diag.Message);
+        Out += "\"}";
+
+        if (!Loc.File.empty()) {
+            // Count the column in UTF-16 code units, carrying on from the
+            // last result if it was further back on the same line.
+            const unsigned ColumnBytes = std::min<size_t>(Loc.Column - 1, Loc.LineText.size());
+            if (CountedLine != Loc.LineText.data() || CountedBytes > ColumnBytes) {
+                CountedLine = Loc.LineText.data();
+                CountedBytes = 0;
+                CountedUnits = 0;
+            }
+            for (; CountedBytes != ColumnBytes; ++CountedBytes) {
+                const auto Byte = static_cast<unsigned char>(Loc.LineText[CountedBytes]);
+                // Characters outside the BMP, with 4-byte encodings, take two.
+                if (!isUTF8Continuation(char(Byte)))
+                    CountedUnits += Byte >= 0xF0 ? 2 : 1;
+            }
+
+            Out += ",\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":\"";
+            appendJSONString(getURIForPath(Loc.File));
+            Out += "\"},\"region\":{\"startLine\":";
+            appendUnsigned(Loc.Line);
+            Out += ",\"startColumn\":";
+            appendUnsigned(CountedUnits + 1);
+            Out += ",\"byteOffset\":";
+            appendUnsigned(Loc.Offset);
+            Out += '}';
+            // The context region is the whole line, so only quote it whole.
+            if (Loc.Snippet.size() == Loc.LineText.size()) {
+                Out += ",\"contextRegion\":{\"startLine\":";
+                appendUnsigned(Loc.Line);
+                Out += ",\"snippet\":{\"text\":\"";
+                appendJSONString(Loc.LineText);
+                Out += "\"}}";
+            }
+            Out += "}}]";
+        }
+
+        if (Diag.Count > 1) {
+            Out += ",\"occurrenceCount\":";
+            appendUnsigned(Diag.Count);
+        }
+        Out += '}';
+    }
+
+    void SARIFDiagnosticConsumer::writeEnd() {
+        Out += "\n]}]}\n";
+    }
+
+    std::unique_ptr<StreamingDiagnosticConsumer> createStreamingDiagnosticConsumer(DiagnosticOutputFormat Format,
+                                                                                   std::ostream &OS) {
+        switch (Format) {
+            case DiagnosticOutputFormat::Text:
+                return std::make_unique<TextDiagnosticConsumer>(OS);
+            case DiagnosticOutputFormat::JSONLines:
+                return std::make_unique<JSONLinesDiagnosticConsumer>(OS);
+            case DiagnosticOutputFormat::SARIF:
+                return std::make_unique<SARIFDiagnosticConsumer>(OS);
+        }
+        return std::make_unique<TextDiagnosticConsumer>(OS);
+    }
+} // namespace swift
@@ -8,58 +8,491 @@
  */
 
 #include "swift/Diagnostic/DiagnosticEngine.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
 
 namespace swift {
+    namespace {
+        /// What DiagnosticKinds.def says about a kind of diagnostic.
+        struct DiagnosticInfo {
+            DiagnosticSeverity Severity;
+            llvm::StringRef Format;
+            llvm::StringRef Name;
+            unsigned NumArguments;
+        };
+
+        constexpr DiagnosticInfo DiagnosticInfos[] = {
+#define DIAG(KIND, ID, Text, Signature) \
+            {DiagnosticSeverity::KIND, {Text, sizeof(Text) - 1}, {#ID, sizeof(#ID) - 1}, \
+             decltype(diag::ID)::NumArguments},
+#include "swift/Diagnostic/DiagnosticKinds.def"
+        };
+        static_assert(std::size(DiagnosticInfos) == NumDiagIDs);
+
+        /// How far apart, in bytes, two diagnostics of a run can be: one
+        /// character, the most the lexer advances between the diagnostics
+        /// it draws from every byte of a broken encoding.
+        constexpr uintptr_t MaxCollapseDistance = 4;
+
+        /// The most diagnostics the merge gathers before passing them on,
+        /// enough to amortize the calls without holding on to a flood.
+        constexpr size_t MaxBatchSize = 1024;
+
+        /// Hands out concurrent mode sessions; 0 is none.
+        std::atomic<uint64_t> NextConcurrentSession{1};
+
+        /// The buffer this thread last used in concurrent mode, valid while
+        /// its engine is still in the same session.
+        struct CachedConcurrentBuffer {
+            uint64_t Session = 0;
+            DiagnosticEngine::ConcurrentBuffer *Buffer = nullptr;
+        };
+
+        thread_local CachedConcurrentBuffer LastConcurrentBuffer;
+    } // namespace
+
+    /**
+     * The diagnostics one thread recorded in concurrent mode. Only that
+     * thread writes to it until the merge; other threads only read the
+     * counters.
+     */
+    struct DiagnosticEngine::ConcurrentBuffer {
+        /// A diagnostic and where it sorts.
+        struct Record {
+            Diagnostic Diag;
+            /// The buffer containing the diagnostic, 0 if none.
+            unsigned BufferID;
+            unsigned Offset;
+            /// The offset of the last diagnostic in its run.
+            unsigned LastOffset;
+        };
+
+        std::vector<Record> Records;
+
+        /// The buffer of the last diagnostic recorded, and how many errors
+        /// this thread has recorded in it since it started on it.
+        unsigned CurrentBufferID = 0;
+        unsigned CurrentBufferErrors = 0;
+
+        /// How many diagnostics of each kind this thread has recorded in
+        /// each buffer, keyed by buffer ID and kind, for MaxPerKind.
+        llvm::DenseMap<std::pair<unsigned, unsigned>, unsigned> KindCounts;
+
+        /// Diagnostics MaxPerKind dropped, and whether the last error,
+        /// warning or remark was one of them, so that its notes are too.
+        unsigned Suppressed = 0;
+        bool SuppressingNotes = false;
+
+        /// Recorded diagnostics, indexed by severity.
+        std::atomic<unsigned> Counts[4] = {};
+
+        /// The next buffer in DiagnosticEngine::ConcurrentBuffers.
+        ConcurrentBuffer *Next = nullptr;
+    };
+
+    /**
+     * Whether a kind of diagnostic is one of the free-form *_message kinds,
+     * which MaxPerKind does not limit.
+     */
+    static bool isFreeForm(DiagID ID) {
+        return ID == DiagID::error_message || ID == DiagID::warning_message || ID == DiagID::note_message ||
+               ID == DiagID::remark_message;
+    }
+
+    DiagnosticSeverity getDiagnosticSeverity(DiagID ID) {
+        return DiagnosticInfos[unsigned(ID)].Severity;
+    }
+
+    llvm::StringRef getDiagnosticFormat(DiagID ID) {
+        return DiagnosticInfos[unsigned(ID)].Format;
+    }
+
+    llvm::StringRef getDiagnosticName(DiagID ID) {
+        return DiagnosticInfos[unsigned(ID)].Name;
+    }
+
     DiagnosticEngine::DiagnosticEngine(const SourceManager &SM) : SM(SM) {
     }
 
+    DiagnosticEngine::~DiagnosticEngine() {
+        if (Concurrent)
+            mergeConcurrentDiagnostics();
+        finishProcessing();
+    }
+
+    void DiagnosticEngine::setLimits(const DiagnosticLimits &NewLimits) {
+        if (!NewLimits.CollapseAdjacent)
+            flush();
+        Limits = NewLimits;
+    }
+
+    void DiagnosticEngine::flush() {
+        if (!Pending)
+            return;
+        emitDiagnostic(*Pending);
+        Pending.reset();
+    }
+
+    void DiagnosticEngine::finishProcessing() {
+        assert(!Concurrent && "cannot finish in concurrent mode");
+        flush();
+        for (const auto &Consumer: Consumers)
+            Consumer->finishProcessing();
+    }
+
     void DiagnosticEngine::addConsumer(std::unique_ptr<DiagnosticConsumer> Consumer) {
+        assert(!Concurrent && "consumers cannot be added in concurrent mode");
         Consumers.push_back(std::move(Consumer));
     }
 
+    void DiagnosticEngine::beginConcurrentDiagnostics() {
+        assert(!Concurrent && "already in concurrent mode");
+        // What was reported before comes first.
+        flush();
+        ConcurrentSession = NextConcurrentSession.fetch_add(1, std::memory_order_relaxed);
+        Concurrent = true;
+    }
+
+    DiagnosticEngine::ConcurrentBuffer &DiagnosticEngine::getConcurrentBuffer() {
+        if (LastConcurrentBuffer.Session == ConcurrentSession)
+            return *LastConcurrentBuffer.Buffer;
+        auto *Buffer = new ConcurrentBuffer;
+        Buffer->Next = ConcurrentBuffers.load(std::memory_order_relaxed);
+        while (!ConcurrentBuffers.compare_exchange_weak(Buffer->Next, Buffer, std::memory_order_release,
+                                                        std::memory_order_relaxed)) {
+        }
+        LastConcurrentBuffer = {ConcurrentSession, Buffer};
+        return *Buffer;
+    }
+
+    void DiagnosticEngine::recordConcurrentDiagnostic(DiagID ID, SourceLocation Loc, SourceLocation LastLoc,
+                                                      unsigned Count,
+                                                      llvm::function_ref<Diagnostic()> MakeDiagnostic) {
+        ConcurrentBuffer &Buffer = getConcurrentBuffer();
+        unsigned BufferID = Loc.isValid() ? SM.findBufferContainingLoc(Loc) : ~0U;
+        unsigned Offset = 0;
+        unsigned LastOffset = 0;
+        if (BufferID == ~0U) {
+            BufferID = 0;
+        } else {
+            Offset = SM.getLocOffsetInBuffer(Loc, BufferID);
+            LastOffset = LastLoc == Loc ? Offset : SM.getLocOffsetInBuffer(LastLoc, BufferID);
+        }
+
+        // Collapse runs as they are recorded, as reportDiagnostic() would,
+        // so that a flood does not pile up until the merge.
+        if (Limits.CollapseAdjacent && BufferID != 0 && !Buffer.Records.empty()) {
+            ConcurrentBuffer::Record &Last = Buffer.Records.back();
+            if (Last.Diag.ID == ID && DiagnosticInfos[unsigned(ID)].NumArguments == 0 &&
+                Last.BufferID == BufferID && Offset > Last.LastOffset &&
+                Offset - Last.LastOffset <= MaxCollapseDistance) {
+                Last.Diag.LastLocation = LastLoc;
+                Last.Diag.Count += Count;
+                Last.LastOffset = LastOffset;
+                return;
+            }
+        }
+
+        // The merge reports at most MaxPerKind of a kind in all, so more
+        // than that many in one buffer can never be reported. Diagnostics
+        // without a buffer may be spread over any of the threads, so they
+        // are left to the merge.
+        const bool IsNote = getDiagnosticSeverity(ID) == DiagnosticSeverity::Note;
+        bool Suppress = IsNote && Buffer.SuppressingNotes;
+        if (!Suppress && Limits.MaxPerKind != 0 && BufferID != 0 && !isFreeForm(ID)) {
+            unsigned &KindCount = Buffer.KindCounts[{BufferID, unsigned(ID)}];
+            Suppress = KindCount >= Limits.MaxPerKind;
+            if (!Suppress)
+                ++KindCount;
+        }
+        if (!IsNote)
+            Buffer.SuppressingNotes = Suppress;
+        if (Suppress) {
+            ++Buffer.Suppressed;
+            return;
+        }
+
+        Diagnostic Diag = MakeDiagnostic();
+        if (BufferID != Buffer.CurrentBufferID) {
+            Buffer.CurrentBufferID = BufferID;
+            Buffer.CurrentBufferErrors = 0;
+        }
+        if (Diag.Severity == DiagnosticSeverity::Error)
+            ++Buffer.CurrentBufferErrors;
+        // Only this thread writes the counter, so there is nothing to race.
+        std::atomic<unsigned> &SeverityCount = Buffer.Counts[unsigned(Diag.Severity)];
+        SeverityCount.store(SeverityCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        Buffer.Records.push_back({std::move(Diag), BufferID, Offset, LastOffset});
+    }
+
+    bool DiagnosticEngine::hasConcurrentBufferReachedErrorLimit(unsigned BufferID) const {
+        return Limits.MaxErrors != 0 && LastConcurrentBuffer.Session == ConcurrentSession &&
+               LastConcurrentBuffer.Buffer->CurrentBufferID == BufferID &&
+               LastConcurrentBuffer.Buffer->CurrentBufferErrors >= Limits.MaxErrors;
+    }
+
+    unsigned DiagnosticEngine::getConcurrentCount(DiagnosticSeverity Severity) const {
+        unsigned Count = 0;
+        for (const ConcurrentBuffer *Buffer = ConcurrentBuffers.load(std::memory_order_acquire); Buffer;
+             Buffer = Buffer->Next)
+            Count += Buffer->Counts[unsigned(Severity)].load(std::memory_order_relaxed);
+        return Count;
+    }
+
+    void DiagnosticEngine::mergeConcurrentDiagnostics() {
+        assert(Concurrent && "not in concurrent mode");
+        Concurrent = false;
+
+        std::vector<std::unique_ptr<ConcurrentBuffer>> Buffers;
+        for (ConcurrentBuffer *Buffer = ConcurrentBuffers.exchange(nullptr, std::memory_order_acquire); Buffer;
+             Buffer = Buffer->Next) {
+            Buffers.emplace_back(Buffer);
+            NumSuppressed += Buffer->Suppressed;
+        }
+
+        // A note sorts with the diagnostic before it, so split each thread's
+        // diagnostics into groups that each start with one that is not a
+        // note.
+        using Record = ConcurrentBuffer::Record;
+        std::vector<llvm::ArrayRef<Record>> Groups;
+        for (const std::unique_ptr<ConcurrentBuffer> &Buffer : Buffers) {
+            const std::vector<Record> &Records = Buffer->Records;
+            for (size_t Begin = 0, End; Begin != Records.size(); Begin = End) {
+                End = Begin + 1;
+                while (End != Records.size() && Records[End].Diag.Severity == DiagnosticSeverity::Note)
+                    ++End;
+                Groups.push_back(llvm::ArrayRef<Record>(Records.data() + Begin, End - Begin));
+            }
+        }
+        std::stable_sort(Groups.begin(), Groups.end(),
+                         [](llvm::ArrayRef<Record> LHS, llvm::ArrayRef<Record> RHS) {
+                             const Record &L = LHS.front();
+                             const Record &R = RHS.front();
+                             return std::tie(L.BufferID, L.Offset, L.Diag.ID, L.Diag.Message) <
+                                    std::tie(R.BufferID, R.Offset, R.Diag.ID, R.Diag.Message);
+                         });
+
+        Batching = true;
+        for (llvm::ArrayRef<Record> Group : Groups) {
+            for (const Record &Rec : Group)
+                diagnose(Rec.Diag);
+            if (Batch.size() >= MaxBatchSize)
+                emitBatch();
+        }
+        Batching = false;
+        emitBatch();
+    }
+
+    std::string formatDiagnosticMessage(llvm::StringRef Format,
+                                        llvm::ArrayRef<DiagnosticArgument> Args) {
+        std::string Message;
+        Message.reserve(Format.size());
+        while (!Format.empty()) {
+            const size_t Percent = Format.find('%');
+            Message += Format.substr(0, Percent);
+            if (Percent == llvm::StringRef::npos)
+                break;
+            Format = Format.drop_front(Percent + 1);
+
+            if (Format.consume_front("%")) {
+                Message += '%';
+                continue;
+            }
+            const size_t Digits = std::min(Format.find_if_not([](char C) { return C >= '0' && C <= '9'; }),
+                                           Format.size());
+            unsigned Index;
+            if (Digits == 0 || Format.substr(0, Digits).getAsInteger(10, Index) || Index >= Args.size()) {
+                assert(false && "diagnostic format refers to a missing argument");
+                Message += '%';
+                continue;
+            }
+            Format = Format.drop_front(Digits);
+
+            const DiagnosticArgument &Arg = Args[Index];
+            switch (Arg.getKind()) {
+                case DiagnosticArgument::ArgumentKind::String:
+                    Message += Arg.getAsString();
+                    break;
+                case DiagnosticArgument::ArgumentKind::Unsigned:
+                    Message += std::to_string(Arg.getAsUnsigned());
+                    break;
+            }
+        }
+        return Message;
+    }
+
     void DiagnosticEngine::error(SourceLocation Loc, const std::string &Message) {
-        Diagnostic Diag(DiagnosticSeverity::Error, Loc, Message);
-        emitDiagnostic(Diag);
-        ++NumErrors;
+        diagnoseMessage(DiagID::error_message, Loc, Message);
     }
 
     void DiagnosticEngine::warning(SourceLocation Loc, const std::string &Message) {
-        Diagnostic Diag(DiagnosticSeverity::Warning, Loc, Message);
-        emitDiagnostic(Diag);
-        ++NumWarnings;
+        diagnoseMessage(DiagID::warning_message, Loc, Message);
     }
 
     void DiagnosticEngine::note(SourceLocation Loc, const std::string &Message) {
-        Diagnostic Diag(DiagnosticSeverity::Note, Loc, Message);
-        emitDiagnostic(Diag);
-        ++NumNotes;
+        diagnoseMessage(DiagID::note_message, Loc, Message);
     }
 
     void DiagnosticEngine::remark(SourceLocation Loc, const std::string &Message) {
-        Diagnostic Diag(DiagnosticSeverity::Remark, Loc, Message);
-        emitDiagnostic(Diag);
-        ++NumRemarks;
+        diagnoseMessage(DiagID::remark_message, Loc, Message);
+    }
+
+    void DiagnosticEngine::diagnoseMessage(DiagID ID, SourceLocation Loc, const std::string &Message) {
+        if (Concurrent)
+            recordConcurrentDiagnostic(ID, Loc, Loc, 1, [&] { return Diagnostic(ID, Loc, Message); });
+        else if (admitDiagnostic(ID))
+            reportDiagnostic(Diagnostic(ID, Loc, Message));
+    }
+
+    void DiagnosticEngine::diagnose(SourceLocation Loc, DiagID ID, llvm::ArrayRef<DiagnosticArgument> Args) {
+        // Without consumers nobody reads the message, so don't build it.
+        auto MakeDiagnostic = [&] {
+            return Diagnostic(ID, Loc,
+                              Consumers.empty() ? std::string()
+                                                : formatDiagnosticMessage(getDiagnosticFormat(ID), Args));
+        };
+        if (Concurrent)
+            recordConcurrentDiagnostic(ID, Loc, Loc, 1, MakeDiagnostic);
+        else if (!collapseIntoPending(ID, Loc, Loc, 1) && admitDiagnostic(ID))
+            reportDiagnostic(MakeDiagnostic());
+    }
+
+    void DiagnosticEngine::diagnose(const Diagnostic &Diag) {
+        if (Concurrent) {
+            recordConcurrentDiagnostic(Diag.ID, Diag.Location, Diag.LastLocation, Diag.Count, [&] { return Diag; });
+            return;
+        }
+        if (collapseIntoPending(Diag.ID, Diag.Location, Diag.LastLocation, Diag.Count) || !admitDiagnostic(Diag.ID))
+            return;
+        reportDiagnostic(Diag);
+    }
+
+    bool DiagnosticEngine::collapseIntoPending(DiagID ID, SourceLocation Loc, SourceLocation LastLoc,
+                                               unsigned Count) {
+        // Only argument-free diagnostics are held back, so the same kind
+        // means the same message.
+        if (!Pending || Pending->ID != ID || !Loc.isValid())
+            return false;
+        const auto Last = reinterpret_cast<uintptr_t>(Pending->LastLocation.getOpaquePointerValue());
+        const auto Next = reinterpret_cast<uintptr_t>(Loc.getOpaquePointerValue());
+        if (Next <= Last || Next - Last > MaxCollapseDistance || SM.findBufferContainingLoc(Loc) != PendingBufferID)
+            return false;
+        Pending->LastLocation = LastLoc;
+        Pending->Count += Count;
+        return true;
+    }
+
+    bool DiagnosticEngine::admitDiagnostic(DiagID ID) {
+        const bool IsNote = getDiagnosticSeverity(ID) == DiagnosticSeverity::Note;
+        bool Suppress = ErrorLimitReached || (IsNote && SuppressingNotes);
+        if (!Suppress && Limits.MaxPerKind != 0 && !isFreeForm(ID))
+            Suppress = KindCounts[unsigned(ID)] >= Limits.MaxPerKind;
+        if (!IsNote)
+            SuppressingNotes = Suppress;
+        if (Suppress)
+            ++NumSuppressed;
+        return !Suppress;
+    }
+
+    void DiagnosticEngine::reportDiagnostic(Diagnostic Diag) {
+        const DiagID ID = Diag.ID;
+        const DiagnosticSeverity Severity = Diag.Severity;
+        const SourceLocation Loc = Diag.Location;
+        countDiagnostic(Severity);
+        ++KindCounts[unsigned(ID)];
+
+        if (!Limits.CollapseAdjacent) {
+            emitDiagnostic(Diag);
+        } else {
+            flush();
+            if (DiagnosticInfos[unsigned(ID)].NumArguments == 0 && Loc.isValid()) {
+                PendingBufferID = SM.findBufferContainingLoc(Loc);
+                Pending.emplace(std::move(Diag));
+            } else {
+                emitDiagnostic(Diag);
+            }
+        }
+
+        // Say so when a limit starts suppressing diagnostics.
+        auto ReportLimit = [&](DiagID LimitID) {
+            reportDiagnostic(Diagnostic(LimitID, Loc,
+                                        Consumers.empty() ? std::string() : getDiagnosticFormat(LimitID).str()));
+        };
+        if (Severity == DiagnosticSeverity::Error && Limits.MaxErrors != 0 && !ErrorLimitReached &&
+            NumErrors >= Limits.MaxErrors) {
+            ErrorLimitReached = true;
+            ReportLimit(DiagID::error_limit_reached);
+        } else if (Limits.MaxPerKind != 0 && !isFreeForm(ID) && ID != DiagID::error_limit_reached &&
+                   ID != DiagID::diagnostic_kind_limit_reached && KindCounts[unsigned(ID)] == Limits.MaxPerKind) {
+            ReportLimit(DiagID::diagnostic_kind_limit_reached);
+        }
+    }
+
+    void DiagnosticEngine::countDiagnostic(DiagnosticSeverity Severity) {
+        switch (Severity) {
+            case DiagnosticSeverity::Error:
+                ++NumErrors;
+                break;
+            case DiagnosticSeverity::Warning:
+                ++NumWarnings;
+                break;
+            case DiagnosticSeverity::Note:
+                ++NumNotes;
+                break;
+            case DiagnosticSeverity::Remark:
+                ++NumRemarks;
+                break;
+        }
     }
 
     bool DiagnosticEngine::hasErrors() const {
-        return NumErrors > 0;
+        return getErrorCount() > 0;
     }
 
     unsigned DiagnosticEngine::getTotalDiagnosticCount() const {
-        return NumErrors + NumWarnings + NumNotes + NumRemarks;
+        unsigned Total = NumErrors + NumWarnings + NumNotes + NumRemarks;
+        if (Concurrent)
+            for (DiagnosticSeverity Severity : {DiagnosticSeverity::Error, DiagnosticSeverity::Warning,
+                                                DiagnosticSeverity::Note, DiagnosticSeverity::Remark})
+                Total += getConcurrentCount(Severity);
+        return Total;
     }
 
     unsigned DiagnosticEngine::getErrorCount() const {
-        return NumErrors;
+        return NumErrors + (Concurrent ? getConcurrentCount(DiagnosticSeverity::Error) : 0);
     }
 
     unsigned DiagnosticEngine::getWarningCount() const {
-        return NumWarnings;
+        return NumWarnings + (Concurrent ? getConcurrentCount(DiagnosticSeverity::Warning) : 0);
     }
 
-    void DiagnosticEngine::emitDiagnostic(const Diagnostic &Diag) const {
+    void DiagnosticEngine::emitDiagnostic(const Diagnostic &Diag) {
+        if (Batching) {
+            if (!Consumers.empty())
+                Batch.push_back(Diag);
+            return;
+        }
         for (const auto &Consumer: Consumers) {
             Consumer->handleDiagnostic(Diag, SM);
         }
     }
+
+    void DiagnosticEngine::emitBatch() {
+        if (Batch.empty())
+            return;
+        for (const auto &Consumer: Consumers)
+            Consumer->handleDiagnostics(Batch, SM);
+        Batch.clear();
+    }
+
+    void DiagnosticQueue::emit() {
+        for (const QueuedDiagnostic &Diag: Diagnostics) {
+            Engine.diagnose(Diag.Location, Diag.ID,
+                            llvm::ArrayRef<DiagnosticArgument>(Diag.Arguments, Diag.NumArguments));
+        }
+        Diagnostics.clear();
+    }
 } // namespace swift
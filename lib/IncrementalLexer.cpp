@@ -0,0 +1,156 @@
+#include "swift/Lexer/IncrementalLexer.h"
+
+#include <algorithm>
+
+using namespace swift;
+
+IncrementalLexer::IncrementalLexer(const LangOptions &LangOpts,
+                                   SourceManager &SM, unsigned BufferID,
+                                   CommentRetentionMode RetainComments)
+  : LangOpts(LangOpts), SM(SM), RetainComments(RetainComments),
+    BufferName(SM.getMemoryBuffer(BufferID)->getBufferIdentifier().str()),
+    OriginalBufferID(BufferID), BufferID(BufferID),
+    Text(SM.getBufferContent(BufferID)) {
+  Lexer L(LangOpts, SM, BufferID, /*Diags=*/nullptr, LexerMode::Swift,
+          HashbangMode::Allowed, RetainComments);
+  Token Tok;
+  for (L.lex(Tok); Tok.isNot(tok::eof); L.lex(Tok))
+    Tokens.push_back(Tok);
+}
+
+IncrementalLexer::~IncrementalLexer() {
+  if (BufferID != OriginalBufferID)
+    SM.removeSourceBuffer(BufferID);
+}
+
+static unsigned getOffset(const Token &Tok, const char *BufferStart) {
+  return Tok.getRawText().begin() - BufferStart;
+}
+
+/// Points \p Tok at the same-length text at \p Start.
+static void moveToken(Token &Tok, const char *Start) {
+  Tok.setText(llvm::StringRef(Start, Tok.getRawText().size()));
+}
+
+/// Whether a token lexed after an edit is the old token at the same place in
+/// the unchanged text. Besides its position, the lexer only carries the kind
+/// of the previous token (a number after a '.' stops at the next '.'), so the
+/// kind and length must be compared, not just the offset: only then is every
+/// token after a matching one known to match too.
+static bool isSameToken(const Token &Old, const Token &New) {
+  return Old.getKind() == New.getKind() &&
+         Old.getRawText().size() == New.getRawText().size() &&
+         Old.isAtStartOfLine() == New.isAtStartOfLine() &&
+         Old.isEscapedIdentifier() == New.isEscapedIdentifier() &&
+         Old.isMultilineString() == New.isMultilineString() &&
+         Old.getCustomDelimiterLen() == New.getCustomDelimiterLen() &&
+         Old.getCommentLength() == New.getCommentLength();
+}
+
+IncrementalLexer::EditResult
+IncrementalLexer::applyEdit(unsigned Offset, unsigned RemovedLength,
+                            llvm::StringRef InsertedText) {
+  assert(Offset + RemovedLength <= Text.size() && "edit out of range");
+
+  std::string NewText;
+  NewText.reserve(Text.size() - RemovedLength + InsertedText.size());
+  NewText += Text.substr(0, Offset);
+  NewText += InsertedText;
+  NewText += Text.substr(Offset + RemovedLength);
+  // The SourceManager hands back the existing buffer for a name it knows,
+  // which another lexer on the same buffer may have taken.
+  std::string NewName;
+  do
+    NewName = BufferName + ";" + std::to_string(++Revision);
+  while (SM.getIDForBufferIdentifier(NewName).has_value());
+  unsigned NewBufferID = SM.addMemBufferCopy(NewText, NewName);
+
+  const char *OldStart = Text.data();
+  const char *NewStart = SM.getBufferContent(NewBufferID).data();
+  const unsigned OldEditEnd = Offset + RemovedLength;
+  const unsigned NewEditEnd = Offset + InsertedText.size();
+
+  // Find the first token the edit can change: a token that ends right at the
+  // edit may run on into the inserted text.
+  size_t First = std::partition_point(Tokens.begin(), Tokens.end(),
+                                      [&](const Token &Tok) {
+                                        return getOffset(Tok, OldStart) +
+                                                   Tok.getRawText().size() <
+                                               Offset;
+                                      }) -
+                 Tokens.begin();
+
+  // Lexing a token can look ahead as far as the end of its line, e.g. for
+  // the backtick that closes an escaped identifier, so restart at the last
+  // token that starts on an earlier line.
+  unsigned ChangeStart = Offset;
+  if (First != Tokens.size())
+    ChangeStart = std::min(ChangeStart, getOffset(Tokens[First], OldStart));
+  size_t Newline = Text.rfind('\n', ChangeStart);
+  unsigned LineStart = Newline == llvm::StringRef::npos ? 0 : Newline + 1;
+  First = std::partition_point(Tokens.begin(), Tokens.begin() + First,
+                               [&](const Token &Tok) {
+                                 return getOffset(Tok, OldStart) < LineStart;
+                               }) -
+          Tokens.begin();
+  if (First != 0)
+    --First;
+  for (size_t I = 0; I != First; ++I)
+    moveToken(Tokens[I], NewStart + getOffset(Tokens[I], OldStart));
+
+  Lexer L(LangOpts, SM, NewBufferID, /*Diags=*/nullptr, LexerMode::Swift,
+          HashbangMode::Allowed, RetainComments);
+  if (First != 0) {
+    Token Restart = Tokens[First];
+    moveToken(Restart, NewStart + getOffset(Restart, OldStart));
+    L.restoreState(L.getStateForBeginningOfToken(Restart));
+  }
+
+  // Lex until a token past the edit lines up with an old one; the old tokens
+  // from there on are still valid.
+  std::vector<Token> Relexed;
+  size_t OldIndex = First;
+  size_t Resync = Tokens.size();
+  Token Tok;
+  L.lex(Tok);
+  // The restart state backs up to the newline before the token, which may be
+  // the last character of a '//' comment token; the lexer does not mark a
+  // token after one of those as starting a line. Whether it does depends only
+  // on the text before it, which the edit left alone, so keep the old flag.
+  if (First != 0 && Tok.isNot(tok::eof) &&
+      getOffset(Tok, NewStart) == getOffset(Tokens[First], OldStart))
+    Tok.setAtStartOfLine(Tokens[First].isAtStartOfLine());
+  for (; Tok.isNot(tok::eof); L.lex(Tok)) {
+    unsigned NewOffset = getOffset(Tok, NewStart);
+    if (NewOffset >= NewEditEnd) {
+      unsigned OldOffset = NewOffset - NewEditEnd + OldEditEnd;
+      while (OldIndex != Tokens.size() &&
+             getOffset(Tokens[OldIndex], OldStart) < OldOffset)
+        ++OldIndex;
+      if (OldIndex != Tokens.size() &&
+          getOffset(Tokens[OldIndex], OldStart) == OldOffset &&
+          isSameToken(Tokens[OldIndex], Tok)) {
+        Resync = OldIndex;
+        break;
+      }
+    }
+    Relexed.push_back(Tok);
+  }
+
+  for (size_t I = Resync; I != Tokens.size(); ++I)
+    moveToken(Tokens[I], NewStart + (getOffset(Tokens[I], OldStart) -
+                                     OldEditEnd + NewEditEnd));
+
+  EditResult Result;
+  Result.FirstToken = First;
+  Result.RemovedTokens = Resync - First;
+  Result.InsertedTokens = Relexed.size();
+  Tokens.erase(Tokens.begin() + First, Tokens.begin() + Resync);
+  Tokens.insert(Tokens.begin() + First, Relexed.begin(), Relexed.end());
+
+  if (BufferID != OriginalBufferID)
+    SM.removeSourceBuffer(BufferID);
+  BufferID = NewBufferID;
+  Text = SM.getBufferContent(NewBufferID);
+  return Result;
+}
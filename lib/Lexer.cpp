@@ -3,6 +3,12 @@
 //
 
 #include "swift/Lexer/Lexer.h"
+#include "swift/Source/ByteScan.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string_view>
 
 using namespace swift;
 
@@ -122,6 +128,29 @@ uint32_t swift::validateUTF8CharacterAndAdvance(const char *&Ptr,
   return EncodedBytes == 4 ? CharValue : ~0U;
 }
 
+/// decodeValidUTF8CharacterAndAdvance - Like validateUTF8CharacterAndAdvance,
+/// but for text the SourceManager has already validated: the encoding is
+/// decoded without being checked.  Falls back to validation if the sequence
+/// would run past End.
+static uint32_t decodeValidUTF8CharacterAndAdvance(const char *&Ptr,
+                                                   const char *End) {
+  unsigned char CurByte = *Ptr;
+  if (CurByte < 0x80) {
+    ++Ptr;
+    return CurByte;
+  }
+
+  unsigned EncodedBytes = llvm::countl_one(CurByte);
+  if (EncodedBytes < 2 || EncodedBytes > 4 || End - Ptr < EncodedBytes)
+    return validateUTF8CharacterAndAdvance(Ptr, End);
+
+  uint32_t CharValue = (unsigned char)(CurByte << EncodedBytes) >> EncodedBytes;
+  for (unsigned i = 1; i != EncodedBytes; ++i)
+    CharValue = (CharValue << 6) | (Ptr[i] & 0x3F);
+  Ptr += EncodedBytes;
+  return CharValue;
+}
+
 //===----------------------------------------------------------------------===//
 // Setup and Helper Methods
 //===----------------------------------------------------------------------===//
@@ -146,24 +175,14 @@ void Lexer::initialize(unsigned Offset, unsigned EndOffset) {
   const llvm::StringRef contents =
       SourceMgr.extractText(SourceMgr.getRangeForBuffer(BufferID));
   BufferStart = contents.data();
-
-  // Ensure we have a null-terminated buffer by copying if needed
-  if (!contents.empty() && contents.data()[contents.size()] != 0) {
-    // We need to make a copy with a null terminator
-    static std::string NullTerminatedCopy;
-    NullTerminatedCopy = contents.str();
-    BufferStart = NullTerminatedCopy.c_str();
-    BufferEnd = BufferStart + NullTerminatedCopy.size();
-    // The c_str() ensures there's a null terminator
-  } else {
-    BufferEnd = BufferStart + contents.size();
-  }
+  BufferEnd = contents.data() + contents.size();
 
   // Safety check for EndOffset - ensure it doesn't exceed buffer size
   if (EndOffset > contents.size()) {
     EndOffset = contents.size();
   }
 
+  // SourceManager makes every buffer NUL-terminated when it is registered.
   assert(*BufferEnd == 0 && "Buffer must be null-terminated");
   assert(BufferStart + Offset <= BufferEnd);
   assert(BufferStart + EndOffset <= BufferEnd);
@@ -175,6 +194,8 @@ void Lexer::initialize(unsigned Offset, unsigned EndOffset) {
   // editing with libSyntax.
   ContentStart = BufferStart + BOMLength;
 
+  InvalidUTF8Ranges = SourceMgr.getBufferTextInfo(BufferID).InvalidRanges;
+
   // TODO: FIX ME (Is this in swift?)
   // Initialize code completion.
   // if (BufferID == SourceMgr.getIDEInspectionTargetBufferID()) {
@@ -247,6 +268,29 @@ Token Lexer::getTokenAt(SourceLocation Loc) {
   return L.peekNextToken();
 }
 
+Lexer::SubrangeState Lexer::beginSubrange(unsigned Offset, unsigned EndOffset) {
+  assert(Offset <= EndOffset && BufferStart + EndOffset <= BufferEnd &&
+         "subrange out of range");
+  SubrangeState Saved{CurPtr, ArtificialEOF, NextToken, std::nullopt};
+  if (DiagQueue) {
+    Saved.DiagQueue.emplace(std::move(*DiagQueue));
+    DiagQueue.reset();
+  }
+
+  ArtificialEOF = BufferStart + EndOffset;
+  CurPtr = BufferStart + Offset;
+  lexImpl();
+  return Saved;
+}
+
+void Lexer::endSubrange(SubrangeState &&Saved) {
+  CurPtr = Saved.CurPtr;
+  ArtificialEOF = Saved.ArtificialEOF;
+  NextToken = Saved.NextToken;
+  if (Saved.DiagQueue)
+    DiagQueue.emplace(std::move(*Saved.DiagQueue));
+}
+
 void Lexer::formToken(tok Kind, const char *TokStart) {
   assert(CurPtr >= BufferStart &&
     CurPtr <= BufferEnd && "Current pointer out of range!");
@@ -254,6 +298,7 @@ void Lexer::formToken(tok Kind, const char *TokStart) {
   // When we are lexing a subrange from the middle of a file buffer, we will
   // run past the end of the range, but will stay within the file.  Check if
   // we are past the imaginary EOF, and synthesize a tok::eof in this case.
+  NextTokenKind = Kind;
   if (Kind != tok::eof && TokStart >= ArtificialEOF) {
     Kind = tok::eof;
   }
@@ -335,20 +380,27 @@ static void diagnoseEmbeddedNul(DiagnosticEngine *Diags, const char *Ptr) {
     return;
 
   SourceLocation NulLoc = Lexer::getSourceLocation(Ptr);
-  SourceLocation NulEndLoc = Lexer::getSourceLocation(Ptr + 1);
-  // Diags->diagnose(NulLoc, diag::lex_nul_character);
-  // .fixItRemoveChars(NulLoc, NulEndLoc);
 
-  Diags->error(NulLoc, "nul character embedded in source file");
+  Diags->diagnose(NulLoc, diag::lex_nul_character);
   // TODO: Fixit remove the nul character.
 }
 
 /// Advance \p CurPtr to the end of line or the end of file. Returns \c true
 /// if it stopped at the end of line, \c false if it stopped at the end of file.
+/// The text before \p ValidUTF8End has already been validated, so non-ASCII
+/// characters there are skipped without being checked.
 static bool advanceToEndOfLine(const char *&CurPtr, const char *BufferEnd,
                                const char *CodeCompletionPtr = nullptr,
-                               DiagnosticEngine *Diags = nullptr) {
+                               DiagnosticEngine *Diags = nullptr,
+                               const char *ValidUTF8End = nullptr) {
+  // Without diagnostics there is nothing to validate for.
+  if (!Diags)
+    ValidUTF8End = BufferEnd;
   while (1) {
+    // Jump over plain comment text to the next byte the switch cares about.
+    const bool ValidateUTF8 = CurPtr >= ValidUTF8End;
+    CurPtr = bytescan::skipLineCommentBody(
+        CurPtr, ValidateUTF8 ? BufferEnd : ValidUTF8End, ValidateUTF8);
     switch (*CurPtr++) {
       case '\n':
       case '\r':
@@ -356,13 +408,12 @@ static bool advanceToEndOfLine(const char *&CurPtr, const char *BufferEnd,
         return true; // If we found the end of the line, return.
       default:
         // If this is a "high" UTF-8 character, validate it.
-        if (Diags && (signed char) (CurPtr[-1]) < 0) {
+        if (Diags && CurPtr - 1 >= ValidUTF8End &&
+            (signed char) (CurPtr[-1]) < 0) {
           --CurPtr;
           const char *CharStart = CurPtr;
           if (validateUTF8CharacterAndAdvance(CurPtr, BufferEnd) == ~0U)
-            // Diags->diagnose(Lexer::getSourceLoc(CharStart),
-            //                 diag::lex_invalid_utf8);
-            Diags->error(Lexer::getSourceLocation(CharStart), "invalid UTF-8");
+            Diags->diagnose(Lexer::getSourceLocation(CharStart), diag::lex_invalid_utf8);
         }
         break; // Otherwise, eat other characters.
       case 0:
@@ -381,9 +432,22 @@ static bool advanceToEndOfLine(const char *&CurPtr, const char *BufferEnd,
   }
 }
 
+const char *Lexer::getValidUTF8End(const char *Ptr) const {
+  // Find the first invalid run that ends after Ptr.
+  const unsigned Offset = Ptr - BufferStart;
+  const auto Next = std::upper_bound(
+      InvalidUTF8Ranges.begin(), InvalidUTF8Ranges.end(), Offset,
+      [](unsigned Offset, const std::pair<unsigned, unsigned> &Range) {
+        return Offset < Range.second;
+      });
+  if (Next == InvalidUTF8Ranges.end())
+    return BufferEnd;
+  return BufferStart + std::max(Next->first, Offset);
+}
+
 void Lexer::skipToEndOfLine(bool EatNewline) {
-  bool isEOL =
-      advanceToEndOfLine(CurPtr, BufferEnd, CodeCompletionPtr, getTokenDiags());
+  bool isEOL = advanceToEndOfLine(CurPtr, BufferEnd, CodeCompletionPtr,
+                                  getTokenDiags(), getValidUTF8End(CurPtr));
   if (EatNewline && isEOL) {
     ++CurPtr;
     NextToken.setAtStartOfLine(true);
@@ -404,7 +468,11 @@ void Lexer::skipHashbang(bool EatNewline) {
 static bool skipToEndOfSlashStarComment(const char *&CurPtr,
                                         const char *BufferEnd,
                                         const char *CodeCompletionPtr = nullptr,
-                                        DiagnosticEngine *Diags = nullptr) {
+                                        DiagnosticEngine *Diags = nullptr,
+                                        const char *ValidUTF8End = nullptr) {
+  // Without diagnostics there is nothing to validate for.
+  if (!Diags)
+    ValidUTF8End = BufferEnd;
   const char *StartPtr = CurPtr - 1;
   assert(CurPtr[-1] == '/' && CurPtr[0] == '*' && "Not a /* comment");
   // Make sure to advance over the * so that we don't incorrectly handle /*/ as
@@ -416,6 +484,10 @@ static bool skipToEndOfSlashStarComment(const char *&CurPtr,
   bool isMultiline = false;
 
   while (1) {
+    // Jump over plain comment text to the next byte the switch cares about.
+    const bool ValidateUTF8 = CurPtr >= ValidUTF8End;
+    CurPtr = bytescan::skipBlockCommentBody(
+        CurPtr, ValidateUTF8 ? BufferEnd : ValidUTF8End, ValidateUTF8);
     switch (*CurPtr++) {
       case '*':
         // Check for a '*/'
@@ -440,13 +512,12 @@ static bool skipToEndOfSlashStarComment(const char *&CurPtr,
 
       default:
         // If this is a "high" UTF-8 character, validate it.
-        if (Diags && (signed char) (CurPtr[-1]) < 0) {
+        if (Diags && CurPtr - 1 >= ValidUTF8End &&
+            (signed char) (CurPtr[-1]) < 0) {
           --CurPtr;
           const char *CharStart = CurPtr;
           if (validateUTF8CharacterAndAdvance(CurPtr, BufferEnd) == ~0U)
-            // Diags->diagnose(Lexer::getSourceLoc(CharStart),
-            //                 diag::lex_invalid_utf8);
-            Diags->error(Lexer::getSourceLocation(CharStart), "invalid UTF-8");
+            Diags->diagnose(Lexer::getSourceLocation(CharStart), diag::lex_invalid_utf8);
         }
 
         break; // Otherwise, eat other characters.
@@ -468,13 +539,10 @@ static bool skipToEndOfSlashStarComment(const char *&CurPtr,
           while (--Depth != 0)
             Terminator += "*/";
           const char *EOL = (CurPtr[-1] == '\n') ? (CurPtr - 1) : CurPtr;
-          // Diags
-          //     ->diagnose(Lexer::getSourceLoc(EOL),
-          //                diag::lex_unterminated_block_comment);
-          Diags->error(Lexer::getSourceLocation(EOL), "unterminated /* comment");
-          // .fixItInsert(Lexer::getSourceLoc(EOL), Terminator);
-          // Diags->diagnose(Lexer::getSourceLoc(StartPtr), diag::lex_comment_start);
-          Diags->note(Lexer::getSourceLocation(StartPtr), "comment began here");
+          // TODO: fix-it insert Terminator at EOL.
+          Diags->diagnose(Lexer::getSourceLocation(EOL),
+                          diag::lex_unterminated_block_comment);
+          Diags->diagnose(Lexer::getSourceLocation(StartPtr), diag::lex_comment_start);
         }
         return isMultiline;
     }
@@ -485,80 +553,271 @@ static bool skipToEndOfSlashStarComment(const char *&CurPtr,
 /// Note that (unlike in C) block comments can be nested.
 void Lexer::skipSlashStarComment() {
   bool isMultiline = skipToEndOfSlashStarComment(
-    CurPtr, BufferEnd, CodeCompletionPtr, getTokenDiags());
+    CurPtr, BufferEnd, CodeCompletionPtr, getTokenDiags(),
+    getValidUTF8End(CurPtr));
   if (isMultiline)
     NextToken.setAtStartOfLine(true);
 }
 
-static bool isValidIdentifierContinuationCodePoint(uint32_t c) {
-  if (c < 0x80)
-    return isAsciiIdentifierContinue(c, /*dollar*/true);
-
-  // N1518: Recommendations for extended identifier characters for C and C++
-  // Proposed Annex X.1: Ranges of characters allowed
-  return c == 0x00A8 || c == 0x00AA || c == 0x00AD || c == 0x00AF
-         || (c >= 0x00B2 && c <= 0x00B5) || (c >= 0x00B7 && c <= 0x00BA)
-         || (c >= 0x00BC && c <= 0x00BE) || (c >= 0x00C0 && c <= 0x00D6)
-         || (c >= 0x00D8 && c <= 0x00F6) || (c >= 0x00F8 && c <= 0x00FF)
-
-         || (c >= 0x0100 && c <= 0x167F)
-         || (c >= 0x1681 && c <= 0x180D)
-         || (c >= 0x180F && c <= 0x1FFF)
-
-         || (c >= 0x200B && c <= 0x200D)
-         || (c >= 0x202A && c <= 0x202E)
-         || (c >= 0x203F && c <= 0x2040)
-         || c == 0x2054
-         || (c >= 0x2060 && c <= 0x206F)
-
-         || (c >= 0x2070 && c <= 0x218F)
-         || (c >= 0x2460 && c <= 0x24FF)
-         || (c >= 0x2776 && c <= 0x2793)
-         || (c >= 0x2C00 && c <= 0x2DFF)
-         || (c >= 0x2E80 && c <= 0x2FFF)
-
-         || (c >= 0x3004 && c <= 0x3007)
-         || (c >= 0x3021 && c <= 0x302F)
-         || (c >= 0x3031 && c <= 0x303F)
-
-         || (c >= 0x3040 && c <= 0xD7FF)
-
-         || (c >= 0xF900 && c <= 0xFD3D)
-         || (c >= 0xFD40 && c <= 0xFDCF)
-         || (c >= 0xFDF0 && c <= 0xFE44)
-         || (c >= 0xFE47 && c <= 0xFFF8)
-
-         || (c >= 0x10000 && c <= 0x1FFFD)
-         || (c >= 0x20000 && c <= 0x2FFFD)
-         || (c >= 0x30000 && c <= 0x3FFFD)
-         || (c >= 0x40000 && c <= 0x4FFFD)
-         || (c >= 0x50000 && c <= 0x5FFFD)
-         || (c >= 0x60000 && c <= 0x6FFFD)
-         || (c >= 0x70000 && c <= 0x7FFFD)
-         || (c >= 0x80000 && c <= 0x8FFFD)
-         || (c >= 0x90000 && c <= 0x9FFFD)
-         || (c >= 0xA0000 && c <= 0xAFFFD)
-         || (c >= 0xB0000 && c <= 0xBFFFD)
-         || (c >= 0xC0000 && c <= 0xCFFFD)
-         || (c >= 0xD0000 && c <= 0xDFFFD)
-         || (c >= 0xE0000 && c <= 0xEFFFD);
+//===----------------------------------------------------------------------===//
+// Unicode code point classification
+//===----------------------------------------------------------------------===//
+
+namespace {
+
+/// An inclusive range of code points.
+struct CodePointRange {
+  uint32_t First;
+  uint32_t Last;
+};
+
+/// Code points that may continue an identifier.
+constexpr CodePointRange IdentifierContinueRanges[] = {
+    {'$', '$'}, {'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'},
+
+    // N1518: Recommendations for extended identifier characters for C and C++
+    // Proposed Annex X.1: Ranges of characters allowed
+    {0x00A8, 0x00A8}, {0x00AA, 0x00AA}, {0x00AD, 0x00AD}, {0x00AF, 0x00AF},
+    {0x00B2, 0x00B5}, {0x00B7, 0x00BA}, {0x00BC, 0x00BE}, {0x00C0, 0x00D6},
+    {0x00D8, 0x00F6}, {0x00F8, 0x00FF},
+
+    {0x0100, 0x167F}, {0x1681, 0x180D}, {0x180F, 0x1FFF},
+
+    {0x200B, 0x200D}, {0x202A, 0x202E}, {0x203F, 0x2040}, {0x2054, 0x2054},
+    {0x2060, 0x206F},
+
+    {0x2070, 0x218F}, {0x2460, 0x24FF}, {0x2776, 0x2793}, {0x2C00, 0x2DFF},
+    {0x2E80, 0x2FFF},
+
+    {0x3004, 0x3007}, {0x3021, 0x302F}, {0x3031, 0x303F},
+
+    {0x3040, 0xD7FF},
+
+    {0xF900, 0xFD3D}, {0xFD40, 0xFDCF}, {0xFDF0, 0xFE44}, {0xFE47, 0xFFF8},
+
+    {0x10000, 0x1FFFD}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+    {0x40000, 0x4FFFD}, {0x50000, 0x5FFFD}, {0x60000, 0x6FFFD},
+    {0x70000, 0x7FFFD}, {0x80000, 0x8FFFD}, {0x90000, 0x9FFFD},
+    {0xA0000, 0xAFFFD}, {0xB0000, 0xBFFFD}, {0xC0000, 0xCFFFD},
+    {0xD0000, 0xDFFFD}, {0xE0000, 0xEFFFD},
+};
+
+/// Identifier characters that may not start an identifier.
+constexpr CodePointRange IdentifierStartExcludedRanges[] = {
+    {'$', '$'}, {'0', '9'},
+
+    // N1518: Recommendations for extended identifier characters for C and C++
+    // Proposed Annex X.2: Ranges of characters disallowed initially
+    {0x0300, 0x036F}, {0x1DC0, 0x1DFF}, {0x20D0, 0x20FF}, {0xFE20, 0xFE2F},
+};
+
+/// Code points that may start an operator.
+constexpr CodePointRange OperatorStartRanges[] = {
+    // ASCII operator chars: / = - + * % < > ! & | ^ ~ . ?
+    {'!', '!'}, {'%', '&'}, {'*', '+'}, {'-', '/'}, {'<', '?'}, {'^', '^'},
+    {'|', '|'}, {'~', '~'},
+
+    // Unicode math, symbol, arrow, dingbat, and line/box drawing chars.
+    {0x00A1, 0x00A7}, {0x00A9, 0x00A9}, {0x00AB, 0x00AC}, {0x00AE, 0x00AE},
+    {0x00B0, 0x00B1}, {0x00B6, 0x00B6}, {0x00BB, 0x00BB}, {0x00BF, 0x00BF},
+    {0x00D7, 0x00D7}, {0x00F7, 0x00F7},
+    {0x2016, 0x2017}, {0x2020, 0x2027}, {0x2030, 0x203E}, {0x2041, 0x2053},
+    {0x2055, 0x205E}, {0x2190, 0x23FF}, {0x2500, 0x2775}, {0x2794, 0x2BFF},
+    {0x2E00, 0x2E7F}, {0x3001, 0x3003}, {0x3008, 0x3030},
+};
+
+/// Code points that may continue, but not start, an operator: Unicode
+/// combining characters and variation selectors.
+constexpr CodePointRange OperatorContinueExtraRanges[] = {
+    {0x0300, 0x036F}, {0x1DC0, 0x1DFF}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F}, {0xE0100, 0xE01EF},
+};
+
+enum CodePointProperty : unsigned {
+  IdentifierStart,
+  IdentifierContinue,
+  OperatorStart,
+  OperatorContinue,
+  NumCodePointProperties
+};
+
+/// The Basic Multilingual Plane is split into 256 blocks of 256 code points.
+/// Each block maps to a leaf holding one 256-bit bitmap per property, and
+/// identical leaves are shared, so the whole plane takes a 256-byte index
+/// plus a few dozen leaves.
+constexpr unsigned CodePointBlockBits = 8;
+constexpr uint32_t CodePointBlockSize = 1 << CodePointBlockBits;
+constexpr unsigned NumCodePointBlocks = 0x10000 / CodePointBlockSize;
+constexpr unsigned CodePointLeafWords = CodePointBlockSize / 64;
+
+struct CodePointLeaf {
+  uint64_t Bits[NumCodePointProperties][CodePointLeafWords] = {};
+
+  constexpr bool operator==(const CodePointLeaf &Other) const {
+    for (unsigned P = 0; P != NumCodePointProperties; ++P)
+      for (unsigned W = 0; W != CodePointLeafWords; ++W)
+        if (Bits[P][W] != Other.Bits[P][W])
+          return false;
+    return true;
+  }
+};
+
+template <unsigned NumLeaves> struct CodePointTable {
+  uint8_t Index[NumCodePointBlocks] = {};
+  CodePointLeaf Leaves[NumLeaves] = {};
+  unsigned Size = 0;
+};
+
+/// Returns the bits of the 64-code-point word starting at \p WordStart that
+/// fall in [First, Last].
+constexpr uint64_t rangeWordMask(uint32_t WordStart, uint32_t First,
+                                 uint32_t Last) {
+  if (Last < WordStart || First > WordStart + 63)
+    return 0;
+  unsigned Lo = First > WordStart ? First - WordStart : 0;
+  unsigned Hi = Last < WordStart + 63 ? Last - WordStart : 63;
+  uint64_t UpToHi = Hi == 63 ? ~uint64_t(0) : (uint64_t(1) << (Hi + 1)) - 1;
+  return UpToHi & ~((uint64_t(1) << Lo) - 1);
+}
+
+template <size_t N>
+constexpr void addRanges(uint64_t (&Bits)[CodePointLeafWords],
+                         uint32_t BlockStart,
+                         const CodePointRange (&Ranges)[N]) {
+  for (const CodePointRange &R : Ranges) {
+    if (R.Last < BlockStart || R.First >= BlockStart + CodePointBlockSize)
+      continue;
+    for (unsigned W = 0; W != CodePointLeafWords; ++W)
+      Bits[W] |= rangeWordMask(BlockStart + 64 * W, R.First, R.Last);
+  }
+}
+
+constexpr CodePointLeaf buildCodePointLeaf(uint32_t BlockStart) {
+  CodePointLeaf Leaf;
+  uint64_t Excluded[CodePointLeafWords] = {};
+  uint64_t OperatorExtra[CodePointLeafWords] = {};
+  addRanges(Leaf.Bits[IdentifierContinue], BlockStart,
+            IdentifierContinueRanges);
+  addRanges(Excluded, BlockStart, IdentifierStartExcludedRanges);
+  addRanges(Leaf.Bits[OperatorStart], BlockStart, OperatorStartRanges);
+  addRanges(OperatorExtra, BlockStart, OperatorContinueExtraRanges);
+  for (unsigned W = 0; W != CodePointLeafWords; ++W) {
+    Leaf.Bits[IdentifierStart][W] =
+        Leaf.Bits[IdentifierContinue][W] & ~Excluded[W];
+    Leaf.Bits[OperatorContinue][W] =
+        Leaf.Bits[OperatorStart][W] | OperatorExtra[W];
+  }
+  return Leaf;
+}
+
+/// Builds the table with room for every block to have its own leaf.
+constexpr CodePointTable<NumCodePointBlocks> buildCodePointTable() {
+  CodePointTable<NumCodePointBlocks> Table;
+  for (unsigned Block = 0; Block != NumCodePointBlocks; ++Block) {
+    CodePointLeaf Leaf = buildCodePointLeaf(Block * CodePointBlockSize);
+    // Runs of identical blocks are the common case; check the last leaf
+    // before searching the rest.
+    unsigned Found = Table.Size;
+    if (Table.Size != 0 && Table.Leaves[Table.Size - 1] == Leaf)
+      Found = Table.Size - 1;
+    for (unsigned L = 0; Found == Table.Size && L != Table.Size; ++L)
+      if (Table.Leaves[L] == Leaf)
+        Found = L;
+    if (Found == Table.Size)
+      Table.Leaves[Table.Size++] = Leaf;
+    Table.Index[Block] = uint8_t(Found);
+  }
+  return Table;
+}
+
+constexpr auto CodePointTableDraft = buildCodePointTable();
+
+/// Copies the draft into a table sized for the leaves actually used.
+template <unsigned NumLeaves>
+constexpr CodePointTable<NumLeaves>
+compactCodePointTable(const CodePointTable<NumCodePointBlocks> &Draft) {
+  CodePointTable<NumLeaves> Table;
+  for (unsigned Block = 0; Block != NumCodePointBlocks; ++Block)
+    Table.Index[Block] = Draft.Index[Block];
+  for (unsigned L = 0; L != NumLeaves; ++L)
+    Table.Leaves[L] = Draft.Leaves[L];
+  Table.Size = NumLeaves;
+  return Table;
+}
+
+constexpr auto CodePoints =
+    compactCodePointTable<CodePointTableDraft.Size>(CodePointTableDraft);
+
+/// Above the BMP the ranges are regular enough to test directly: every
+/// plane from 1 to 14 is an identifier character except its last two code
+/// points, and the only operator characters are the variation selectors
+/// supplement, which may continue an operator.
+constexpr bool isSupplementaryIdentifierCodePoint(uint32_t C) {
+  return C < 0xF0000 && (C & 0xFFFF) <= 0xFFFD;
+}
+constexpr CodePointRange SupplementaryOperatorContinueRange = {0xE0100,
+                                                               0xE01EF};
+
+/// Checks that the rules above agree with the range tables.
+constexpr bool checkSupplementaryRules() {
+  unsigned Plane = 1;
+  for (const CodePointRange &R : IdentifierContinueRanges) {
+    if (R.Last < 0x10000)
+      continue;
+    if (R.First != Plane << 16 || R.Last != ((Plane << 16) | 0xFFFD))
+      return false;
+    ++Plane;
+  }
+  for (const CodePointRange &R : IdentifierStartExcludedRanges)
+    if (R.Last >= 0x10000)
+      return false;
+  for (const CodePointRange &R : OperatorStartRanges)
+    if (R.Last >= 0x10000)
+      return false;
+  unsigned Extra = 0;
+  for (const CodePointRange &R : OperatorContinueExtraRanges) {
+    if (R.Last < 0x10000)
+      continue;
+    if (R.First != SupplementaryOperatorContinueRange.First ||
+        R.Last != SupplementaryOperatorContinueRange.Last)
+      return false;
+    ++Extra;
+  }
+  return Plane == 15 && Extra == 1;
 }
+static_assert(checkSupplementaryRules(),
+              "supplementary code point rules out of sync with the ranges");
 
-static bool isValidIdentifierStartCodePoint(uint32_t c) {
-  if (!isValidIdentifierContinuationCodePoint(c))
-    return false;
-  if (c < 0x80 && (isDigit(c) || c == '$'))
+inline bool hasCodePointProperty(uint32_t C, CodePointProperty Property) {
+  if (C < 0x10000) {
+    const CodePointLeaf &Leaf =
+        CodePoints.Leaves[CodePoints.Index[C >> CodePointBlockBits]];
+    uint32_t Offset = C & (CodePointBlockSize - 1);
+    return (Leaf.Bits[Property][Offset / 64] >> (Offset % 64)) & 1;
+  }
+  switch (Property) {
+  case IdentifierStart:
+  case IdentifierContinue:
+    return isSupplementaryIdentifierCodePoint(C);
+  case OperatorStart:
     return false;
+  case OperatorContinue:
+    return C >= SupplementaryOperatorContinueRange.First &&
+           C <= SupplementaryOperatorContinueRange.Last;
+  case NumCodePointProperties:
+    break;
+  }
+  return false;
+}
 
-  // N1518: Recommendations for extended identifier characters for C and C++
-  // Proposed Annex X.2: Ranges of characters disallowed initially
-  if ((c >= 0x0300 && c <= 0x036F) ||
-      (c >= 0x1DC0 && c <= 0x1DFF) ||
-      (c >= 0x20D0 && c <= 0x20FF) ||
-      (c >= 0xFE20 && c <= 0xFE2F))
-    return false;
+} // end anonymous namespace
 
-  return true;
+static bool isValidIdentifierContinuationCodePoint(uint32_t c) {
+  return hasCodePointProperty(c, IdentifierContinue);
+}
+
+static bool isValidIdentifierStartCodePoint(uint32_t c) {
+  return hasCodePointProperty(c, IdentifierStart);
 }
 
 static bool isForbiddenRawIdentifierWhitespace(uint32_t c) {
@@ -600,10 +859,16 @@ static bool isValidIdentifierEscapedCodePoint(uint32_t c) {
   return true;
 }
 
+/// advanceIf - Decodes the character at ptr and advances past it if it
+/// satisfies predicate. A character before validEnd is known to be valid
+/// UTF-8 and is decoded without being validated.
 static bool advanceIf(char const *&ptr, char const *end,
-                      bool (*predicate)(uint32_t)) {
+                      bool (*predicate)(uint32_t),
+                      char const *validEnd = nullptr) {
   char const *next = ptr;
-  uint32_t c = validateUTF8CharacterAndAdvance(next, end);
+  uint32_t c = validEnd && next < validEnd
+                   ? decodeValidUTF8CharacterAndAdvance(next, end)
+                   : validateUTF8CharacterAndAdvance(next, end);
   if (c == ~0U)
     return false;
   if (predicate(c)) {
@@ -614,13 +879,14 @@ static bool advanceIf(char const *&ptr, char const *end,
 }
 
 static bool advanceIfValidStartOfIdentifier(char const *&ptr,
-                                            char const *end) {
-  return advanceIf(ptr, end, isValidIdentifierStartCodePoint);
+                                            char const *end,
+                                            char const *validEnd = nullptr) {
+  return advanceIf(ptr, end, isValidIdentifierStartCodePoint, validEnd);
 }
 
-static bool advanceIfValidContinuationOfIdentifier(char const *&ptr,
-                                                   char const *end) {
-  return advanceIf(ptr, end, isValidIdentifierContinuationCodePoint);
+static bool advanceIfValidContinuationOfIdentifier(
+    char const *&ptr, char const *end, char const *validEnd = nullptr) {
+  return advanceIf(ptr, end, isValidIdentifierContinuationCodePoint, validEnd);
 }
 
 static bool advanceIfValidEscapedIdentifier(char const *&ptr, char const *end) {
@@ -630,37 +896,13 @@ static bool advanceIfValidEscapedIdentifier(char const *&ptr, char const *end) {
 /// isOperatorStartCodePoint - Return true if the specified code point is a
 /// valid start of an operator.
 static bool isOperatorStartCodePoint(uint32_t C) {
-  // ASCII operator chars.
-  static const char OpChars[] = "/=-+*%<>!&|^~.?";
-  if (C < 0x80)
-    return memchr(OpChars, C, sizeof(OpChars) - 1) != 0;
-
-  // Unicode math, symbol, arrow, dingbat, and line/box drawing chars.
-  return (C >= 0x00A1 && C <= 0x00A7)
-         || C == 0x00A9 || C == 0x00AB || C == 0x00AC || C == 0x00AE
-         || C == 0x00B0 || C == 0x00B1 || C == 0x00B6 || C == 0x00BB
-         || C == 0x00BF || C == 0x00D7 || C == 0x00F7
-         || C == 0x2016 || C == 0x2017 || (C >= 0x2020 && C <= 0x2027)
-         || (C >= 0x2030 && C <= 0x203E) || (C >= 0x2041 && C <= 0x2053)
-         || (C >= 0x2055 && C <= 0x205E) || (C >= 0x2190 && C <= 0x23FF)
-         || (C >= 0x2500 && C <= 0x2775) || (C >= 0x2794 && C <= 0x2BFF)
-         || (C >= 0x2E00 && C <= 0x2E7F) || (C >= 0x3001 && C <= 0x3003)
-         || (C >= 0x3008 && C <= 0x3030);
+  return hasCodePointProperty(C, OperatorStart);
 }
 
 /// isOperatorContinuationCodePoint - Return true if the specified code point
 /// is a valid operator code point.
 static bool isOperatorContinuationCodePoint(uint32_t C) {
-  if (isOperatorStartCodePoint(C))
-    return true;
-
-  // Unicode combining characters and variation selectors.
-  return (C >= 0x0300 && C <= 0x036F)
-         || (C >= 0x1DC0 && C <= 0x1DFF)
-         || (C >= 0x20D0 && C <= 0x20FF)
-         || (C >= 0xFE00 && C <= 0xFE0F)
-         || (C >= 0xFE20 && C <= 0xFE2F)
-         || (C >= 0xE0100 && C <= 0xE01EF);
+  return hasCodePointProperty(C, OperatorContinue);
 }
 
 static bool advanceIfValidStartOfOperator(char const *&ptr,
@@ -732,29 +974,137 @@ bool Lexer::isOperator(llvm::StringRef string) {
 }
 
 
-tok Lexer::kindOfIdentifier(llvm::StringRef Str, bool InSILMode) {
-#define SIL_KEYWORD(kw)
-#define KEYWORD(kw) if (Str == #kw) return tok::kw_##kw;
-#include "swift/Lexer/TokenKinds.def"
+//===----------------------------------------------------------------------===//
+// Keyword classification
+//===----------------------------------------------------------------------===//
 
-  // SIL keywords are only active in SIL mode.
-  if (InSILMode) {
-#define SIL_KEYWORD(kw) if (Str == #kw) return tok::kw_##kw;
+namespace {
+/// A keyword spelling as listed in TokenKinds.def.
+struct KeywordSpelling {
+  std::string_view Text;
+  tok Kind;
+  bool IsSIL;
+};
+
+constexpr KeywordSpelling KeywordSpellings[] = {
+#define KEYWORD(kw) {#kw, tok::kw_##kw, false},
+#define SIL_KEYWORD(kw) {#kw, tok::kw_##kw, true},
 #include "swift/Lexer/TokenKinds.def"
+};
+
+/// A slot in the keyword hash table.  Empty slots have a zero length, which
+/// never matches an identifier.
+struct KeywordSlot {
+  const char *Text = nullptr;
+  uint8_t Length = 0;
+  tok Kind = tok::identifier;
+  bool IsSIL = false;
+};
+
+constexpr unsigned KeywordTableBits = 8;
+
+/// First seed tried when searching for a collision-free hash.  It is known to
+/// work for the current keyword set so the compile-time search ends on its
+/// first iteration; when keywords are added the search continues from here.
+constexpr uint32_t KeywordHashSeedHint = 2612;
+
+/// hashKeyword - FNV-style mix of the length and three characters of a
+/// non-empty spelling, reduced to a slot index.  Together these characters
+/// distinguish every keyword in TokenKinds.def.
+constexpr unsigned hashKeyword(const char *Text, size_t Length,
+                               uint32_t Seed) {
+  uint32_t Hash = Seed;
+  for (uint32_t C : {uint32_t(Length), uint32_t(uint8_t(Text[0])),
+                     uint32_t(uint8_t(Text[Length * 3 / 4])),
+                     uint32_t(uint8_t(Text[Length - 1]))})
+    Hash = (Hash ^ C) * 0x01000193u;
+  return Hash >> (32 - KeywordTableBits);
+}
+
+struct KeywordTable {
+  uint32_t Seed = ~0U;
+  size_t MinLength = ~size_t(0);
+  size_t MaxLength = 0;
+  std::array<KeywordSlot, 1U << KeywordTableBits> Slots{};
+};
+
+/// buildKeywordTable - Find a seed for which every keyword lands in its own
+/// slot and fill in the table.  Returns a table with Seed == ~0U on failure.
+constexpr KeywordTable buildKeywordTable() {
+  for (uint32_t Seed = KeywordHashSeedHint; Seed != KeywordHashSeedHint + 64;
+       ++Seed) {
+    KeywordTable Table;
+    bool Collided = false;
+    for (const KeywordSpelling &KW : KeywordSpellings) {
+      KeywordSlot &Slot =
+          Table.Slots[hashKeyword(KW.Text.data(), KW.Text.size(), Seed)];
+      if (Slot.Length != 0) {
+        Collided = true;
+        break;
+      }
+      Slot = {KW.Text.data(), uint8_t(KW.Text.size()), KW.Kind, KW.IsSIL};
+      Table.MinLength = std::min(Table.MinLength, KW.Text.size());
+      Table.MaxLength = std::max(Table.MaxLength, KW.Text.size());
+    }
+    if (!Collided) {
+      Table.Seed = Seed;
+      return Table;
+    }
   }
-  return tok::identifier;
+  return KeywordTable();
+}
+
+constexpr KeywordTable Keywords = buildKeywordTable();
+static_assert(Keywords.Seed != ~0U,
+              "no collision-free keyword hash near KeywordHashSeedHint; "
+              "search for a new hint");
+} // end anonymous namespace
+
+/// kindOfIdentifier - Classify an identifier with a single probe of the
+/// keyword hash table followed by one length check and one memcmp.
+tok Lexer::kindOfIdentifier(llvm::StringRef Str, bool InSILMode) {
+  if (Str.size() < Keywords.MinLength || Str.size() > Keywords.MaxLength)
+    return tok::identifier;
+
+  const KeywordSlot &Slot =
+      Keywords.Slots[hashKeyword(Str.data(), Str.size(), Keywords.Seed)];
+  if (Slot.Length != Str.size() ||
+      std::memcmp(Slot.Text, Str.data(), Str.size()) != 0)
+    return tok::identifier;
+
+  // SIL keywords are only active in SIL mode.
+  if (Slot.IsSIL && !InSILMode)
+    return tok::identifier;
+  return Slot.Kind;
 }
 
 /// lexIdentifier - Match [a-zA-Z_][a-zA-Z_$0-9]*
 void Lexer::lexIdentifier() {
   const char *TokStart = CurPtr - 1;
-  CurPtr = TokStart;
-  bool didStart = advanceIfValidStartOfIdentifier(CurPtr, BufferEnd);
-  assert(didStart && "Unexpected start");
-  (void) didStart;
-
-  // Lex [a-zA-Z_$0-9[[:XID_Continue:]]]*
-  while (advanceIfValidContinuationOfIdentifier(CurPtr, BufferEnd));
+  const char *ValidUTF8End = nullptr;
+  if (isASCII(*TokStart)) {
+    // lexImpl only gets here for [a-zA-Z_], so there is nothing to decode.
+    assert(isAsciiIdentifierStart(*TokStart) && "Unexpected start");
+  } else {
+    CurPtr = TokStart;
+    ValidUTF8End = getValidUTF8End(CurPtr);
+    bool didStart =
+        advanceIfValidStartOfIdentifier(CurPtr, BufferEnd, ValidUTF8End);
+    assert(didStart && "Unexpected start");
+    (void) didStart;
+  }
+
+  // Lex [a-zA-Z_$0-9[[:XID_Continue:]]]*. ASCII runs are skipped in bulk;
+  // only a byte >= 0x80 needs decoding and the Unicode tables.
+  CurPtr = bytescan::skipIdentifierBody(CurPtr, BufferEnd);
+  while (CurPtr < BufferEnd && !isASCII(*CurPtr)) {
+    if (!ValidUTF8End)
+      ValidUTF8End = getValidUTF8End(CurPtr);
+    if (!advanceIfValidContinuationOfIdentifier(CurPtr, BufferEnd,
+                                                ValidUTF8End))
+      break;
+    CurPtr = bytescan::skipIdentifierBody(CurPtr, BufferEnd);
+  }
 
   // Determine the token kind for this identifier
   llvm::StringRef IdentifierStr(TokStart, CurPtr - TokStart);
@@ -950,18 +1300,7 @@ void Lexer::lexOperatorIdentifier() {
       case '=':
         // Refrain from emitting this message in operator name position.
         if (NextToken.isNot(tok::kw_operator) && leftBound != rightBound) {
-          // auto d = diagnose(TokStart, diag::lex_unary_equal);
-          // if (leftBound)
-          //   d.fixItInsert(getSourceLoc(TokStart), " ");
-          // else
-          //   d.fixItInsert(getSourceLoc(TokStart+1), " ");
-          // FIXME: should use inflightdiagnostic
-          // but we don't have it here
-          DiagQueue->diagnose(Diagnostic(
-            DiagnosticSeverity::Error,
-            getSourceLocation(TokStart),
-            "unary operator cannot be immediately followed by '='"
-          ));
+          diagnose(TokStart, diag::lex_unary_equal);
 
           // TODO: fixit insert space
         }
@@ -989,11 +1328,7 @@ void Lexer::lexOperatorIdentifier() {
         // a tok::period, since that is what the user is wanting to know about.
         if (*AfterHorzWhitespace == '\0' &&
             AfterHorzWhitespace == CodeCompletionPtr) {
-          // diagnose(TokStart, diag::expected_member_name);
-          DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error,
-                                         getSourceLocation(TokStart),
-                                         "expected member name following '.'"
-          ));
+          diagnose(TokStart, diag::expected_member_name);
           return formToken(tok::period, TokStart);
         }
 
@@ -1002,21 +1337,14 @@ void Lexer::lexOperatorIdentifier() {
             // either // or /* and most likely occurs just in our testsuite for
             // expected-error lines.
             *AfterHorzWhitespace != '/') {
-          // diagnose(TokStart, diag::extra_whitespace_period)
-          //   .fixItRemoveChars(getSourceLoc(CurPtr),
-          //                     getSourceLoc(AfterHorzWhitespace));
-
-          DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error,
-                                         getSourceLocation(TokStart),
-                                         "extraneous whitespace after '.'"
-          ));
+          // TODO: fix-it remove the whitespace after the period.
+
+          diagnose(TokStart, diag::extra_whitespace_period);
           return formToken(tok::period, TokStart);
         }
 
         // Otherwise, it is probably a missing member.
-        // diagnose(TokStart, diag::expected_member_name);
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(TokStart),
-                                       "expected member name following '.'"));
+        diagnose(TokStart, diag::expected_member_name);
         return formToken(tok::unknown, TokStart);
       }
       case '?':
@@ -1029,9 +1357,7 @@ void Lexer::lexOperatorIdentifier() {
       case ('-' << 8) | '>': // ->
         return formToken(tok::arrow, TokStart);
       case ('*' << 8) | '/': // */
-        // diagnose(TokStart, diag::lex_unexpected_block_comment_end);
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(TokStart),
-                                       "unexpected end of block comment"));
+        diagnose(TokStart, diag::lex_unexpected_block_comment_end);
         return formToken(tok::unknown, TokStart);
     }
   } else {
@@ -1039,9 +1365,7 @@ void Lexer::lexOperatorIdentifier() {
     // it as potentially ending a block comment.
     auto Pos = llvm::StringRef(TokStart, CurPtr - TokStart).find("*/");
     if (Pos != llvm::StringRef::npos) {
-      // diagnose(TokStart+Pos, diag::lex_unexpected_block_comment_end);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(TokStart),
-                                     "unexpected end of block comment"));
+      diagnose(TokStart, diag::lex_unexpected_block_comment_end);
       return formToken(tok::unknown, TokStart);
     }
   }
@@ -1100,14 +1424,7 @@ void Lexer::lexHexNumber() {
   };
 
   auto expected_hex_digit = [&](const char *loc) {
-    // TODO: FIXME
-    // diagnose(loc, diag::lex_invalid_digit_in_int_literal, llvm::StringRef(loc, 1),
-    //          (unsigned)ExpectedDigitKind::Hex);
-    // "invalid digit '%0' in integer literal"
-    // replace with %0 with llvm::StringRef(loc, 1)
-    DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(loc),
-                                   "invalid digit '" + std::string(loc, 1) + "' in integer literal"));
-    // DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error,getSourceLocation(loc), ))
+    diagnose(loc, diag::lex_invalid_digit_in_int_literal, llvm::StringRef(loc, 1));
     return expected_digit();
   };
 
@@ -1150,9 +1467,7 @@ void Lexer::lexHexNumber() {
         CurPtr = PtrOnDot;
         return formToken(tok::integer_literal, TokStart);
       }
-      // diagnose(CurPtr, diag::lex_expected_binary_exponent_in_hex_float_literal);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                     "hexadecimal floating point literal must end with an exponent"));
+      diagnose(CurPtr, diag::lex_expected_binary_exponent_in_hex_float_literal);
       return formToken(tok::unknown, TokStart);
     }
   }
@@ -1180,15 +1495,9 @@ void Lexer::lexHexNumber() {
     // non-identifier (empty exponent)
     auto tmp = CurPtr;
     if (advanceIfValidContinuationOfIdentifier(CurPtr, BufferEnd))
-      // diagnose(tmp, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1),
-      //          *tmp == '_');
-      // diagnose(CurPtr, diag::lex_expected_binary_exponent_in_hex_float_literal);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                     "invalid digit '" + std::string(tmp, 1) + "' in exponent"));
+      diagnose(CurPtr, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1));
     else
-      // diagnose(CurPtr, diag::lex_expected_digit_in_fp_exponent);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                     "expected a digit in floating point exponent"));
+      diagnose(CurPtr, diag::lex_expected_digit_in_fp_exponent);
     return expected_digit();
   }
 
@@ -1197,10 +1506,7 @@ void Lexer::lexHexNumber() {
 
   auto tmp = CurPtr;
   if (advanceIfValidContinuationOfIdentifier(CurPtr, BufferEnd)) {
-    // diagnose(tmp, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1),
-    //          false);
-    DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                   "invalid digit '" + std::string(tmp, 1) + "' in exponent"));
+    diagnose(CurPtr, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1));
     return expected_digit();
   }
 
@@ -1227,11 +1533,7 @@ void Lexer::lexNumber() {
   };
 
   auto expected_int_digit = [&](const char *loc, ExpectedDigitKind kind) {
-    // diagnose(loc, diag::lex_invalid_digit_in_int_literal, llvm::StringRef(loc, 1),
-    //          (unsigned)kind);
-    // diagnose(CurPtr, diag::lex_expected_binary_exponent_in_hex_float_literal);
-    DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(loc),
-                                   "invalid digit '" + std::string(loc, 1) + "' in integer literal"));
+    diagnose(loc, diag::lex_invalid_digit_in_int_literal, llvm::StringRef(loc, 1));
     return expected_digit();
   };
 
@@ -1314,15 +1616,9 @@ void Lexer::lexNumber() {
       // non-identifier (empty exponent)
       auto tmp = CurPtr;
       if (advanceIfValidContinuationOfIdentifier(CurPtr, BufferEnd))
-        // diagnose(tmp, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1),
-        //          *tmp == '_');
-        // diagnose(CurPtr, diag::lex_expected_binary_exponent_in_hex_float_literal);
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                       "invalid digit '" + std::string(tmp, 1) + "' in exponent"));
+        diagnose(CurPtr, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1));
       else
-        // diagnose(CurPtr, diag::lex_expected_digit_in_fp_exponent);
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                       "expected a digit in floating point exponent"));
+        diagnose(CurPtr, diag::lex_expected_digit_in_fp_exponent);
 
       return expected_digit();
     }
@@ -1332,11 +1628,7 @@ void Lexer::lexNumber() {
 
     auto tmp = CurPtr;
     if (advanceIfValidContinuationOfIdentifier(CurPtr, BufferEnd)) {
-      // diagnose(tmp, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1),
-      //          false);
-      // diagnose(CurPtr, diag::lex_expected_digit_in_fp_exponent);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                     "invalid digit '" + std::string(tmp, 1) + "' in exponent"));
+      diagnose(CurPtr, diag::lex_invalid_digit_in_fp_exponent, llvm::StringRef(tmp, 1));
 
       return expected_digit();
     }
@@ -1359,10 +1651,7 @@ unsigned Lexer::lexUnicodeEscape(const char *&CurPtr, Lexer *Diags) {
 
   if (CurPtr[0] != '}') {
     if (Diags)
-      // Diags->diagnose(CurPtr, diag::lex_invalid_u_escape_rbrace);
-      // "expected '}' in unicode escape sequence"
-      Diags->DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                            "expected '}' in unicode escape sequence"));
+      Diags->diagnose(CurPtr, diag::lex_invalid_u_escape_rbrace);
 
     return ~1U;
   }
@@ -1370,9 +1659,7 @@ unsigned Lexer::lexUnicodeEscape(const char *&CurPtr, Lexer *Diags) {
 
   if (NumDigits < 1 || NumDigits > 8) {
     if (Diags)
-      // Diags->diagnose(CurPtr, diag::lex_invalid_u_escape);
-      Diags->DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr),
-                                            "invalid unicode escape sequence"));
+      Diags->diagnose(CurPtr, diag::lex_invalid_u_escape);
     return ~1U;
   }
 
@@ -1452,13 +1739,10 @@ static bool delimiterMatches(unsigned CustomDelimiterLen, const char *&BytesPtr,
   BytesPtr += CustomDelimiterLen;
 
   if (Diags && TmpPtr > BytesPtr) {
-    const auto message = IsClosing
-                           ? "invalid character in closing delimiter"
-                           : "invalid character in escape delimiter";
-    // Diags->diagnose(Lexer::getSourceLoc(BytesPtr), message)
-    //     .fixItRemoveChars(Lexer::getSourceLoc(BytesPtr),
-    //                       Lexer::getSourceLoc(TmpPtr));
-    Diags->error(Lexer::getSourceLocation(BytesPtr), message);
+    const auto ID = IsClosing ? diag::lex_invalid_closing_delimiter
+                              : diag::lex_invalid_escape_delimiter;
+    // TODO: fix-it remove the characters between BytesPtr and TmpPtr.
+    Diags->diagnose(Lexer::getSourceLocation(BytesPtr), ID);
   }
   return true;
 }
@@ -1470,8 +1754,9 @@ static bool advanceIfMultilineDelimiter(unsigned CustomDelimiterLen,
                                         bool IsOpening = false) {
   // Test for single-line string literals that resemble multiline delimiter.
   const char *TmpPtr = CurPtr + 1;
-  if (IsOpening && CustomDelimiterLen) {
-    while (*TmpPtr != '\r' && *TmpPtr != '\n') {
+  // Stop at the NUL after the buffer if the literal is on its last line.
+  if (IsOpening && CustomDelimiterLen && *CurPtr != 0) {
+    while (*TmpPtr != '\r' && *TmpPtr != '\n' && *TmpPtr != 0) {
       if (*TmpPtr == '"') {
         if (delimiterMatches(CustomDelimiterLen, ++TmpPtr, nullptr)) {
           return false;
@@ -1515,18 +1800,17 @@ unsigned Lexer::lexCharacter(const char *&CurPtr, char StopQuote,
         if (isPrintable(CurPtr[-1]) == 0)
           if (!(IsMultilineString && (CurPtr[-1] == '\t')))
             if (EmitDiagnostics)
-              // diagnose(CharStart, diag::lex_unprintable_ascii_character);
-              // "unprintable ASCII character found in source file"
-              DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CharStart),
-                                             "unprintable ASCII character found in source file"));
+              diagnose(CharStart, diag::lex_unprintable_ascii_character);
         return CurPtr[-1];
       }
       --CurPtr;
-      unsigned CharValue = validateUTF8CharacterAndAdvance(CurPtr, BufferEnd);
+      unsigned CharValue =
+          CurPtr < getValidUTF8End(CurPtr)
+              ? decodeValidUTF8CharacterAndAdvance(CurPtr, BufferEnd)
+              : validateUTF8CharacterAndAdvance(CurPtr, BufferEnd);
       if (CharValue != ~0U) return CharValue;
       if (EmitDiagnostics)
-        // diagnose(CharStart, diag::lex_invalid_utf8);
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CharStart), "invalid UTF-8"));
+        diagnose(CharStart, diag::lex_invalid_utf8);
 
       return ~1U;
     }
@@ -1556,9 +1840,7 @@ unsigned Lexer::lexCharacter(const char *&CurPtr, char StopQuote,
     case 0:
       assert(CurPtr - 1 != BufferEnd && "Caller must handle EOF");
       if (EmitDiagnostics)
-        // diagnose(CurPtr-1, diag::lex_nul_character);
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr - 1),
-                                       "nul character embedded in source file"));
+        diagnose(CurPtr - 1, diag::lex_nul_character);
 
       return CurPtr[-1];
     case '\n': // String literals cannot have \n or \r in them.
@@ -1584,9 +1866,7 @@ unsigned Lexer::lexCharacter(const char *&CurPtr, char StopQuote,
       LLVM_FALLTHROUGH;
     default: // Invalid escape.
       if (EmitDiagnostics)
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr - 1),
-                                       "invalid escape sequence in literal"));
-    // diagnose(CurPtr, diag::lex_invalid_escape);
+        diagnose(CurPtr - 1, diag::lex_invalid_escape);
     // If this looks like a plausible escape character, recover as though this
     // is an invalid escape.
       if (isAlphanumeric(*CurPtr)) ++CurPtr;
@@ -1613,10 +1893,7 @@ unsigned Lexer::lexCharacter(const char *&CurPtr, char StopQuote,
       ++CurPtr;
       if (*CurPtr != '{') {
         if (EmitDiagnostics)
-          DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr - 1),
-                                         "unicode escape sequence expects between 1 and 8 hex digits"));
-
-        // diagnose(CurPtr-1, diag::lex_unicode_escape_braces);
+          diagnose(CurPtr - 1, diag::lex_unicode_escape_braces);
         return ~1U;
       }
 
@@ -1630,9 +1907,7 @@ unsigned Lexer::lexCharacter(const char *&CurPtr, char StopQuote,
   llvm::SmallString<64> TempString;
   if (CharValue >= 0x80 && EncodeToUTF8(CharValue, TempString)) {
     if (EmitDiagnostics)
-      // diagnose(CharStart, diag::lex_invalid_unicode_scalar);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, getSourceLocation(CurPtr - 1),
-                                     "invalid unicode scalar value"));
+      diagnose(CurPtr - 1, diag::lex_invalid_unicode_scalar);
 
     return ~1U;
   }
@@ -1854,10 +2129,9 @@ getMultilineTrailingIndent(llvm::StringRef Bytes, DiagnosticEngine *Diags = null
             auto escapeLoc = Lexer::getSourceLocation(Ptr);
             bool invalid = true;
             while (*--Ptr == '\\') invalid = !invalid;
+            // TODO: fix-it remove the escape up to the end of the line.
             if (invalid)
-              Diags->error(escapeLoc, "escaped newline at end of file");
-            // Diags->diagnose(escapeLoc, diag::lex_escaped_newline_at_lastline);
-            // .fixItRemoveChars(escapeLoc, Lexer::getSourceLoc(LineEnd));
+              Diags->diagnose(escapeLoc, diag::lex_escaped_newline_at_lastline);
           }
         }
 
@@ -1870,10 +2144,8 @@ getMultilineTrailingIndent(llvm::StringRef Bytes, DiagnosticEngine *Diags = null
 
   if (sawNonWhitespace && Diags) {
     auto loc = Lexer::getSourceLocation(start + 1);
-    // Diags->diagnose(loc, diag::lex_illegal_multiline_string_end);
     // FIXME: Should try to suggest indentation.
-    // .fixItInsert(loc, "\n");
-    Diags->error(loc, "illegal end of multiline string");
+    Diags->diagnose(loc, diag::lex_illegal_multiline_string_end);
   }
 
   return "";
@@ -1901,44 +2173,19 @@ static void diagnoseInvalidMultilineIndents(
   auto getLoc = [&](size_t offset) -> SourceLocation {
     return Lexer::getSourceLocation((const char *) Bytes.bytes_begin() + offset);
   };
-  auto classify = [&](unsigned char ch) -> unsigned {
-    switch (ch) {
-      case ' ':
-        return 0;
-      case '\t':
-        return 1;
-      default:
-        return 2;
-    }
-  };
-
-  Diags->error(getLoc(LineStarts[0] + MistakeOffset), "multiline string indentation inconsistent");
-  Diags->error(IndentLoc.getAdvancedLoc(MistakeOffset),
-               "multiline string indentation should match here");
-  Diags->error(getLoc(LineStarts[0] + MistakeOffset), "multiline string indentation change line");
-  // Diags->diagnose(getLoc(LineStarts[0] + MistakeOffset),
-  //                 diag::lex_multiline_string_indent_inconsistent,
-  //                 LineStarts.size() != 1, LineStarts.size(),
-  //                 classify(Bytes[LineStarts[0] + MistakeOffset]));
-  //
-  // Diags->diagnose(IndentLoc.getAdvancedLoc(MistakeOffset),
-  //                 diag::lex_multiline_string_indent_should_match_here,
-  //                 classify(ExpectedIndent[MistakeOffset]));
-  //
-  // auto fix = Diags->diagnose(getLoc(LineStarts[0] + MistakeOffset),
-  //                            diag::lex_multiline_string_indent_change_line,
-  //                            LineStarts.size() != 1);
+  Diags->diagnose(getLoc(LineStarts[0] + MistakeOffset),
+                  diag::lex_multiline_string_indent_inconsistent);
+  Diags->diagnose(IndentLoc.getAdvancedLoc(MistakeOffset),
+                  diag::lex_multiline_string_indent_should_match_here);
+  Diags->diagnose(getLoc(LineStarts[0] + MistakeOffset),
+                  diag::lex_multiline_string_indent_change_line);
 
   assert(MistakeOffset <= ActualIndent.size());
   assert(ExpectedIndent.substr(0, MistakeOffset) ==
     ActualIndent.substr(0, MistakeOffset));
 
-  for (auto line: LineStarts) {
-    // TODO: Fix Me
-    // fix.fixItReplaceChars(getLoc(line + MistakeOffset),
-    //                       getLoc(line + ActualIndent.size()),
-    //                       ExpectedIndent.substr(MistakeOffset));
-  }
+  // TODO: fix-it replace the indent of each line from MistakeOffset on with
+  // the rest of ExpectedIndent.
 }
 
 /// validateMultilineIndents:
@@ -2051,9 +2298,9 @@ void Lexer::diagnoseSingleQuoteStringLiteral(const char *TokStart,
   replacement.append(OutputPtr, Ptr - 1);
   replacement.push_back('"');
 
-  // getTokenDiags()->diagnose(startLoc, diag::lex_single_quote_string);
-  // .fixItReplaceChars(startLoc, endLoc, replacement);
-  getTokenDiags()->error(startLoc, "single-quote string literal");
+  // TODO: fix-it replace the quotes with double quotes.
+  if (DiagnosticEngine *Diags = getTokenDiags())
+    Diags->diagnose(startLoc, diag::lex_single_quote_string);
 }
 
 /// lexStringLiteral:
@@ -2071,10 +2318,11 @@ void Lexer::lexStringLiteral(unsigned CustomDelimiterLen) {
   bool IsMultilineString = advanceIfMultilineDelimiter(
     CustomDelimiterLen, CurPtr, getTokenDiags(), true);
   if (IsMultilineString && *CurPtr != '\n' && *CurPtr != '\r')
-    // diagnose(CurPtr, diag::lex_illegal_multiline_string_start)
-    //     .fixItInsert(Lexer::getSourceLoc(CurPtr), "\n");
-    DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr),
-                                   "illegal start of multiline string"));
+    // TODO: fix-it insert a newline after the opening delimiter.
+    diagnose(CurPtr, diag::lex_illegal_multiline_string_start);
+
+  // The interpolations found so far, for SegmentTable.
+  llvm::SmallVector<StringSegmentTable::Interpolation, 4> Interpolations;
 
   bool wasErroneous = false;
   while (true) {
@@ -2089,32 +2337,27 @@ void Lexer::lexStringLiteral(unsigned CustomDelimiterLen) {
       if (*CurPtr == ')') {
         // Successfully scanned the body of the expression literal.
         ++CurPtr;
+        if (SegmentTable)
+          Interpolations.push_back({uint32_t(TmpPtr - 1 - BufferStart),
+                                    uint32_t(CurPtr - BufferStart)});
         continue;
       } else {
         if ((*CurPtr == '\r' || *CurPtr == '\n') && IsMultilineString) {
-          // diagnose(--TmpPtr, diag::string_interpolation_unclosed);
-          DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(--TmpPtr),
-                                         "string interpolation unclosed"));
+          diagnose(--TmpPtr, diag::string_interpolation_unclosed);
 
           // The only case we reach here is unterminated single line string in
           // the interpolation. For better recovery, go on after emitting
           // an error.
-          // diagnose(CurPtr, diag::lex_unterminated_string);
-          DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr),
-                                         "unterminated string literal"));
+          diagnose(CurPtr, diag::lex_unterminated_string);
 
           wasErroneous = true;
           continue;
         } else if (!IsMultilineString || CurPtr == BufferEnd) {
-          // diagnose(--TmpPtr, diag::string_interpolation_unclosed);
-          DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(--TmpPtr),
-                                         "string interpolation unclosed"));
+          diagnose(--TmpPtr, diag::string_interpolation_unclosed);
         }
 
         // As a fallback, just emit an unterminated string error.
-        // diagnose(TokStart, diag::lex_unterminated_string);
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(TokStart),
-                                       "unterminated string literal"));
+        diagnose(TokStart, diag::lex_unterminated_string);
         return formToken(tok::unknown, TokStart);
       }
     }
@@ -2122,9 +2365,7 @@ void Lexer::lexStringLiteral(unsigned CustomDelimiterLen) {
     // String literals cannot have \n or \r in them (unless multiline).
     if (((*CurPtr == '\r' || *CurPtr == '\n') && !IsMultilineString)
         || CurPtr == BufferEnd) {
-      // diagnose(TokStart, diag::lex_unterminated_string);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(TokStart),
-                                     "unterminated string literal"));
+      diagnose(TokStart, diag::lex_unterminated_string);
       return formToken(tok::unknown, TokStart);
     }
 
@@ -2147,8 +2388,9 @@ void Lexer::lexStringLiteral(unsigned CustomDelimiterLen) {
   if (wasErroneous)
     return formToken(tok::unknown, TokStart);
 
-  return formStringLiteralToken(TokStart, IsMultilineString,
-                                CustomDelimiterLen);
+  formStringLiteralToken(TokStart, IsMultilineString, CustomDelimiterLen);
+  if (SegmentTable && NextToken.is(tok::string_literal))
+    SegmentTable->record(TokStart - BufferStart, Interpolations);
 }
 
 
@@ -2183,11 +2425,8 @@ const char *Lexer::findEndOfCurlyQuoteStringLiteral(const char *Body,
     // an opening curly quote) diagnose it with a fixit and then return.
     if (CharValue == 0x0000201D) {
       if (EmitDiagnostics) {
-        DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CharStart),
-                                       "invalid curly quote"));
-        // diagnose(CharStart, diag::lex_invalid_curly_quote);
-        // .fixItReplaceChars(getSourceLoc(CharStart), getSourceLoc(Body),
-        //                    "\"");
+        // TODO: fix-it replace the curly quote with '"'.
+        diagnose(CharStart, diag::lex_invalid_curly_quote);
       }
       return Body;
     }
@@ -2451,9 +2690,10 @@ void Lexer::lexEscapedIdentifier() {
   while (advanceIfValidEscapedIdentifier(CurPtr, BufferEnd));
 
   // If we have the terminating "`", it's an escaped/raw identifier, unless it
-  // contained only operator characters or was entirely whitespace.
+  // was empty, contained only operator characters or was entirely whitespace.
   llvm::StringRef IdStr(IdentifierStart, CurPtr - IdentifierStart);
-  if (*CurPtr == '`' && !isOperator(IdStr) && !isEntirelyWhitespace(IdStr)) {
+  if (*CurPtr == '`' && !IdStr.empty() && !isOperator(IdStr) &&
+      !isEntirelyWhitespace(IdStr)) {
     ++CurPtr;
     formEscapedIdentifierToken(Quote);
     return;
@@ -2505,9 +2745,7 @@ bool Lexer::tryLexConflictMarker(bool EatNewline) {
                               : ConflictMarkerKind::Perforce;
   if (const char *End = findConflictEnd(Ptr, BufferEnd, Kind)) {
     // Diagnose at the conflict marker, then jump ahead to the end.
-    // diagnose(CurPtr, diag::lex_conflict_marker_in_file);
-    DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr),
-                                   "conflict marker in file"));
+    diagnose(CurPtr, diag::lex_conflict_marker_in_file);
     CurPtr = End;
 
     // Skip ahead to the end of the marker.
@@ -2523,27 +2761,27 @@ bool Lexer::tryLexConflictMarker(bool EatNewline) {
 
 bool Lexer::lexUnknown(bool EmitDiagnosticsIfToken) {
   const char *Tmp = CurPtr - 1;
+  const char *ValidUTF8End = getValidUTF8End(Tmp);
 
-  if (advanceIfValidContinuationOfIdentifier(Tmp, BufferEnd)) {
+  if (advanceIfValidContinuationOfIdentifier(Tmp, BufferEnd, ValidUTF8End)) {
     // If this is a valid identifier continuation, but not a valid identifier
     // start, attempt to recover by eating more continuation characters.
     if (EmitDiagnosticsIfToken) {
-      // diagnose(CurPtr - 1, diag::lex_invalid_identifier_start_character);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1),
-                                     "invalid identifier start character"));
+      diagnose(CurPtr - 1, diag::lex_invalid_identifier_start_character);
     }
-    while (advanceIfValidContinuationOfIdentifier(Tmp, BufferEnd));
+    while (advanceIfValidContinuationOfIdentifier(Tmp, BufferEnd,
+                                                  ValidUTF8End));
     CurPtr = Tmp;
     return true;
   }
 
   // This character isn't allowed in Swift source.
-  uint32_t Codepoint = validateUTF8CharacterAndAdvance(Tmp, BufferEnd);
+  uint32_t Codepoint =
+      Tmp < ValidUTF8End ? decodeValidUTF8CharacterAndAdvance(Tmp, BufferEnd)
+                         : validateUTF8CharacterAndAdvance(Tmp, BufferEnd);
   if (Codepoint == ~0U) {
-    DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1),
-                                   "invalid UTF-8 found in source file"));
-    // diagnose(CurPtr - 1, diag::lex_invalid_utf8);
-    // .fixItReplaceChars(getSourceLoc(CurPtr - 1), getSourceLoc(Tmp), " ");
+    // TODO: fix-it replace the bytes with a space.
+    diagnose(CurPtr - 1, diag::lex_invalid_utf8_in_source);
     CurPtr = Tmp;
     return false; // Skip presumed whitespace.
   } else if (Codepoint == 0x000000A0) {
@@ -2552,20 +2790,15 @@ bool Lexer::lexUnknown(bool EmitDiagnosticsIfToken) {
       Tmp += 2;
     llvm::SmallString<8> Spaces;
     Spaces.assign((Tmp - CurPtr + 1) / 2, ' ');
-    DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1),
-                                   "non-breaking space"));
-    // diagnose(CurPtr - 1, diag::lex_nonbreaking_space);
-    // .fixItReplaceChars(getSourceLoc(CurPtr - 1), getSourceLoc(Tmp),
-    //                    Spaces);
+    // TODO: fix-it replace the non-breaking spaces with Spaces.
+    diagnose(CurPtr - 1, diag::lex_nonbreaking_space);
     CurPtr = Tmp;
     return false;
   } else if (Codepoint == 0x0000201D) {
     // If this is an end curly quote, just diagnose it with a fixit hint.
     if (EmitDiagnosticsIfToken) {
-      // diagnose(CurPtr - 1, diag::lex_invalid_curly_quote);
-      // .fixItReplaceChars(getSourceLoc(CurPtr - 1), getSourceLoc(Tmp), "\"");
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1),
-                                     "invalid curly quote"));
+      // TODO: fix-it replace the curly quote with '"'.
+      diagnose(CurPtr - 1, diag::lex_invalid_curly_quote);
     }
     CurPtr = Tmp;
     return true;
@@ -2583,37 +2816,18 @@ bool Lexer::lexUnknown(bool EmitDiagnosticsIfToken) {
     // diagnose an end curly quote in the middle of a straight quoted
     // literal.
     if (EmitDiagnosticsIfToken) {
-      // diagnose(CurPtr - 1, diag::lex_invalid_curly_quote);
-      // .fixItReplaceChars(getSourceLoc(CurPtr - 1), getSourceLoc(EndPtr),
-      //                    "\"");
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1),
-                                     "invalid curly quote"));
+      // TODO: fix-it replace the curly quote with '"'.
+      diagnose(CurPtr - 1, diag::lex_invalid_curly_quote);
     }
     CurPtr = Tmp;
     return true;
   }
 
-  // diagnose(CurPtr - 1, diag::lex_invalid_character);
-  // .fixItReplaceChars(getSourceLoc(CurPtr - 1), getSourceLoc(Tmp), " ");
-  DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1), "invalid character"));
+  // TODO: fix-it replace the character with a space.
+  diagnose(CurPtr - 1, diag::lex_invalid_character);
 
-  // TODO: Fix Me - If we have a confusable character, we should try to diagnose
-  // char ExpectedCodepoint;
-  // if ((ExpectedCodepoint =
-  //          confusable::tryConvertConfusableCharacterToASCII(Codepoint))) {
-  //
-  //   llvm::SmallString<4> ConfusedChar;
-  //   EncodeToUTF8(Codepoint, ConfusedChar);
-  //   llvm::SmallString<1> ExpectedChar;
-  //   ExpectedChar += ExpectedCodepoint;
-  //   auto charNames = confusable::getConfusableAndBaseCodepointNames(Codepoint);
-  //
-  //   // diagnose(CurPtr - 1, diag::lex_confusable_character, ConfusedChar,
-  //   //          charNames.first, ExpectedChar, charNames.second);
-  //       // .fixItReplaceChars(getSourceLoc(CurPtr - 1), getSourceLoc(Tmp),
-  //       //                    ExpectedChar);
-  //   DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1), "confusable character"));
-  // }
+  // TODO: diagnose a confusable character with lex_confusable_character,
+  // suggesting the ASCII character it resembles.
 
   CurPtr = Tmp;
   return false; // Skip presumed whitespace.
@@ -2769,7 +2983,8 @@ llvm::StringRef Lexer::getEncodedStringSegmentImpl(llvm::StringRef Bytes,
 void Lexer::getStringLiteralSegments(
   const Token &Str,
   llvm::SmallVectorImpl<StringSegment> &Segments,
-  DiagnosticEngine *Diags) {
+  DiagnosticEngine *Diags,
+  const StringSegmentTable *Table) {
   assert(Str.is(tok::string_literal));
   // Get the bytes behind the string literal, dropping any double quotes.
   llvm::StringRef Bytes = getStringLiteralContent(Str);
@@ -2781,43 +2996,56 @@ void Lexer::getStringLiteralSegments(
   if (MultilineString)
     IndentToStrip = getMultilineTrailingIndent(Bytes).size();
 
-  // Note that it is always safe to read one over the end of "Bytes" because
-  // we know that there is a terminating " character.  Use BytesPtr to avoid a
-  // range check subscripting on the StringRef.
   const char *SegmentStartPtr = Bytes.begin();
-  const char *BytesPtr = SegmentStartPtr;
-  size_t pos;
-  while ((pos = Bytes.find('\\', BytesPtr - Bytes.begin())) != llvm::StringRef::npos) {
-    BytesPtr = Bytes.begin() + pos + 1;
-
-    if (!delimiterMatches(CustomDelimiterLen, BytesPtr, Diags) ||
-        *BytesPtr++ != '(')
-      continue;
 
-    // String interpolation.
-
-    // Push the current segment.
+  // Pushes the literal segment that ends at the '\' of an interpolation, and
+  // the interpolated expression [ExprStart, ExprEnd), parentheses included.
+  auto addInterpolation = [&](const char *ExprStart, const char *ExprEnd) {
     Segments.push_back(
       StringSegment::getLiteral(getSourceLocation(SegmentStartPtr),
-                                BytesPtr - SegmentStartPtr - 2 - CustomDelimiterLen,
+                                ExprStart - SegmentStartPtr - 1 - CustomDelimiterLen,
                                 IsFirstSegment, false, IndentToStrip,
                                 CustomDelimiterLen));
     IsFirstSegment = false;
 
-    // Find the closing ')'.
-    const char *End = skipToEndOfInterpolatedExpression(
-      BytesPtr, Str.getText().end(), MultilineString);
-    assert(*End == ')' && "invalid string literal interpolations should"
-      " not be returned as string literals");
-    ++End;
-
-    // Add an expression segment.
     Segments.push_back(
-      StringSegment::getExpr(getSourceLocation(BytesPtr - 1), End - BytesPtr + 1));
+      StringSegment::getExpr(getSourceLocation(ExprStart), ExprEnd - ExprStart));
 
     // Reset the beginning of the segment to the string that remains to be
     // consumed.
-    SegmentStartPtr = BytesPtr = End;
+    SegmentStartPtr = ExprEnd;
+  };
+
+  if (auto Recorded = Table ? Table->lookup(Str) : std::nullopt) {
+    // The lexer already found the interpolations.
+    const char *BufferStart = Table->getBufferText().data();
+    for (const StringSegmentTable::Interpolation &I : *Recorded)
+      addInterpolation(BufferStart + I.Begin, BufferStart + I.End);
+  } else {
+    // Note that it is always safe to read one over the end of "Bytes" because
+    // we know that there is a terminating " character.  Use BytesPtr to avoid a
+    // range check subscripting on the StringRef.
+    const char *BytesPtr = SegmentStartPtr;
+    size_t pos;
+    while ((pos = Bytes.find('\\', BytesPtr - Bytes.begin())) != llvm::StringRef::npos) {
+      BytesPtr = Bytes.begin() + pos + 1;
+
+      if (!delimiterMatches(CustomDelimiterLen, BytesPtr, Diags) ||
+          *BytesPtr++ != '(')
+        continue;
+
+      // String interpolation.
+
+      // Find the closing ')'.
+      const char *End = skipToEndOfInterpolatedExpression(
+        BytesPtr, Str.getText().end(), MultilineString);
+      assert(*End == ')' && "invalid string literal interpolations should"
+        " not be returned as string literals");
+      ++End;
+
+      addInterpolation(BytesPtr - 1, End);
+      BytesPtr = End;
+    }
   }
 
   Segments.push_back(
@@ -2828,6 +3056,93 @@ void Lexer::getStringLiteralSegments(
 }
 
 
+//===----------------------------------------------------------------------===//
+// Lead byte dispatch
+//===----------------------------------------------------------------------===//
+
+namespace {
+
+/// What lexImpl does with the first byte of a token.
+enum class LeadByteClass : uint8_t {
+  Unknown,     ///< ASCII that cannot start a token
+  Identifier,  ///< [a-zA-Z_]
+  Number,      ///< [0-9]
+  Operator,    ///< operator characters with no special cases
+  Punctuator,  ///< single-character tokens, see LeadByte::Kind
+  String,      ///< ' and "
+  Whitespace,  ///< ' ', '\t', '\v', '\f'
+  Newline,     ///< '\n', '\r'
+  Nul,
+  HighByte,    ///< first byte of a multi-byte UTF-8 sequence (or garbage)
+  UTF16BOM,    ///< 0xFE and 0xFF
+  Hash,
+  Slash,
+  Dollar,
+  Percent,
+  Exclaim,
+  Question,
+  Less,
+  Backtick,
+};
+
+struct LeadByte {
+  LeadByteClass Class = LeadByteClass::Unknown;
+  /// The token formed by a Punctuator byte.
+  tok Kind = tok::unknown;
+};
+
+/// Classifies every byte value, using the same character sets as
+/// charinfo::InfoTable, so lexImpl needs a single indexed branch per token.
+constexpr std::array<LeadByte, 256> buildLeadByteTable() {
+  std::array<LeadByte, 256> Table{};
+  auto set = [&Table](const char *Chars, LeadByteClass Class) {
+    for (; *Chars; ++Chars)
+      Table[(unsigned char)*Chars].Class = Class;
+  };
+  auto punctuator = [&Table](char C, tok Kind) {
+    Table[(unsigned char)C] = {LeadByteClass::Punctuator, Kind};
+  };
+
+  for (unsigned C = 0x80; C != 0x100; ++C)
+    Table[C].Class = LeadByteClass::HighByte;
+  Table[0xFE].Class = LeadByteClass::UTF16BOM;
+  Table[0xFF].Class = LeadByteClass::UTF16BOM;
+  Table[0].Class = LeadByteClass::Nul;
+
+  set("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_",
+      LeadByteClass::Identifier);
+  set("0123456789", LeadByteClass::Number);
+  set("=-+*&|^~.>", LeadByteClass::Operator);
+  set("'\"", LeadByteClass::String);
+  set(" \t\v\f", LeadByteClass::Whitespace);
+  set("\n\r", LeadByteClass::Newline);
+  set("#", LeadByteClass::Hash);
+  set("/", LeadByteClass::Slash);
+  set("$", LeadByteClass::Dollar);
+  set("%", LeadByteClass::Percent);
+  set("!", LeadByteClass::Exclaim);
+  set("?", LeadByteClass::Question);
+  set("<", LeadByteClass::Less);
+  set("`", LeadByteClass::Backtick);
+
+  punctuator('@', tok::at_sign);
+  punctuator('{', tok::l_brace);
+  punctuator('[', tok::l_square);
+  punctuator('(', tok::l_paren);
+  punctuator('}', tok::r_brace);
+  punctuator(']', tok::r_square);
+  punctuator(')', tok::r_paren);
+  punctuator(',', tok::comma);
+  punctuator(';', tok::semi);
+  punctuator(':', tok::colon);
+  punctuator('\\', tok::backslash);
+  return Table;
+}
+
+constexpr std::array<LeadByte, 256> LeadBytes = buildLeadByteTable();
+
+} // end anonymous namespace
+
 //===----------------------------------------------------------------------===//
 // Main Lexer Loop
 //===----------------------------------------------------------------------===//
@@ -2859,8 +3174,24 @@ void Lexer::lexImpl() {
     return formToken(tok::eof, TokStart);
   }
 
-  switch (*CurPtr++) {
-    default: {
+  const LeadByte &Lead = LeadBytes[(unsigned char)*CurPtr++];
+  switch (Lead.Class) {
+    case LeadByteClass::Identifier:
+      return lexIdentifier();
+
+    case LeadByteClass::Number:
+      return lexNumber();
+
+    case LeadByteClass::Operator:
+      return lexOperatorIdentifier();
+
+    case LeadByteClass::Punctuator:
+      return formToken(Lead.Kind, TokStart);
+
+    case LeadByteClass::String:
+      return lexStringLiteral();
+
+    case LeadByteClass::HighByte: {
       char const *Tmp = CurPtr - 1;
       if (advanceIfValidStartOfIdentifier(Tmp, BufferEnd)) {
         return lexIdentifier();
@@ -2869,7 +3200,9 @@ void Lexer::lexImpl() {
       if (advanceIfValidStartOfOperator(Tmp, BufferEnd)) {
         return lexOperatorIdentifier();
       }
-
+      [[fallthrough]];
+    }
+    case LeadByteClass::Unknown: {
       bool ShouldTokenize = lexUnknown(/*EmitDiagnosticsIfToken=*/true);
       assert(
         ShouldTokenize &&
@@ -2878,26 +3211,19 @@ void Lexer::lexImpl() {
       return formToken(tok::unknown, TokStart);
     }
 
-    case '\n':
-    case '\r':
+    case LeadByteClass::Newline:
       llvm_unreachable("Newlines should be eaten by lexTrivia as LeadingTrivia");
 
-    case ' ':
-    case '\t':
-    case '\f':
-    case '\v':
+    case LeadByteClass::Whitespace:
       llvm_unreachable(
         "Whitespaces should be eaten by lexTrivia as LeadingTrivia");
 
-    case (char) -1:
-    case (char) -2:
-      // diagnose(CurPtr-1, diag::lex_utf16_bom_marker);
-      DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(CurPtr - 1),
-                                     "UTF-16 BOM marker"));
+    case LeadByteClass::UTF16BOM:
+      diagnose(CurPtr - 1, diag::lex_utf16_bom_marker);
       CurPtr = BufferEnd;
       return formToken(tok::unknown, TokStart);
 
-    case 0:
+    case LeadByteClass::Nul:
       switch (getNulCharacterKind(CurPtr - 1)) {
         case NulCharacterKind::CodeCompletion:
           while (advanceIfValidContinuationOfIdentifier(CurPtr, BufferEnd));
@@ -2914,21 +3240,9 @@ void Lexer::lexImpl() {
           llvm_unreachable(
             "Embedded nul should be eaten by lexTrivia as LeadingTrivia");
       }
+      llvm_unreachable("Unhandled NulCharacterKind");
 
-    case '@': return formToken(tok::at_sign, TokStart);
-    case '{': return formToken(tok::l_brace, TokStart);
-    case '[': return formToken(tok::l_square, TokStart);
-    case '(': return formToken(tok::l_paren, TokStart);
-    case '}': return formToken(tok::r_brace, TokStart);
-    case ']': return formToken(tok::r_square, TokStart);
-    case ')': return formToken(tok::r_paren, TokStart);
-
-    case ',': return formToken(tok::comma, TokStart);
-    case ';': return formToken(tok::semi, TokStart);
-    case ':': return formToken(tok::colon, TokStart);
-    case '\\': return formToken(tok::backslash, TokStart);
-
-    case '#': {
+    case LeadByteClass::Hash: {
       // Try lex a raw string literal.
       auto *Diags = getTokenDiags();
       if (unsigned CustomDelimiterLen = advanceIfCustomDelimiter(CurPtr, Diags)) {
@@ -2944,7 +3258,7 @@ void Lexer::lexImpl() {
       return lexHash();
     }
     // Operator characters.
-    case '/':
+    case LeadByteClass::Slash:
       if (CurPtr[0] == '/') {
         // "//"
         skipSlashSlashComment(true);
@@ -2965,8 +3279,8 @@ void Lexer::lexImpl() {
       }
 
       return lexOperatorIdentifier();
-    case '$': return lexDollarIdent();
-    case '%':
+    case LeadByteClass::Dollar: return lexDollarIdent();
+    case LeadByteClass::Percent:
       // Lex %[0-9a-zA-Z_]+ as a local SIL value
       if (InSILBody && isAsciiIdentifierContinue(CurPtr[0])) {
         do {
@@ -2976,7 +3290,7 @@ void Lexer::lexImpl() {
       }
       return lexOperatorIdentifier();
 
-    case '!':
+    case LeadByteClass::Exclaim:
       if (InSILBody) {
         return formToken(tok::sil_exclamation, TokStart);
       }
@@ -2985,106 +3299,23 @@ void Lexer::lexImpl() {
       }
       return lexOperatorIdentifier();
 
-    case '?':
+    case LeadByteClass::Question:
       if (isLeftBound(TokStart, ContentStart)) {
         return formToken(tok::question_postfix, TokStart);
       }
       return lexOperatorIdentifier();
 
-    case '<':
+    case LeadByteClass::Less:
       if (CurPtr[0] == '#') {
         return tryLexEditorPlaceholder();
       }
 
       return lexOperatorIdentifier();
-    case '>':
-      return lexOperatorIdentifier();
-
-    case '=':
-    case '-':
-    case '+':
-    case '*':
-    case '&':
-    case '|':
-    case '^':
-    case '~':
-    case '.':
-      return lexOperatorIdentifier();
-
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-      return lexNumber();
 
-    case '\'':
-    case '"':
-      return lexStringLiteral();
-
-    case 'A':
-    case 'B':
-    case 'C':
-    case 'D':
-    case 'E':
-    case 'F':
-    case 'G':
-    case 'H':
-    case 'I':
-    case 'J':
-    case 'K':
-    case 'L':
-    case 'M':
-    case 'N':
-    case 'O':
-    case 'P':
-    case 'Q':
-    case 'R':
-    case 'S':
-    case 'T':
-    case 'U':
-    case 'V':
-    case 'W':
-    case 'X':
-    case 'Y':
-    case 'Z':
-    case 'a':
-    case 'b':
-    case 'c':
-    case 'd':
-    case 'e':
-    case 'f':
-    case 'g':
-    case 'h':
-    case 'i':
-    case 'j':
-    case 'k':
-    case 'l':
-    case 'm':
-    case 'n':
-    case 'o':
-    case 'p':
-    case 'q':
-    case 'r':
-    case 's':
-    case 't':
-    case 'u':
-    case 'v':
-    case 'w':
-    case 'x':
-    case 'y':
-    case 'z':
-    case '_':
-      return lexIdentifier();
-
-    case '`':
+    case LeadByteClass::Backtick:
       return lexEscapedIdentifier();
   }
+  llvm_unreachable("Unhandled LeadByteClass");
 }
 
 Token Lexer::getTokenAtLocation(const SourceManager &SM, SourceLocation Loc,
@@ -3127,6 +3358,18 @@ void Lexer::lexTrivia() {
   CommentStart = nullptr;
 
 Restart:
+  // Indentation and blank lines come in runs; skip them a block at a time.
+  // The switch below still handles any whitespace the scanner stops short of.
+  if (*CurPtr == ' ' && !isWhitespace(CurPtr[1])) {
+    // A single separating space is by far the most common case.
+    ++CurPtr;
+  } else if (isWhitespace(*CurPtr)) {
+    bool SawNewline = false;
+    CurPtr = bytescan::skipWhitespace(CurPtr, BufferEnd, SawNewline);
+    if (SawNewline)
+      NextToken.setAtStartOfLine(true);
+  }
+
   const char *TriviaStart = CurPtr;
 
   switch (*CurPtr++) {
@@ -3169,9 +3412,7 @@ Restart:
         // Hashbang '#!/path/to/swift'.
         --CurPtr;
         if (!IsHashbangAllowed)
-          // diagnose(TriviaStart, diag::lex_hashbang_not_allowed);
-          DiagQueue->diagnose(Diagnostic(DiagnosticSeverity::Error, Lexer::getSourceLocation(TriviaStart),
-                                         "hashbang not allowed"));
+          diagnose(TriviaStart, diag::lex_hashbang_not_allowed);
         skipHashbang(/*EatNewline=*/false);
         goto Restart;
       }
@@ -3328,6 +3569,12 @@ static SourceLocation getLocForStartOfTokenInBuf(SourceManager &SM,
           HashbangMode::Allowed, CommentRetentionMode::None,
           BufferStart, BufferEnd);
 
+  // Record string literals as they are lexed, so that an offset inside an
+  // interpolation is found without scanning the literal again.
+  StringSegmentTable Segments(SM, BufferID);
+  L.setStringSegmentTable(&Segments);
+  L.resetToOffset(BufferStart);
+
   // Lex tokens until we find the token that contains the source location.
   Token Tok;
   do {
@@ -3344,19 +3591,17 @@ static SourceLocation getLocForStartOfTokenInBuf(SourceManager &SM,
       // Current token encompasses our source location.
 
       if (Tok.is(tok::string_literal)) {
-        llvm::SmallVector<Lexer::StringSegment, 4> Segments;
-        Lexer::getStringLiteralSegments(Tok, Segments, /*Diags=*/nullptr);
-        for (auto &Seg: Segments) {
-          unsigned SegOffs = SM.getLocOffsetInBuffer(Seg.Loc, BufferID);
-          unsigned SegEnd = SegOffs + Seg.Length;
-          if (SegOffs > Offset)
-            break;
-
-          // If the offset is inside an interpolated expr segment, re-lex.
-          if (Seg.Kind == Lexer::StringSegment::Expr && Offset < SegEnd)
-            return getLocForStartOfTokenInBuf(SM, BufferID, Offset,
-                                              /*BufferStart=*/SegOffs,
-                                              /*BufferEnd=*/SegEnd);
+        auto Interpolations = Segments.lookup(Tok);
+        assert(Interpolations && "string literal was not recorded");
+        auto Expr = std::find_if(Interpolations->begin(), Interpolations->end(),
+                                 [&](const StringSegmentTable::Interpolation &I) {
+                                   return I.Begin <= Offset && Offset < I.End;
+                                 });
+        // If the offset is inside an interpolated expr, continue lexing the
+        // expression. There is no need to come back out of it.
+        if (Expr != Interpolations->end()) {
+          (void)L.beginSubrange(Expr->Begin, Expr->End);
+          continue;
         }
       }
 
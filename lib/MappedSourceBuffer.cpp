@@ -0,0 +1,97 @@
+/**
+ * @file MappedSourceBuffer.cpp
+ * @brief Implementation of memory-mapped source file loading.
+ */
+
+#include "swift/Source/MappedSourceBuffer.h"
+
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SWIFT_MAPPED_SOURCE_BUFFER 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace swift;
+
+#if SWIFT_MAPPED_SOURCE_BUFFER
+
+namespace {
+  /// A file mapped by mapSourceFile(), unmapped when the buffer goes away.
+  class MappedSourceBuffer final : public llvm::MemoryBuffer {
+    void *Mapping;
+    size_t MappingSize;
+    std::string Identifier;
+
+  public:
+    MappedSourceBuffer(void *Mapping, size_t MappingSize, size_t FileSize,
+                       llvm::StringRef Identifier)
+      : Mapping(Mapping), MappingSize(MappingSize), Identifier(Identifier.str()) {
+      const char *Start = static_cast<const char *>(Mapping);
+      init(Start, Start + FileSize, /*RequiresNullTerminator=*/true);
+    }
+
+    ~MappedSourceBuffer() override { ::munmap(Mapping, MappingSize); }
+
+    llvm::StringRef getBufferIdentifier() const override { return Identifier; }
+
+    BufferKind getBufferKind() const override { return MemoryBuffer_MMap; }
+  };
+}
+
+/**
+ * Maps a source file read-only, with a NUL after its last byte.
+ *
+ * @param Path Path to the file
+ * @return The buffer, or null if the file could not be mapped
+ */
+std::unique_ptr<llvm::MemoryBuffer> swift::mapSourceFile(llvm::StringRef Path) {
+  const int FD = ::open(Path.str().c_str(), O_RDONLY | O_CLOEXEC);
+  if (FD < 0)
+    return nullptr;
+
+  struct stat Status;
+  if (::fstat(FD, &Status) != 0 || !S_ISREG(Status.st_mode) || Status.st_size == 0) {
+    ::close(FD);
+    return nullptr;
+  }
+  const size_t FileSize = Status.st_size;
+  const size_t PageSize = ::sysconf(_SC_PAGESIZE);
+
+  void *Mapping = MAP_FAILED;
+  size_t MappingSize = FileSize;
+  if (FileSize % PageSize != 0) {
+    // The rest of the last page reads as zeros and holds the NUL.
+    Mapping = ::mmap(nullptr, FileSize, PROT_READ, MAP_PRIVATE, FD, 0);
+  } else {
+    // The file ends on a page boundary. Reserve one more page of zeros and
+    // map the file over the rest of the reservation.
+    MappingSize = FileSize + PageSize;
+    Mapping = ::mmap(nullptr, MappingSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Mapping != MAP_FAILED &&
+        ::mmap(Mapping, FileSize, PROT_READ, MAP_PRIVATE | MAP_FIXED, FD, 0) == MAP_FAILED) {
+      ::munmap(Mapping, MappingSize);
+      Mapping = MAP_FAILED;
+    }
+  }
+  ::close(FD);
+  if (Mapping == MAP_FAILED)
+    return nullptr;
+
+  // The lexer reads the file front to back, starting right away.
+  ::madvise(Mapping, FileSize, MADV_SEQUENTIAL);
+  ::madvise(Mapping, FileSize, MADV_WILLNEED);
+
+  return std::make_unique<MappedSourceBuffer>(Mapping, MappingSize, FileSize, Path);
+}
+
+#else
+
+std::unique_ptr<llvm::MemoryBuffer> swift::mapSourceFile(llvm::StringRef) {
+  return nullptr;
+}
+
+#endif // SWIFT_MAPPED_SOURCE_BUFFER
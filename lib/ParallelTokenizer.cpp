@@ -0,0 +1,146 @@
+#include "swift/Lexer/TokenStream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace swift;
+
+namespace {
+  /// Chunks smaller than this are not worth a thread.
+  constexpr unsigned MinChunkSize = 64 * 1024;
+
+  /// The tokens of one guessed chunk of the buffer.
+  struct Chunk {
+    unsigned Offset;
+    unsigned EndOffset;
+    std::vector<Token> Tokens;
+    /// The first token at or after EndOffset, as the chunk's lexer saw it.
+    Token Stop;
+  };
+}
+
+static void lexChunk(const LangOptions &LangOpts, const SourceManager &SM,
+                     unsigned BufferID, TokenizeOptions Options,
+                     Chunk &C) {
+  Options.Offset = C.Offset;
+  Options.EndOffset = C.EndOffset;
+  C.Tokens.clear();
+  TokenStream Stream(LangOpts, SM, BufferID, Options);
+  Token Tok;
+  while (Stream.next(Tok))
+    C.Tokens.push_back(Tok);
+  C.Stop = Stream.getStopToken();
+}
+
+/// Whether lexing from the start of a chunk produced the same token as the
+/// lexer that ran into it from the previous chunk. From a matching token on,
+/// both lexers are in the same state and produce the same tokens. The kind
+/// and length have to be compared too, because the lexer looks at the
+/// previous token: after a '.', '0.1' is lexed as '0' '.' '1', not a float.
+static bool isSameToken(const Token &A, const Token &B) {
+  return A.getRawText().begin() == B.getRawText().begin() &&
+         A.getKind() == B.getKind() && A.getLength() == B.getLength() &&
+         A.isAtStartOfLine() == B.isAtStartOfLine() &&
+         A.getCommentLength() == B.getCommentLength();
+}
+
+std::vector<Token> swift::tokenizeParallel(const LangOptions &LangOpts,
+                                           const SourceManager &SM,
+                                           unsigned BufferID, unsigned Threads,
+                                           bool KeepComments,
+                                           bool TokenizeInterpolatedString) {
+  TokenizeOptions Options;
+  Options.KeepComments = KeepComments;
+  Options.TokenizeInterpolatedString = TokenizeInterpolatedString;
+
+  llvm::StringRef Text = SM.getBufferContent(BufferID);
+  unsigned BufferSize = Text.size();
+  if (Threads == 0)
+    Threads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned NumChunks = std::min(Threads, BufferSize / MinChunkSize);
+  if (NumChunks <= 1) {
+    std::vector<Token> Tokens;
+    for (const Token &Tok : TokenStream(LangOpts, SM, BufferID, Options))
+      Tokens.push_back(Tok);
+    return Tokens;
+  }
+
+  // Guess chunk boundaries at newlines, so that the first token of a chunk
+  // is usually at the start of a line. A chunk starts at the newline itself
+  // so that its lexer sees it.
+  std::vector<Chunk> Chunks;
+  unsigned Begin = 0;
+  for (unsigned I = 1; I <= NumChunks && Begin < BufferSize; ++I) {
+    unsigned End = BufferSize;
+    if (I != NumChunks) {
+      size_t Newline = Text.find('\n', uint64_t(BufferSize) * I / NumChunks);
+      if (Newline != llvm::StringRef::npos)
+        End = Newline;
+    }
+    if (End <= Begin)
+      continue;
+    Chunks.push_back({Begin, End, {}, Token()});
+    Begin = End;
+  }
+
+  std::atomic<size_t> NextChunk{0};
+  auto Worker = [&] {
+    for (size_t I = NextChunk++; I < Chunks.size(); I = NextChunk++)
+      lexChunk(LangOpts, SM, BufferID, Options, Chunks[I]);
+  };
+  std::vector<std::thread> Workers;
+  for (unsigned I = 1; I < std::min<size_t>(Threads, Chunks.size()); ++I)
+    Workers.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Workers)
+    T.join();
+
+  // Stitch the chunks together in order. The first chunk starts at the start
+  // of the buffer, so it is always right; every later chunk is checked
+  // against where the lexer of the chunks before it stopped.
+  std::vector<Token> Tokens;
+  size_t Total = 0;
+  for (const Chunk &C : Chunks)
+    Total += C.Tokens.size();
+  Tokens.reserve(Total);
+
+  Token Stop = Chunks.front().Stop;
+  Tokens.insert(Tokens.end(), Chunks.front().Tokens.begin(),
+                Chunks.front().Tokens.end());
+  const char *BufferStart = Text.data();
+  for (size_t I = 1; I != Chunks.size(); ++I) {
+    Chunk &C = Chunks[I];
+    // A token that started before the chunk ran through all of it.
+    if (Stop.getRawText().begin() >= BufferStart + C.EndOffset)
+      continue;
+
+    const Token &First = C.Tokens.empty() ? C.Stop : C.Tokens.front();
+    if (!isSameToken(First, Stop)) {
+      // The guessed boundary fell inside a token or comment, or the chunk's
+      // first token depends on the one before it; lex the chunk again
+      // starting at the last token, so that the lexer sees it, and drop that
+      // token. The pieces of a split string literal are not tokens the lexer
+      // can start at, and nothing depends on a string literal, so start
+      // after those.
+      bool RelexLast = !Tokens.empty() && Tokens.back().isNot(tok::string_literal);
+      if (Tokens.empty())
+        C.Offset = 0;
+      else if (RelexLast)
+        C.Offset = Tokens.back().getRawText().begin() - BufferStart;
+      else
+        C.Offset = Tokens.back().getRawText().end() - BufferStart;
+      lexChunk(LangOpts, SM, BufferID, Options, C);
+      if (RelexLast) {
+        assert(!C.Tokens.empty() &&
+               C.Tokens.front().getRawText() == Tokens.back().getRawText() &&
+               "last token lexed differently");
+        C.Tokens.erase(C.Tokens.begin());
+      }
+    }
+    Tokens.insert(Tokens.end(), C.Tokens.begin(), C.Tokens.end());
+    Stop = C.Stop;
+  }
+  return Tokens;
+}
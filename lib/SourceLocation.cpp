@@ -0,0 +1,179 @@
+/**
+ * @file SourceLocation.cpp
+ * @brief Implementation of the location space behind compact source locations.
+ *
+ * Only built into anything when SWIFT_COMPACT_SOURCE_LOCATIONS is set;
+ * otherwise a SourceLocation is a pointer and needs no lookup.
+ */
+
+#include "swift/Source/SourceLocation.h"
+
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+using namespace swift;
+
+namespace {
+  /// A registered buffer and the offset of its first byte.
+  struct Range {
+    const char *Start;
+    const char *End;
+    uint32_t Base;
+  };
+
+  /// The registered ranges, sorted by address and by offset.
+  struct Space {
+    std::shared_mutex Lock;
+    std::vector<Range> ByAddress;
+    /// Fresh offsets are handed out in increasing order, so ranges are
+    /// appended here unless they reuse a gap.
+    std::vector<Range> ByOffset;
+    /// The offset of the next range; offset 0 is the invalid location.
+    uint64_t NextBase = 1;
+    /// Bumped whenever a range is removed, so that threads stop using a
+    /// cached range whose buffer may have been freed.
+    std::atomic<uint64_t> Generation{0};
+  };
+
+  /// The range this thread last looked up, usable while the space is still
+  /// at the same generation.
+  struct CachedRange {
+    Range Cached{nullptr, nullptr, 0};
+    uint64_t Generation = ~uint64_t(0);
+  };
+
+  thread_local CachedRange LastRange;
+}
+
+/**
+ * Returns the process-wide location space. It is never destroyed, so that
+ * SourceManagers with static storage can still release their ranges.
+ */
+static Space &getSpace() {
+  static Space *const TheSpace = new Space;
+  return *TheSpace;
+}
+
+/**
+ * Assigns offsets to the bytes of a buffer, and one more to its end.
+ *
+ * @param Start First byte of the buffer
+ * @param End End of the buffer
+ */
+void SourceLocationSpace::addRange(const char *Start, const char *End) {
+  Space &S = getSpace();
+  std::unique_lock<std::shared_mutex> Guard(S.Lock);
+  const uint64_t Size = uint64_t(End - Start) + 1;
+  auto ByOffset = S.ByOffset.end();
+  uint64_t Base = S.NextBase;
+  if (Base + Size > uint64_t(UINT32_MAX) + 1) {
+    // Fresh offsets have run out; take the first gap removed ranges left
+    // that is large enough, counting the one after the last range.
+    uint64_t GapStart = 1;
+    for (ByOffset = S.ByOffset.begin(); ByOffset != S.ByOffset.end(); ++ByOffset) {
+      if (ByOffset->Base - GapStart >= Size)
+        break;
+      GapStart = uint64_t(ByOffset->Base) + (ByOffset->End - ByOffset->Start) + 1;
+    }
+    if (GapStart + Size > uint64_t(UINT32_MAX) + 1)
+      llvm::report_fatal_error("out of 32-bit source location space");
+    Base = GapStart;
+    if (ByOffset == S.ByOffset.end())
+      S.NextBase = Base + Size;
+  } else {
+    S.NextBase += Size;
+  }
+
+  const Range Added{Start, End, uint32_t(Base)};
+  S.ByAddress.insert(std::upper_bound(S.ByAddress.begin(), S.ByAddress.end(), Added,
+                                      [](const Range &LHS, const Range &RHS) {
+                                        return LHS.Start < RHS.Start;
+                                      }),
+                     Added);
+  S.ByOffset.insert(ByOffset, Added);
+}
+
+/**
+ * Forgets the range of a buffer that is about to be freed. Its offsets are
+ * only handed out again once no fresh ones are left.
+ *
+ * @param Start First byte of the buffer
+ */
+void SourceLocationSpace::removeRange(const char *Start) {
+  Space &S = getSpace();
+  std::unique_lock<std::shared_mutex> Guard(S.Lock);
+  const auto ByAddress = std::lower_bound(S.ByAddress.begin(), S.ByAddress.end(), Start,
+                                          [](const Range &R, const char *P) {
+                                            return R.Start < P;
+                                          });
+  if (ByAddress == S.ByAddress.end() || ByAddress->Start != Start)
+    return;
+  const uint32_t Base = ByAddress->Base;
+  S.ByAddress.erase(ByAddress);
+  S.ByOffset.erase(std::lower_bound(S.ByOffset.begin(), S.ByOffset.end(), Base,
+                                    [](const Range &R, uint32_t Offset) {
+                                      return R.Base < Offset;
+                                    }));
+  S.Generation.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Returns the offset of a byte in a registered buffer.
+ *
+ * @param Ptr Pointer to the byte
+ * @return The offset, or 0 if no registered buffer contains Ptr
+ */
+uint32_t SourceLocationSpace::getOffset(const char *Ptr) {
+  Space &S = getSpace();
+  const uint64_t Generation = S.Generation.load(std::memory_order_acquire);
+  const Range &Cached = LastRange.Cached;
+  if (LastRange.Generation == Generation && Cached.Start <= Ptr && Ptr <= Cached.End)
+    return Cached.Base + uint32_t(Ptr - Cached.Start);
+
+  std::shared_lock<std::shared_mutex> Guard(S.Lock);
+  const auto Next = std::upper_bound(S.ByAddress.begin(), S.ByAddress.end(), Ptr,
+                                     [](const char *P, const Range &R) {
+                                       return P < R.Start;
+                                     });
+  if (Next == S.ByAddress.begin() || Ptr > std::prev(Next)->End)
+    return 0;
+  LastRange = {*std::prev(Next), Generation};
+  return std::prev(Next)->Base + uint32_t(Ptr - std::prev(Next)->Start);
+}
+
+/**
+ * Returns the byte at an offset.
+ *
+ * @param Offset Offset of the byte
+ * @return Pointer to the byte, or nullptr if no registered buffer has Offset
+ */
+const char *SourceLocationSpace::getPointer(uint32_t Offset) {
+  Space &S = getSpace();
+  const uint64_t Generation = S.Generation.load(std::memory_order_acquire);
+  const Range &Cached = LastRange.Cached;
+  if (LastRange.Generation == Generation && Cached.Base <= Offset &&
+      Offset - Cached.Base <= uint32_t(Cached.End - Cached.Start))
+    return Cached.Start + (Offset - Cached.Base);
+
+  std::shared_lock<std::shared_mutex> Guard(S.Lock);
+  const auto Next = std::upper_bound(S.ByOffset.begin(), S.ByOffset.end(), Offset,
+                                     [](uint32_t O, const Range &R) {
+                                       return O < R.Base;
+                                     });
+  if (Next == S.ByOffset.begin())
+    return nullptr;
+  const Range &Found = *std::prev(Next);
+  if (Offset - Found.Base > uint32_t(Found.End - Found.Start))
+    return nullptr;
+  LastRange = {Found, Generation};
+  return Found.Start + (Offset - Found.Base);
+}
+
+#endif // SWIFT_COMPACT_SOURCE_LOCATIONS
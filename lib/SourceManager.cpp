@@ -7,11 +7,107 @@
  */
 
 #include "swift/Source/SourceManager.h"
+#include "swift/Source/ByteScan.h"
+#include "swift/Source/MappedSourceBuffer.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
 
+#include <algorithm>
+
 using namespace swift;
 
+/**
+ * Returns the length of the valid UTF-8 sequence starting at Ptr, or 0 if the
+ * bytes there are not one. Overlong encodings, surrogates and code points
+ * above U+10FFFF are all rejected.
+ *
+ * @param Ptr Start of the sequence; must point at a byte >= 0x80
+ * @param End End of the buffer
+ * @return Length of the sequence in bytes, or 0 if it is invalid
+ */
+static unsigned getValidUTF8SequenceLength(const unsigned char *Ptr, const unsigned char *End) {
+  auto isContinuation = [](unsigned char C) { return (C & 0xC0) == 0x80; };
+  const ptrdiff_t Available = End - Ptr;
+  const unsigned char Lead = Ptr[0];
+
+  if (Lead >= 0xC2 && Lead <= 0xDF)
+    return Available >= 2 && isContinuation(Ptr[1]) ? 2 : 0;
+
+  if (Lead >= 0xE0 && Lead <= 0xEF) {
+    if (Available < 3 || !isContinuation(Ptr[1]) || !isContinuation(Ptr[2]))
+      return 0;
+    // Reject overlong encodings and UTF-16 surrogates.
+    if ((Lead == 0xE0 && Ptr[1] < 0xA0) || (Lead == 0xED && Ptr[1] >= 0xA0))
+      return 0;
+    return 3;
+  }
+
+  if (Lead >= 0xF0 && Lead <= 0xF4) {
+    if (Available < 4 || !isContinuation(Ptr[1]) || !isContinuation(Ptr[2]) || !isContinuation(Ptr[3]))
+      return 0;
+    // Reject overlong encodings and code points above U+10FFFF.
+    if ((Lead == 0xF0 && Ptr[1] < 0x90) || (Lead == 0xF4 && Ptr[1] >= 0x90))
+      return 0;
+    return 4;
+  }
+
+  return 0;
+}
+
+/**
+ * Classifies the contents of a buffer, recording every run of bytes that is
+ * not part of a valid UTF-8 sequence. ASCII text is skipped with the vector
+ * scanner, so pure-ASCII buffers cost a single fast pass.
+ *
+ * @param Text Contents of the buffer
+ * @return The encoding information for the buffer
+ */
+static BufferTextInfo computeBufferTextInfo(llvm::StringRef Text) {
+  BufferTextInfo Info;
+  const char *Start = Text.begin();
+  const char *End = Text.end();
+
+  for (const char *Ptr = bytescan::findNonASCII(Start, End); Ptr != End;
+       Ptr = bytescan::findNonASCII(Ptr, End)) {
+    if (Info.Encoding == BufferTextInfo::EncodingKind::ASCII)
+      Info.Encoding = BufferTextInfo::EncodingKind::ValidUTF8;
+
+    if (unsigned Length = getValidUTF8SequenceLength(
+            reinterpret_cast<const unsigned char *>(Ptr), reinterpret_cast<const unsigned char *>(End))) {
+      Ptr += Length;
+      continue;
+    }
+
+    // Extend the previous invalid run if this byte directly follows it.
+    const auto Offset = static_cast<unsigned>(Ptr - Start);
+    if (!Info.InvalidRanges.empty() && Info.InvalidRanges.back().second == Offset)
+      ++Info.InvalidRanges.back().second;
+    else
+      Info.InvalidRanges.emplace_back(Offset, Offset + 1);
+    ++Ptr;
+  }
+
+  if (!Info.InvalidRanges.empty())
+    Info.Encoding = BufferTextInfo::EncodingKind::InvalidUTF8;
+  return Info;
+}
+
+/**
+ * Returns true if no invalid byte lies in the given range of the buffer.
+ *
+ * @param Begin Start offset of the range
+ * @param End End offset of the range
+ * @return True if the range is known to be valid UTF-8
+ */
+bool BufferTextInfo::isRangeValidUTF8(unsigned Begin, unsigned End) const {
+  // Find the first invalid run that ends after Begin.
+  const auto It = std::upper_bound(InvalidRanges.begin(), InvalidRanges.end(), Begin,
+                                   [](unsigned Offset, const std::pair<unsigned, unsigned> &Range) {
+                                     return Offset < Range.second;
+                                   });
+  return It == InvalidRanges.end() || It->first >= End;
+}
+
 /**
  * Default constructor for SourceManager.
  * Initializes the file system to use the real file system.
@@ -21,23 +117,76 @@ SourceManager::SourceManager() {
   FileSystem = llvm::vfs::getRealFileSystem();
 }
 
+/**
+ * Destructor for SourceManager. With compact source locations, frees the
+ * location ranges of the buffers before the buffers themselves go away.
+ */
+SourceManager::~SourceManager() {
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+  for (const std::unique_ptr<llvm::MemoryBuffer> &Buffer : Buffers)
+    if (Buffer)
+      SourceLocationSpace::removeRange(Buffer->getBufferStart());
+#endif
+}
+
+/**
+ * Returns the opaque value of a location, by which locations in the same
+ * buffer are ordered.
+ */
+static uintptr_t getOpaqueValue(SourceLocation Loc) {
+  return reinterpret_cast<uintptr_t>(Loc.getOpaquePointerValue());
+}
+
 /**
  * Adds a new source buffer to the SourceManager.
  * 
  * @param Buffer The memory buffer to add
+ * @param IsNullTerminated Whether the buffer has a NUL at getBufferEnd()
  * @return The buffer ID for the added buffer
  */
-unsigned SourceManager::addNewSourceBuffer(std::unique_ptr<llvm::MemoryBuffer> Buffer) {
-  const llvm::StringRef BufferIdentifier = Buffer->getBufferIdentifier();
-
+unsigned SourceManager::addNewSourceBuffer(std::unique_ptr<llvm::MemoryBuffer> Buffer,
+                                           bool IsNullTerminated) {
   // Check if we already have this buffer. If so, just return the ID.
-  auto ExistingBuffer = getIDForBufferIdentifier(BufferIdentifier);
+  auto ExistingBuffer = getIDForBufferIdentifier(Buffer->getBufferIdentifier());
   if (ExistingBuffer.has_value()) {
     return *ExistingBuffer;
   }
 
+  // The lexer relies on a NUL just past the end of the buffer. File loads and
+  // getMemBufferCopy already provide one; copy anything else once, here, so
+  // every Lexer can work on the registered bytes directly. Checking the byte
+  // itself would read past the end of a buffer that is not terminated.
+  if (!IsNullTerminated) {
+    Buffer = llvm::MemoryBuffer::getMemBufferCopy(Buffer->getBuffer(),
+                                                  Buffer->getBufferIdentifier());
+  }
+  const llvm::StringRef BufferIdentifier = Buffer->getBufferIdentifier();
+
   // Add the buffer to LLVM's SourceMgr.
-  unsigned BufferID = LLVMSourceMgr.AddNewSourceBuffer(std::move(Buffer), llvm::SMLoc());
+  BufferTextInfo Info = computeBufferTextInfo(Buffer->getBuffer());
+  Buffers.push_back(std::move(Buffer));
+  const unsigned BufferID = Buffers.size();
+  BufferInfos.push_back(std::move(Info));
+  LineTables.push_back(std::make_unique<LineTable>());
+
+  const llvm::MemoryBuffer *Added = getMemoryBuffer(BufferID);
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+  SourceLocationSpace::addRange(Added->getBufferStart(), Added->getBufferEnd());
+#endif
+  const SourceLocation Start(llvm::SMLoc::getFromPointer(Added->getBufferStart()));
+  BufferStarts.push_back(Start);
+
+  // Buffers are usually allocated at increasing addresses, and compact
+  // locations are assigned in increasing order, so this rarely moves more
+  // than a few entries.
+  const BufferRange Range{getOpaqueValue(Start),
+                          getOpaqueValue(Start.getAdvancedLoc(Added->getBufferSize())), BufferID};
+  BufferRanges.insert(std::upper_bound(BufferRanges.begin(), BufferRanges.end(), Range,
+                                       [](const BufferRange &LHS, const BufferRange &RHS) {
+                                         return LHS.Start < RHS.Start;
+                                       }),
+                      Range);
+  LastBufferRange.store(0, std::memory_order_relaxed);
 
   // Remember the buffer identifier.
   BufIdentIDMap[BufferIdentifier] = BufferID;
@@ -50,22 +199,42 @@ unsigned SourceManager::addNewSourceBuffer(std::unique_ptr<llvm::MemoryBuffer> B
  * If the buffer is not already added, it gets added.
  * 
  * @param FilePath Path to the file
+ * @param Error Set to why the file could not be read, if not null
  * @return Buffer ID if successful, ~0U otherwise
  */
-unsigned SourceManager::getOrOpenBuffer(llvm::StringRef FilePath) {
+unsigned SourceManager::getOrOpenBuffer(llvm::StringRef FilePath, std::error_code *Error) {
   // Check if we already have this buffer.
   if (const auto ExistingBuffer = getIDForBufferIdentifier(FilePath); ExistingBuffer.has_value()) {
     return *ExistingBuffer;
   }
 
   // Otherwise, create and add the buffer.
-  auto FileOrErr = FileSystem->getBufferForFile(FilePath);
-  if (!FileOrErr) {
-    // Return an invalid BufferID on error.
-    return ~0U;
+  // mapSourceFile() opens the path itself, so it would bypass any other
+  // file system.
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  if (LoadMode == FileLoadMode::Mapped && FileSystem == llvm::vfs::getRealFileSystem())
+    Buffer = mapSourceFile(FilePath);
+  if (!Buffer) {
+    auto FileOrErr = FileSystem->getBufferForFile(FilePath, /*FileSize=*/-1,
+                                                  /*RequiresNullTerminator=*/true);
+    if (!FileOrErr) {
+      // Return an invalid BufferID on error.
+      if (Error)
+        *Error = FileOrErr.getError();
+      return ~0U;
+    }
+    Buffer = std::move(*FileOrErr);
   }
 
-  return addNewSourceBuffer(std::move(*FileOrErr));
+  if (Buffer->getBufferKind() == llvm::MemoryBuffer::MemoryBuffer_MMap) {
+    ++LoadStats.FilesMapped;
+    LoadStats.BytesMapped += Buffer->getBufferSize();
+  } else {
+    ++LoadStats.FilesCopied;
+    LoadStats.BytesCopied += Buffer->getBufferSize();
+  }
+  // Both loads require a NUL terminator.
+  return addNewSourceBuffer(std::move(Buffer), /*IsNullTerminated=*/true);
 }
 
 /**
@@ -88,7 +257,8 @@ std::optional<unsigned> SourceManager::getIDForBufferIdentifier(llvm::StringRef
  * @return Pointer to the memory buffer
  */
 const llvm::MemoryBuffer *SourceManager::getMemoryBuffer(unsigned BufferID) const {
-  return LLVMSourceMgr.getMemoryBuffer(BufferID);
+  assert(BufferID - 1 < Buffers.size() && Buffers[BufferID - 1] && "invalid or removed buffer");
+  return Buffers[BufferID - 1].get();
 }
 
 /**
@@ -98,8 +268,7 @@ const llvm::MemoryBuffer *SourceManager::getMemoryBuffer(unsigned BufferID) cons
  * @return Source location for the buffer's start
  */
 SourceLocation SourceManager::getLocForBufferStart(unsigned BufferID) const {
-  return SourceLocation(llvm::SMLoc::getFromPointer(
-    LLVMSourceMgr.getMemoryBuffer(BufferID)->getBufferStart()));
+  return BufferStarts[BufferID - 1];
 }
 
 /**
@@ -109,20 +278,30 @@ SourceLocation SourceManager::getLocForBufferStart(unsigned BufferID) const {
  * @return ID of the buffer containing the location, or ~0U if not found
  */
 unsigned SourceManager::findBufferContainingLoc(SourceLocation Loc) const {
-  if (!Loc.isValid())
+  if (!Loc.isValid() || BufferRanges.empty())
     return ~0U;
+  const uintptr_t Ptr = getOpaqueValue(Loc);
 
-  // Search through all the buffers to find which one contains this location.
-  for (unsigned i = 1, e = LLVMSourceMgr.getNumBuffers() + 1; i != e; ++i) {
-    if (auto *Buffer = LLVMSourceMgr.getMemoryBuffer(i); Buffer->getBufferStart() <= Loc.Value.getPointer() &&
-                                                         Loc.Value.getPointer() <= Buffer->getBufferEnd()) {
-      return i;
-    }
+  // Most lookups are in the same buffer as the one before.
+  const size_t Last = LastBufferRange.load(std::memory_order_relaxed);
+  if (Last < BufferRanges.size() && BufferRanges[Last].Start <= Ptr &&
+      Ptr <= BufferRanges[Last].End) {
+    return BufferRanges[Last].BufferID;
+  }
+
+  // Otherwise, the buffer is the last one starting at or before the location.
+  const auto Next = std::upper_bound(BufferRanges.begin(), BufferRanges.end(), Ptr,
+                                     [](uintptr_t P, const BufferRange &Range) {
+                                       return P < Range.Start;
+                                     });
+  if (Next == BufferRanges.begin() || Ptr > std::prev(Next)->End) {
+    // If no buffer contains this location, return an invalid buffer ID
+    // instead of triggering an assertion failure
+    return ~0U;
   }
 
-  // If no buffer contains this location, return an invalid buffer ID
-  // instead of triggering an assertion failure
-  return ~0U;
+  LastBufferRange.store(std::prev(Next) - BufferRanges.begin(), std::memory_order_relaxed);
+  return std::prev(Next)->BufferID;
 }
 
 /**
@@ -137,11 +316,11 @@ unsigned SourceManager::getLocOffsetInBuffer(SourceLocation Loc, unsigned Buffer
   const auto BufferStart = getLocForBufferStart(BufferID);
 
   // Check that the location is actually within the specified buffer.
-  assert(BufferStart.Value.getPointer() <= Loc.Value.getPointer() &&
+  assert(Loc.getOffsetFrom(BufferStart) >= 0 &&
     "Location is not from the specified buffer");
 
   // Return the difference.
-  return Loc.Value.getPointer() - BufferStart.Value.getPointer();
+  return Loc.getOffsetFrom(BufferStart);
 }
 
 /**
@@ -159,7 +338,7 @@ unsigned SourceManager::getByteDistance(SourceLocation Start, SourceLocation End
 
   // If the buffers are the same, just do the math.
   if (Buffer1 == Buffer2) {
-    return End.Value.getPointer() - Start.Value.getPointer();
+    return End.getOffsetFrom(Start);
   }
 
   // Otherwise, the locations are in different buffers.
@@ -168,22 +347,116 @@ unsigned SourceManager::getByteDistance(SourceLocation Start, SourceLocation End
   unsigned Distance = 0;
 
   // Add the distance from Start to the end of its buffer.
-  auto *Buffer1Data = getMemoryBuffer(Buffer1);
-  Distance += (Buffer1Data->getBufferEnd() - Start.Value.getPointer());
+  Distance += getMemoryBuffer(Buffer1)->getBufferSize() - getLocOffsetInBuffer(Start, Buffer1);
 
   // Add the distances of any intermediate buffers.
   for (unsigned i = Buffer1 + 1; i != Buffer2; ++i) {
-    auto *BufferData = getMemoryBuffer(i);
-    Distance += BufferData->getBufferSize();
+    if (const auto &BufferData = Buffers[i - 1])
+      Distance += BufferData->getBufferSize();
   }
 
   // Add the distance from the start of Buffer2 to End.
-  Distance += (End.Value.getPointer() -
-               getMemoryBuffer(Buffer2)->getBufferStart());
+  Distance += getLocOffsetInBuffer(End, Buffer2);
 
   return Distance;
 }
 
+/**
+ * Returns the line starts of a buffer. The table is built by the first
+ * caller; concurrent callers wait for it.
+ *
+ * @param BufferID ID of the buffer
+ * @return Offsets of the start of every line, beginning with 0
+ */
+const std::vector<uint32_t> &SourceManager::getLineStarts(unsigned BufferID) const {
+  LineTable &Table = *LineTables[BufferID - 1];
+  std::call_once(Table.Built, [&] {
+    const llvm::StringRef Text = getBufferContent(BufferID);
+    // Reserve for typical line lengths to avoid most regrowth.
+    Table.LineStarts.reserve(Text.size() / 32 + 1);
+    Table.LineStarts.push_back(0);
+    bytescan::appendLineStarts(Text.begin(), Text.end(), Table.LineStarts);
+  });
+  return Table.LineStarts;
+}
+
+/**
+ * Returns the line and column of a location in any buffer.
+ *
+ * @param Loc Source location to look up
+ * @return 1-based line and column
+ */
+std::pair<unsigned, unsigned> SourceManager::getLineAndColumn(SourceLocation Loc) const {
+  const unsigned BufferID = findBufferContainingLoc(Loc);
+  assert(BufferID != ~0U && "location is not in any buffer");
+  return getLineAndColumnInBuffer(Loc, BufferID);
+}
+
+/**
+ * Returns the line and column of a location by binary search in the line
+ * table of its buffer.
+ *
+ * @param Loc Source location to look up
+ * @param BufferID ID of the buffer containing the location
+ * @return 1-based line and column
+ */
+std::pair<unsigned, unsigned> SourceManager::getLineAndColumnInBuffer(SourceLocation Loc,
+                                                                      unsigned BufferID) const {
+  const unsigned Offset = getLocOffsetInBuffer(Loc, BufferID);
+  const std::vector<uint32_t> &LineStarts = getLineStarts(BufferID);
+
+  // The line is the last one starting at or before the offset.
+  const auto Next = std::upper_bound(LineStarts.begin(), LineStarts.end(), Offset);
+  const unsigned Line = Next - LineStarts.begin();
+  return {Line, Offset - LineStarts[Line - 1] + 1};
+}
+
+/**
+ * Returns the location of a line and column, or an invalid location if
+ * they are out of range.
+ *
+ * @param BufferID ID of the buffer
+ * @param Line 1-based line number
+ * @param Col 1-based column
+ * @return Source location of the line and column
+ */
+SourceLocation SourceManager::getLocForLineCol(unsigned BufferID, unsigned Line, unsigned Col) const {
+  const std::vector<uint32_t> &LineStarts = getLineStarts(BufferID);
+  if (Line == 0 || Line > LineStarts.size() || Col == 0)
+    return SourceLocation();
+
+  // A line ends at its '\n', or at the end of the buffer for the last one.
+  const unsigned LineStart = LineStarts[Line - 1];
+  const unsigned LineEnd = Line < LineStarts.size()
+                             ? LineStarts[Line] - 1
+                             : getBufferContent(BufferID).size();
+  if (Col - 1 > LineEnd - LineStart)
+    return SourceLocation();
+
+  return getLocForOffset(BufferID, LineStart + Col - 1);
+}
+
+/**
+ * Returns the text of a line, dropping the '\n' that ends it and a '\r'
+ * before that.
+ *
+ * @param BufferID ID of the buffer
+ * @param Line 1-based line number
+ * @return The text of the line
+ */
+llvm::StringRef SourceManager::getLineText(unsigned BufferID, unsigned Line) const {
+  const std::vector<uint32_t> &LineStarts = getLineStarts(BufferID);
+  if (Line == 0 || Line > LineStarts.size())
+    return {};
+
+  const llvm::StringRef Text = getBufferContent(BufferID);
+  const unsigned LineStart = LineStarts[Line - 1];
+  const unsigned LineEnd = Line < LineStarts.size() ? LineStarts[Line] - 1 : Text.size();
+  llvm::StringRef LineText = Text.slice(LineStart, LineEnd);
+  LineText.consume_back("\r");
+  return LineText;
+}
+
 /**
  * Returns a buffer identifier suitable for display to the user.
  * 
@@ -214,8 +487,7 @@ bool SourceManager::containsLoc(SourceRange Range, SourceLocation Loc) const {
     return false;
 
   // Check if the location is within the range.
-  return Range.Start.Value.getPointer() <= Loc.Value.getPointer() &&
-         Loc.Value.getPointer() <= Range.End.Value.getPointer();
+  return Loc.getOffsetFrom(Range.Start) >= 0 && Range.End.getOffsetFrom(Loc) >= 0;
 }
 
 /**
@@ -231,17 +503,11 @@ llvm::StringRef SourceManager::extractText(CharSourceRange Range) const {
   if (BufferID == ~0U)
     return {};
 
+  // Range.getEnd() is the last byte of the range, not one past it, so the
+  // length is the only reliable way to find the end.
   const unsigned StartOffset = getLocOffsetInBuffer(Range.getStart(), BufferID);
-  unsigned EndOffset;
-
-  if (Range.getEnd().isValid()) {
-    EndOffset = getLocOffsetInBuffer(Range.getEnd(), BufferID);
-  } else {
-    EndOffset = StartOffset + Range.getByteLength();
-  }
-
   const llvm::StringRef Buffer = getBufferContent(BufferID);
-  return Buffer.substr(StartOffset, EndOffset - StartOffset);
+  return Buffer.substr(StartOffset, Range.getByteLength());
 }
 
 /**
@@ -265,7 +531,41 @@ unsigned SourceManager::addMemBufferCopy(const llvm::MemoryBuffer *Buffer) {
 
 unsigned SourceManager::addMemBufferCopy(const llvm::StringRef InputData,
                                          const llvm::StringRef BufIdentifier) {
+  // getMemBufferCopy always allocates room for a trailing NUL.
   auto Buffer = std::unique_ptr<llvm::MemoryBuffer>(
       llvm::MemoryBuffer::getMemBufferCopy(InputData, BufIdentifier));
-  return addNewSourceBuffer(std::move(Buffer));
-}
\ No newline at end of file
+  return addNewSourceBuffer(std::move(Buffer), /*IsNullTerminated=*/true);
+}
+
+/**
+ * Frees a buffer. Everything that refers to its memory, its identifier
+ * included, is dropped before the buffer itself.
+ *
+ * @param BufferID ID of the buffer to remove
+ */
+void SourceManager::removeSourceBuffer(unsigned BufferID) {
+  const llvm::MemoryBuffer *Buffer = getMemoryBuffer(BufferID);
+
+  // The map's key points into the buffer, and another buffer may have been
+  // registered under the same identifier since.
+  if (const auto It = BufIdentIDMap.find(Buffer->getBufferIdentifier());
+      It != BufIdentIDMap.end() && It->second == BufferID)
+    BufIdentIDMap.erase(It);
+
+  const auto Range = std::lower_bound(BufferRanges.begin(), BufferRanges.end(),
+                                      getOpaqueValue(getLocForBufferStart(BufferID)),
+                                      [](const BufferRange &R, uintptr_t Start) {
+                                        return R.Start < Start;
+                                      });
+  assert(Range != BufferRanges.end() && Range->BufferID == BufferID && "every buffer has a range");
+  BufferRanges.erase(Range);
+  LastBufferRange.store(0, std::memory_order_relaxed);
+
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+  SourceLocationSpace::removeRange(Buffer->getBufferStart());
+#endif
+  BufferStarts[BufferID - 1] = SourceLocation();
+  BufferInfos[BufferID - 1] = BufferTextInfo();
+  LineTables[BufferID - 1].reset();
+  Buffers[BufferID - 1].reset();
+}
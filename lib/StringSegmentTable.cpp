@@ -0,0 +1,42 @@
+#include "swift/Lexer/StringSegmentTable.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace swift;
+
+void StringSegmentTable::record(unsigned TokenOffset,
+                                llvm::ArrayRef<Interpolation> NewInterpolations) {
+  assert(TokenOffset < BufferText.size() && "literal is not in this buffer");
+
+  auto ByOffset = [](const Entry &E, unsigned Offset) {
+    return E.TokenOffset < Offset;
+  };
+  auto I = Strings.end();
+  if (!Strings.empty() && Strings.back().TokenOffset >= TokenOffset) {
+    I = std::lower_bound(Strings.begin(), Strings.end(), TokenOffset, ByOffset);
+    if (I != Strings.end() && I->TokenOffset == TokenOffset)
+      return;
+  }
+
+  Strings.insert(I, {TokenOffset, uint32_t(Interpolations.size()),
+                     uint32_t(NewInterpolations.size())});
+  Interpolations.insert(Interpolations.end(), NewInterpolations.begin(),
+                        NewInterpolations.end());
+}
+
+std::optional<llvm::ArrayRef<StringSegmentTable::Interpolation>>
+StringSegmentTable::lookup(unsigned TokenOffset) const {
+  auto I = std::lower_bound(Strings.begin(), Strings.end(), TokenOffset,
+                            [](const Entry &E, unsigned Offset) {
+                              return E.TokenOffset < Offset;
+                            });
+  if (I == Strings.end() || I->TokenOffset != TokenOffset)
+    return std::nullopt;
+  return llvm::ArrayRef<Interpolation>(Interpolations).slice(I->First, I->Count);
+}
+
+void StringSegmentTable::clear() {
+  Strings.clear();
+  Interpolations.clear();
+}
@@ -0,0 +1,95 @@
+#include "swift/Lexer/TokenBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace swift;
+
+void TokenBuffer::push_back(const Token &Tok) {
+  llvm::StringRef Text = Tok.getRawText();
+  assert(Text.data() >= BufferText.data() &&
+         Text.data() + Text.size() <= BufferText.data() + BufferText.size() &&
+         "token is not from this buffer");
+
+  uint8_t TokFlags = 0;
+  if (Tok.isAtStartOfLine())
+    TokFlags |= AtStartOfLineFlag;
+  if (Tok.isEscapedIdentifier())
+    TokFlags |= EscapedIdentifierFlag;
+  if (Tok.isMultilineString())
+    TokFlags |= MultilineStringFlag;
+  if (Tok.getCommentLength() != 0 || Tok.getCustomDelimiterLen() != 0) {
+    TokFlags |= HasExtraFlag;
+    Extras.push_back({unsigned(Kinds.size()), Tok.getCommentLength(),
+                      Tok.getCustomDelimiterLen()});
+  }
+
+  Kinds.push_back(Tok.getKind());
+  Offsets.push_back(uint32_t(Text.data() - BufferText.data()));
+  Lengths.push_back(uint32_t(Text.size()));
+  Flags.push_back(TokFlags);
+}
+
+void TokenBuffer::reserve(size_t N) {
+  Kinds.reserve(N);
+  Offsets.reserve(N);
+  Lengths.reserve(N);
+  Flags.reserve(N);
+}
+
+void TokenBuffer::clear() {
+  Kinds.clear();
+  Offsets.clear();
+  Lengths.clear();
+  Flags.clear();
+  Extras.clear();
+}
+
+void TokenBuffer::shrink_to_fit() {
+  Kinds.shrink_to_fit();
+  Offsets.shrink_to_fit();
+  Lengths.shrink_to_fit();
+  Flags.shrink_to_fit();
+  Extras.shrink_to_fit();
+}
+
+Token TokenBuffer::operator[](size_t Index) const {
+  assert(Index < size() && "token index out of range");
+  unsigned CommentLength = 0;
+  unsigned CustomDelimiterLen = 0;
+  if (Flags[Index] & HasExtraFlag) {
+    auto It = std::lower_bound(
+        Extras.begin(), Extras.end(), Index,
+        [](const Extra &E, size_t I) { return E.Index < I; });
+    assert(It != Extras.end() && It->Index == Index && "missing extra");
+    CommentLength = It->CommentLength;
+    CustomDelimiterLen = It->CustomDelimiterLen;
+  }
+
+  Token Tok(Kinds[Index], getRawText(Index), CommentLength);
+  Tok.setAtStartOfLine(Flags[Index] & AtStartOfLineFlag);
+  if (Flags[Index] & EscapedIdentifierFlag)
+    Tok.setEscapedIdentifier(true);
+  if (Kinds[Index] == tok::string_literal)
+    Tok.setStringLiteral(Flags[Index] & MultilineStringFlag,
+                         CustomDelimiterLen);
+  return Tok;
+}
+
+size_t TokenBuffer::find(tok Kind, size_t From) const {
+  if (From >= size())
+    return npos;
+  // tok is a single byte, so this is a vectorized byte search.
+  const void *Match = std::memchr(Kinds.data() + From, int(Kind), size() - From);
+  if (!Match)
+    return npos;
+  return static_cast<const tok *>(Match) - Kinds.data();
+}
+
+size_t TokenBuffer::getMemoryUsage() const {
+  return Kinds.capacity() * sizeof(tok) +
+         Offsets.capacity() * sizeof(uint32_t) +
+         Lengths.capacity() * sizeof(uint32_t) +
+         Flags.capacity() * sizeof(uint8_t) +
+         Extras.capacity() * sizeof(Extra);
+}
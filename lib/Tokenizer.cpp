@@ -2,135 +2,154 @@
 // Created by Satish Babariya on 25/04/25.
 //
 
-#include "swift/Lexer/Lexer.h"
-#include <set>
-
-static void getStringPartTokens(const swift::Token &Tok,
-                                const swift::LangOptions &LangOpts,
-                                const swift::SourceManager &SM, int BufID,
-                                std::vector<swift::Token> &Toks);
-
-namespace swift {
-    template <typename DF>
-    void tokenize(const LangOptions &LangOpts, const SourceManager &SM,
-                  unsigned BufferID, unsigned Offset, unsigned EndOffset,
-                  DiagnosticEngine * Diags,
-                  CommentRetentionMode RetainComments,
-                  bool TokenizeInterpolatedString, llvm::ArrayRef<Token> SplitTokens,
-                  DF &&DestFunc) {
-        if (Offset == 0 && EndOffset == 0)
-            EndOffset = SM.getRangeForBuffer(BufferID).getByteLength();
-
-        Lexer L(LangOpts, SM, BufferID, Diags, LexerMode::Swift,
-                HashbangMode::Allowed, RetainComments, Offset,
-                EndOffset);
-
-        auto TokComp = [&](const Token &A, const Token &B) {
-            return SM.isBeforeInBuffer(A.getLoc(), B.getLoc());
-        };
-
-        std::set<Token, decltype(TokComp)> ResetTokens(TokComp);
-        for (auto C = SplitTokens.begin(), E = SplitTokens.end(); C != E; ++C) {
-            ResetTokens.insert(*C);
-        }
-
-        Token Tok;
-        do {
-            L.lex(Tok);
-
-            // If the token has the same location as a reset location,
-            // reset the token stream
-            auto F = ResetTokens.find(Tok);
-            if (F != ResetTokens.end()) {
-                assert(F->isNot(tok::string_literal));
-
-                DestFunc(*F);
-
-                auto NewState = L.getStateForBeginningOfTokenLoc(
-                    F->getLoc().getAdvancedLoc(F->getLength()));
-                L.restoreState(NewState);
-                continue;
-            }
-
-            if (Tok.is(tok::string_literal) && TokenizeInterpolatedString) {
-                std::vector<Token> StrTokens;
-                getStringPartTokens(Tok, LangOpts, SM, BufferID, StrTokens);
-                for (auto &StrTok : StrTokens) {
-                    DestFunc(StrTok);
-                }
-            } else {
-                DestFunc(Tok);
-            }
-
-        } while (Tok.getKind() != tok::eof);
-    }
-} // namespace swift
+#include "swift/Lexer/TokenStream.h"
+
+#include <algorithm>
 
 using namespace swift;
 
-/// Tokenizes a string literal, taking into account string interpolation.
-static void getStringPartTokens(const Token &Tok, const LangOptions &LangOpts,
-                                const SourceManager &SM,
-                                int BufID, std::vector<Token> &Toks) {
-  assert(Tok.is(tok::string_literal));
-  bool IsMultiline = Tok.isMultilineString();
-  unsigned CustomDelimiterLen = Tok.getCustomDelimiterLen();
-  unsigned QuoteLen = (IsMultiline ? 3 : 1) + CustomDelimiterLen;
-  llvm::SmallVector<Lexer::StringSegment, 4> Segments;
-  Lexer::getStringLiteralSegments(Tok, Segments, /*Diags=*/nullptr);
-  for (unsigned i = 0, e = Segments.size(); i != e; ++i) {
-    Lexer::StringSegment &Seg = Segments[i];
-    bool isFirst = i == 0;
-    bool isLast = i == e-1;
-    if (Seg.Kind == Lexer::StringSegment::Literal) {
-      SourceLocation Loc = Seg.Loc;
-      unsigned Len = Seg.Length;
-      if (isFirst) {
-        // Include the quote.
-        Loc = Loc.getAdvancedLoc(-QuoteLen);
-        Len += QuoteLen;
-      }
-      if (isLast) {
-        // Include the quote.
-        Len += QuoteLen;
-      }
-
-      llvm::StringRef Text = SM.extractText({ Loc, Len });
-      Token NewTok;
-      NewTok.setToken(tok::string_literal, Text);
-      NewTok.setStringLiteral(IsMultiline, CustomDelimiterLen);
-      Toks.push_back(NewTok);
-
-    } else {
-      assert(Seg.Kind == Lexer::StringSegment::Expr &&
-             "new enumerator was introduced ?");
-      unsigned Offset = SM.getLocOffsetInBuffer(Seg.Loc, BufID);
-      unsigned EndOffset = Offset + Seg.Length;
-
-      if (isFirst) {
-        // Add a token for the quote character.
-        llvm::StringRef Text = SM.extractText({ Seg.Loc.getAdvancedLoc(-2), 1 });
-        Token NewTok;
-        NewTok.setToken(tok::string_literal, Text);
-        Toks.push_back(NewTok);
-      }
-
-      std::vector<Token> NewTokens = swift::tokenize(LangOpts, SM, BufID,
-                                                     Offset, EndOffset,
-                                                     /*Diags=*/nullptr,
-                                                     /*KeepComments=*/true);
-      Toks.insert(Toks.end(), NewTokens.begin(), NewTokens.end());
-
-      if (isLast) {
-        // Add a token for the quote character.
-        llvm::StringRef Text = SM.extractText({ Seg.Loc.getAdvancedLoc(Seg.Length),
-                                          1 });
-        Token NewTok;
-        NewTok.setToken(tok::string_literal, Text);
-        Toks.push_back(NewTok);
-      }
+TokenStream::TokenStream(const LangOptions &LangOpts, const SourceManager &SM,
+                         unsigned BufferID, const TokenizeOptions &Options)
+  : TokenizeInterpolatedString(Options.TokenizeInterpolatedString),
+    Segments(SM, BufferID),
+    L(LangOpts, SM, BufferID, Options.Diags, LexerMode::Swift,
+      HashbangMode::Allowed,
+      Options.KeepComments ? CommentRetentionMode::ReturnAsTokens
+                           : CommentRetentionMode::AttachToNextToken,
+      Options.Offset,
+      Options.Offset == 0 && Options.EndOffset == 0
+          ? SM.getRangeForBuffer(BufferID).getByteLength()
+          : Options.EndOffset),
+    SplitTokens(Options.SplitTokens) {
+  assert(std::is_sorted(SplitTokens.begin(), SplitTokens.end(),
+                        [](const Token &A, const Token &B) {
+                          return SourceManager::isBeforeInBuffer(A.getLoc(),
+                                                                 B.getLoc());
+                        }) &&
+         "split tokens must be sorted by location");
+
+  if (TokenizeInterpolatedString) {
+    // The lexer has already lexed the first token; lex it again so that its
+    // interpolations are recorded too.
+    L.setStringSegmentTable(&Segments);
+    L.resetToOffset(Options.Offset);
+  }
+}
+
+/// Appends the literal text [Start, End) of \p Str to \p Pieces. The first
+/// piece keeps the flags of the whole literal.
+static void addLiteralPiece(const Token &Str, const char *Start,
+                            const char *End,
+                            llvm::SmallVectorImpl<Token> &Pieces) {
+  llvm::StringRef Text(Start, End - Start);
+  if (Start == Str.getRawText().begin()) {
+    Token Piece = Str;
+    Piece.setText(Text);
+    Pieces.push_back(Piece);
+    return;
+  }
+
+  Token Piece(tok::string_literal, Text);
+  Piece.setStringLiteral(Str.isMultilineString(), Str.getCustomDelimiterLen());
+  Pieces.push_back(Piece);
+}
+
+void TokenStream::splitStringLiteral(const Token &Str) {
+  // Recording nested literals may grow the table, so take a copy.
+  auto Recorded = *Segments.lookup(Str);
+  llvm::SmallVector<StringSegmentTable::Interpolation, 4> Interpolations(
+      Recorded.begin(), Recorded.end());
+  assert(!Interpolations.empty());
+
+  const char *BufferStart = Segments.getBufferText().data();
+  unsigned CustomDelimiterLen = Str.getCustomDelimiterLen();
+  const char *LiteralStart = Str.getRawText().begin();
+  for (const StringSegmentTable::Interpolation &I : Interpolations) {
+    // The literal runs up to the '\' and any '#'s before the '('.
+    addLiteralPiece(Str, LiteralStart,
+                    BufferStart + I.Begin - 1 - CustomDelimiterLen, Pending);
+
+    // Lex the expression, parentheses included, with the same lexer.
+    Lexer::SubrangeState Saved = L.beginSubrange(I.Begin, I.End);
+    Token Tok;
+    for (L.lex(Tok); Tok.isNot(tok::eof); L.lex(Tok)) {
+      if (isInterpolated(Tok))
+        splitStringLiteral(Tok);
+      else
+        Pending.push_back(Tok);
     }
+    L.endSubrange(std::move(Saved));
+
+    LiteralStart = BufferStart + I.End;
   }
+  addLiteralPiece(Str, LiteralStart, Str.getRawText().end(), Pending);
+}
+
+bool TokenStream::next(Token &Result) {
+  if (PendingIndex != Pending.size()) {
+    Result = Pending[PendingIndex++];
+    return true;
+  }
+  if (ReachedEOF)
+    return false;
+
+  while (true) {
+    Token Tok;
+    L.lex(Tok);
+
+    // Skip split tokens the lexer has already moved past, then check whether
+    // the next one starts here; if so, it replaces the lexed token and the
+    // lexer resumes after it.
+    while (!SplitTokens.empty() &&
+           SourceManager::isBeforeInBuffer(SplitTokens.front().getLoc(),
+                                           Tok.getLoc()))
+      SplitTokens = SplitTokens.drop_front();
+
+    if (!SplitTokens.empty() && SplitTokens.front().getLoc() == Tok.getLoc()) {
+      const Token &Split = SplitTokens.front();
+      SplitTokens = SplitTokens.drop_front();
+      assert(Split.isNot(tok::string_literal));
+
+      auto NewState = L.getStateForBeginningOfTokenLoc(
+          Split.getLoc().getAdvancedLoc(Split.getLength()));
+      L.restoreState(NewState);
+      Result = Split;
+      return true;
+    }
+
+    if (Tok.is(tok::eof)) {
+      ReachedEOF = true;
+      StopToken = Tok;
+      StopToken.setKind(L.getNextTokenKindBeforeEOF());
+      return false;
+    }
+
+    if (isInterpolated(Tok)) {
+      Pending.clear();
+      PendingIndex = 0;
+      splitStringLiteral(Tok);
+      Result = Pending[PendingIndex++];
+      return true;
+    }
+
+    Result = Tok;
+    return true;
+  }
+}
+
+static TokenizeOptions makeTokenizeOptions(unsigned Offset, unsigned EndOffset,
+                                           DiagnosticEngine *Diags,
+                                           bool KeepComments,
+                                           bool TokenizeInterpolatedString,
+                                           llvm::ArrayRef<Token> SplitTokens) {
+  TokenizeOptions Options;
+  Options.Offset = Offset;
+  Options.EndOffset = EndOffset;
+  Options.Diags = Diags;
+  Options.KeepComments = KeepComments;
+  Options.TokenizeInterpolatedString = TokenizeInterpolatedString;
+  Options.SplitTokens = SplitTokens;
+  return Options;
 }
 
 std::vector<Token> swift::tokenize(const LangOptions &LangOpts,
@@ -140,16 +159,29 @@ std::vector<Token> swift::tokenize(const LangOptions &LangOpts,
                                    bool KeepComments,
                                    bool TokenizeInterpolatedString,
                                    llvm::ArrayRef<Token> SplitTokens) {
-  std::vector<Token> Tokens;
-
-  tokenize(LangOpts, SM, BufferID, Offset, EndOffset, Diags,
-           KeepComments ? CommentRetentionMode::ReturnAsTokens
-                        : CommentRetentionMode::AttachToNextToken,
-           TokenizeInterpolatedString,
-           SplitTokens,
-           [&](const Token &Tok) { Tokens.push_back(Tok); });
+  TokenStream Stream(LangOpts, SM, BufferID,
+                     makeTokenizeOptions(Offset, EndOffset, Diags, KeepComments,
+                                         TokenizeInterpolatedString,
+                                         SplitTokens));
+  return std::vector<Token>(Stream.begin(), Stream.end());
+}
 
-  assert(Tokens.back().is(tok::eof));
-  Tokens.pop_back(); // Remove EOF.
+TokenBuffer swift::tokenizeToBuffer(const LangOptions &LangOpts,
+                                    const SourceManager &SM, unsigned BufferID,
+                                    unsigned Offset, unsigned EndOffset,
+                                    DiagnosticEngine *Diags,
+                                    bool KeepComments,
+                                    bool TokenizeInterpolatedString,
+                                    llvm::ArrayRef<Token> SplitTokens) {
+  TokenBuffer Tokens(SM, BufferID);
+  TokenStream Stream(LangOpts, SM, BufferID,
+                     makeTokenizeOptions(Offset, EndOffset, Diags, KeepComments,
+                                         TokenizeInterpolatedString,
+                                         SplitTokens));
+  Token Tok;
+  while (Stream.next(Tok))
+    Tokens.push_back(Tok);
+
+  Tokens.shrink_to_fit();
   return Tokens;
-}
\ No newline at end of file
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <swift/Lexer/BatchTokenizer.h>
+#include <swift/Source/SourceManager.h>
+
+using namespace swift;
+
+namespace {
+    class RecordingDiagnosticConsumer : public DiagnosticConsumer {
+    public:
+        std::vector<std::string> Messages;
+
+        void handleDiagnostic(const Diagnostic &Diag, const SourceManager &SM) override {
+            unsigned BufferID = SM.findBufferContainingLoc(Diag.Location);
+            Messages.push_back(SM.getDisplayNameForLoc(Diag.Location).str() + ":" +
+                               std::to_string(SM.getLocOffsetInBuffer(Diag.Location, BufferID)) +
+                               ": " + Diag.Message);
+        }
+    };
+}
+
+class BatchTokenizerTest : public ::testing::Test {
+public:
+    LangOptions LangOpts;
+    SourceManager SourceMgr;
+};
+
+TEST_F(BatchTokenizerTest, MatchesTokenizeToBuffer) {
+    std::vector<unsigned> BufferIDs;
+    for (unsigned I = 0; I != 20; ++I) {
+        // Sizes vary so that the largest-first order differs from this one.
+        std::string Source;
+        for (unsigned Line = 0; Line != (I * 7) % 13 + 1; ++Line)
+            Source += "let v" + std::to_string(Line) + " = \"\\(x) \\(y)\" // c\n";
+        BufferIDs.push_back(SourceMgr.addMemBufferCopy(Source, "file" + std::to_string(I) + ".swift"));
+    }
+
+    for (unsigned Threads : {1u, 4u}) {
+        BatchTokenizeOptions Options;
+        Options.Threads = Threads;
+        std::vector<TokenBuffer> Results = tokenizeBuffers(LangOpts, SourceMgr, BufferIDs,
+                                                           nullptr, Options);
+        ASSERT_EQ(BufferIDs.size(), Results.size());
+        for (size_t I = 0; I != BufferIDs.size(); ++I) {
+            TokenBuffer Expected = tokenizeToBuffer(LangOpts, SourceMgr, BufferIDs[I]);
+            ASSERT_EQ(Expected.size(), Results[I].size()) << "file " << I;
+            for (size_t T = 0; T != Expected.size(); ++T) {
+                EXPECT_EQ(Expected.getKind(T), Results[I].getKind(T)) << "file " << I;
+                EXPECT_EQ(Expected.getLoc(T), Results[I].getLoc(T)) << "file " << I;
+            }
+        }
+    }
+}
+
+TEST_F(BatchTokenizerTest, DiagnosticsInInputOrder) {
+    // Embedded NULs are diagnosed; the larger buffer is lexed first.
+    std::vector<unsigned> BufferIDs;
+    BufferIDs.push_back(SourceMgr.addMemBufferCopy(llvm::StringRef("a\0b", 3), "small.swift"));
+    BufferIDs.push_back(SourceMgr.addMemBufferCopy(
+        llvm::StringRef("let x = 1\nlet y = 2\n\0z", 22), "large.swift"));
+
+    auto Consumer = std::make_unique<RecordingDiagnosticConsumer>();
+    RecordingDiagnosticConsumer *ConsumerPtr = Consumer.get();
+    DiagnosticEngine Diags(SourceMgr);
+    Diags.addConsumer(std::move(Consumer));
+
+    BatchTokenizeOptions Options;
+    Options.Threads = 2;
+    tokenizeBuffers(LangOpts, SourceMgr, BufferIDs, &Diags, Options);
+
+    ASSERT_EQ(2u, ConsumerPtr->Messages.size());
+    EXPECT_EQ("small.swift:1: nul character embedded in source file", ConsumerPtr->Messages[0]);
+    EXPECT_EQ("large.swift:20: nul character embedded in source file", ConsumerPtr->Messages[1]);
+    EXPECT_EQ(2u, Diags.getErrorCount());
+}
+
+TEST_F(BatchTokenizerTest, MissingFile) {
+    DiagnosticEngine Diags(SourceMgr);
+    std::vector<std::string> Paths = {"/nonexistent/file.swift"};
+    std::vector<BatchTokenizeResult> Results = tokenizeFiles(LangOpts, SourceMgr, Paths, &Diags);
+    ASSERT_EQ(1u, Results.size());
+    EXPECT_EQ(~0U, Results[0].BufferID);
+    EXPECT_TRUE(Results[0].Tokens.empty());
+    EXPECT_EQ(1u, Diags.getErrorCount());
+}
+
+TEST_F(BatchTokenizerTest, DiagnosticsIndependentOfThreadCount) {
+    std::vector<unsigned> BufferIDs;
+    for (unsigned I = 0; I != 16; ++I) {
+        std::string Source;
+        for (unsigned Line = 0; Line != (I * 5) % 11 + 1; ++Line)
+            Source += "let s = \"\\q\" // \xFF\n/* \x01 */ let \x01\x01\x01 = 0x1g\n";
+        BufferIDs.push_back(SourceMgr.addMemBufferCopy(Source, "file" + std::to_string(I) + ".swift"));
+    }
+
+    auto Run = [&](unsigned Threads, const DiagnosticLimits &Limits) {
+        auto Consumer = std::make_unique<RecordingDiagnosticConsumer>();
+        RecordingDiagnosticConsumer *ConsumerPtr = Consumer.get();
+        DiagnosticEngine Diags(SourceMgr);
+        Diags.addConsumer(std::move(Consumer));
+        Diags.setLimits(Limits);
+        BatchTokenizeOptions Options;
+        Options.Threads = Threads;
+        tokenizeBuffers(LangOpts, SourceMgr, BufferIDs, &Diags, Options);
+        return ConsumerPtr->Messages;
+    };
+
+    DiagnosticLimits Limited;
+    Limited.MaxErrors = 25;
+    Limited.MaxPerKind = 10;
+    Limited.CollapseAdjacent = true;
+    for (const DiagnosticLimits &Limits : {DiagnosticLimits(), Limited}) {
+        const std::vector<std::string> Serial = Run(1, Limits);
+        EXPECT_FALSE(Serial.empty());
+        for (unsigned Threads : {2u, 4u, 7u})
+            EXPECT_EQ(Serial, Run(Threads, Limits)) << Threads << " threads";
+    }
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <swift/Diagnostic/DiagnosticConsumers.h>
+
+#include <sstream>
+
+using namespace swift;
+
+class DiagnosticConsumersTest : public ::testing::Test {
+public:
+    SourceManager SourceMgr;
+    std::ostringstream Output;
+
+    /// Diagnoses, through an engine writing with Consumer, an invalid
+    /// escape on line 2 of "consumers.swift", then a free-form warning
+    /// without a location.
+    void diagnoseSample(std::unique_ptr<DiagnosticConsumer> Consumer) {
+        const unsigned BufferID = SourceMgr.addMemBufferCopy("let a = 1\r\n\tlet é = \"\\q\"\n", "consumers.swift");
+        DiagnosticEngine Diags(SourceMgr);
+        Diags.addConsumer(std::move(Consumer));
+        Diags.diagnose(SourceMgr.getLocForLineCol(BufferID, 2, 12), diag::lex_invalid_escape);
+        Diags.warning(SourceLocation(), "say \"hi\"\n\x01\xFF");
+    }
+};
+
+TEST_F(DiagnosticConsumersTest, TextQuotesTheLine) {
+    diagnoseSample(std::make_unique<TextDiagnosticConsumer>(Output));
+    EXPECT_EQ("consumers.swift:2:12: error: invalid escape sequence in literal\n"
+              "\tlet é = \"\\q\"\n"
+              "\t         ^\n"
+              "warning: say \"hi\"\n\x01\xFF\n",
+              Output.str());
+}
+
+TEST_F(DiagnosticConsumersTest, JSONLinesEscapesStrings) {
+    diagnoseSample(std::make_unique<JSONLinesDiagnosticConsumer>(Output));
+    EXPECT_EQ("{\"file\":\"consumers.swift\",\"line\":2,\"column\":12,\"offset\":22,\"severity\":\"error\","
+              "\"id\":\"lex_invalid_escape\",\"message\":\"invalid escape sequence in literal\",\"count\":1,"
+              "\"snippet\":\"\\tlet é = \\\"\\\\q\\\"\"}\n"
+              "{\"severity\":\"warning\",\"id\":\"warning_message\","
+              "\"message\":\"say \\\"hi\\\"\\n\\u0001\\ufffd\",\"count\":1}\n",
+              Output.str());
+}
+
+TEST_F(DiagnosticConsumersTest, SARIFCountsUTF16Columns) {
+    diagnoseSample(std::make_unique<SARIFDiagnosticConsumer>(Output));
+    const std::string Log = Output.str();
+    EXPECT_EQ(0u, Log.find("{\"version\":\"2.1.0\","));
+    EXPECT_NE(std::string::npos, Log.find("\"ruleId\":\"lex_invalid_escape\",\"level\":\"error\""));
+    // 'é' is two bytes but one UTF-16 code unit.
+    EXPECT_NE(std::string::npos,
+              Log.find("\"artifactLocation\":{\"uri\":\"consumers.swift\"},"
+                       "\"region\":{\"startLine\":2,\"startColumn\":11,\"byteOffset\":22}"));
+    EXPECT_NE(std::string::npos, Log.find("\"ruleId\":\"warning_message\",\"level\":\"warning\""));
+    EXPECT_EQ(Log.size() - 6, Log.find("\n]}]}\n"));
+}
+
+TEST_F(DiagnosticConsumersTest, WritesOnlyFullBuffers) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(std::string(1000, 'x'), "long.swift");
+    const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferID);
+    auto Consumer = std::make_unique<TextDiagnosticConsumer>(Output, /*ShowSnippets=*/true, /*BufferSize=*/1024);
+    TextDiagnosticConsumer *ConsumerPtr = Consumer.get();
+    DiagnosticEngine Diags(SourceMgr);
+    Diags.addConsumer(std::move(Consumer));
+
+    // A long line is quoted around the column.
+    Diags.diagnose(Loc.getAdvancedLoc(500), diag::lex_invalid_character);
+    EXPECT_TRUE(Output.str().empty());
+    ConsumerPtr->flush();
+    const std::string Caret = std::string(StreamingDiagnosticConsumer::MaxSnippetLength / 2, ' ') + "^\n";
+    EXPECT_EQ("long.swift:1:501: error: invalid character\n" +
+              std::string(StreamingDiagnosticConsumer::MaxSnippetLength, 'x') + "\n" + Caret,
+              Output.str());
+
+    // Each diagnostic takes the same space, so the buffer is written out
+    // with the one that fills it.
+    const size_t Size = Output.str().size();
+    Output.str("");
+    for (int I = 0; I != 5; ++I)
+        Diags.diagnose(Loc.getAdvancedLoc(500), diag::lex_invalid_character);
+    const size_t Full = (1024 + Size - 1) / Size * Size;
+    EXPECT_EQ(Full, Output.str().size());
+    Diags.finishProcessing();
+    EXPECT_EQ(5 * Size, Output.str().size());
+    EXPECT_EQ(6u, ConsumerPtr->getErrorCount());
+}
@@ -0,0 +1,314 @@
+#include <gtest/gtest.h>
+#include <swift/Diagnostic/DiagnosticEngine.h>
+
+#include <thread>
+
+using namespace swift;
+
+namespace {
+    /// Records every diagnostic, and how many came in batches.
+    class CapturingDiagnosticConsumer : public DiagnosticConsumer {
+    public:
+        std::vector<Diagnostic> Diagnostics;
+        unsigned Batches = 0;
+        bool Finished = false;
+
+        void handleDiagnostic(const Diagnostic &Diag, const SourceManager &) override {
+            Diagnostics.push_back(Diag);
+        }
+
+        void handleDiagnostics(llvm::ArrayRef<Diagnostic> Diags, const SourceManager &) override {
+            ++Batches;
+            Diagnostics.insert(Diagnostics.end(), Diags.begin(), Diags.end());
+        }
+
+        void finishProcessing() override {
+            Finished = true;
+        }
+    };
+} // end anonymous namespace
+
+class DiagnosticEngineTest : public ::testing::Test {
+public:
+    SourceManager SourceMgr;
+    DiagnosticEngine Diags{SourceMgr};
+    CapturingDiagnosticConsumer *Captured = nullptr;
+
+    void SetUp() override {
+        auto Consumer = std::make_unique<CapturingDiagnosticConsumer>();
+        Captured = Consumer.get();
+        Diags.addConsumer(std::move(Consumer));
+    }
+};
+
+TEST(DiagnosticFormatTest, SubstitutesArguments) {
+    EXPECT_EQ("no arguments", formatDiagnosticMessage("no arguments", {}));
+    EXPECT_EQ("invalid digit 'g' in integer literal",
+              formatDiagnosticMessage("invalid digit '%0' in integer literal", {llvm::StringRef("g")}));
+    EXPECT_EQ("2 of 10, 100% 2",
+              formatDiagnosticMessage("%1 of %0, 100%% %1", {DiagnosticArgument(10u), DiagnosticArgument(2u)}));
+}
+
+TEST(DiagnosticKindsTest, DescribesEachKind) {
+    EXPECT_EQ(DiagnosticSeverity::Error, getDiagnosticSeverity(DiagID::lex_unterminated_string));
+    EXPECT_EQ("unterminated string literal", getDiagnosticFormat(DiagID::lex_unterminated_string));
+    EXPECT_EQ("lex_unterminated_string", getDiagnosticName(DiagID::lex_unterminated_string));
+    EXPECT_EQ(DiagnosticSeverity::Note, getDiagnosticSeverity(DiagID::lex_comment_start));
+    EXPECT_EQ(DiagID::lex_comment_start, diag::lex_comment_start.ID);
+    EXPECT_LT(unsigned(DiagID::lex_multiline_string_indent_change_line), NumDiagIDs);
+}
+
+TEST_F(DiagnosticEngineTest, DiagnosticsCarryTheirID) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy("0xg", "ids.swift");
+    const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferID);
+    Diags.diagnose(Loc.getAdvancedLoc(2), diag::lex_invalid_digit_in_int_literal,
+                   SourceMgr.getBufferContent(BufferID).substr(2, 1));
+    Diags.diagnose(Loc, diag::lex_comment_start);
+    Diags.warning(Loc, "free-form");
+
+    ASSERT_EQ(3u, Captured->Diagnostics.size());
+    EXPECT_EQ(DiagID::lex_invalid_digit_in_int_literal, Captured->Diagnostics[0].ID);
+    EXPECT_EQ(DiagnosticSeverity::Error, Captured->Diagnostics[0].Severity);
+    EXPECT_EQ("invalid digit 'g' in integer literal", Captured->Diagnostics[0].Message);
+    EXPECT_EQ(DiagID::lex_comment_start, Captured->Diagnostics[1].ID);
+    EXPECT_EQ(DiagnosticSeverity::Note, Captured->Diagnostics[1].Severity);
+    EXPECT_EQ(DiagID::warning_message, Captured->Diagnostics[2].ID);
+    EXPECT_EQ("free-form", Captured->Diagnostics[2].Message);
+    EXPECT_EQ(1u, Diags.getErrorCount());
+    EXPECT_EQ(1u, Diags.getWarningCount());
+
+    // A diagnostic passed on from another engine keeps its ID.
+    SourceManager OtherSourceMgr;
+    DiagnosticEngine Other(OtherSourceMgr);
+    auto Forwarded = std::make_unique<CapturingDiagnosticConsumer>();
+    CapturingDiagnosticConsumer *ForwardedPtr = Forwarded.get();
+    Other.addConsumer(std::move(Forwarded));
+    Other.diagnose(Captured->Diagnostics[0]);
+    ASSERT_EQ(1u, ForwardedPtr->Diagnostics.size());
+    EXPECT_EQ(DiagID::lex_invalid_digit_in_int_literal, ForwardedPtr->Diagnostics[0].ID);
+    EXPECT_EQ(1u, Other.getErrorCount());
+}
+
+TEST_F(DiagnosticEngineTest, QueueEmitsInOrder) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy("abc", "queue.swift");
+    const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferID);
+    const llvm::StringRef Text = SourceMgr.getBufferContent(BufferID);
+    {
+        DiagnosticQueue Queue(Diags);
+        Queue.diagnose(Loc, diag::lex_invalid_digit_in_int_literal, Text.substr(0, 1));
+        Queue.diagnose(Loc.getAdvancedLoc(1), diag::warning_message, Text.substr(1, 1));
+        EXPECT_EQ(2u, Queue.size());
+        EXPECT_TRUE(Captured->Diagnostics.empty());
+        Queue.emit();
+        EXPECT_EQ(0u, Queue.size());
+
+        // Left in the queue at destruction, and emitted then.
+        Queue.diagnose(Loc, diag::lex_comment_start);
+    }
+
+    ASSERT_EQ(3u, Captured->Diagnostics.size());
+    EXPECT_EQ("invalid digit 'a' in integer literal", Captured->Diagnostics[0].Message);
+    EXPECT_EQ(DiagnosticSeverity::Error, Captured->Diagnostics[0].Severity);
+    EXPECT_EQ("b", Captured->Diagnostics[1].Message);
+    EXPECT_EQ(Loc.getAdvancedLoc(1), Captured->Diagnostics[1].Location);
+    EXPECT_EQ(DiagID::lex_comment_start, Captured->Diagnostics[2].ID);
+    EXPECT_EQ(1u, Diags.getErrorCount());
+    EXPECT_EQ(1u, Diags.getWarningCount());
+    EXPECT_EQ(3u, Diags.getTotalDiagnosticCount());
+}
+
+TEST_F(DiagnosticEngineTest, ClearedQueueEmitsNothing) {
+    DiagnosticQueue Queue(Diags, /*EmitOnDestruction=*/false);
+    Queue.diagnose(SourceLocation(), diag::lex_invalid_character);
+    Queue.clear();
+    Queue.emit();
+    Queue.diagnose(SourceLocation(), diag::lex_invalid_character);
+    EXPECT_TRUE(Captured->Diagnostics.empty());
+    EXPECT_FALSE(Diags.hasErrors());
+}
+
+TEST_F(DiagnosticEngineTest, LimitsCapEachKind) {
+    DiagnosticLimits Limits;
+    Limits.MaxPerKind = 2;
+    Diags.setLimits(Limits);
+
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(std::string(100, ' '), "kinds.swift");
+    const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferID);
+    for (int I = 0; I != 5; ++I) {
+        Diags.diagnose(Loc.getAdvancedLoc(10 * I), diag::lex_unterminated_block_comment);
+        Diags.diagnose(Loc.getAdvancedLoc(10 * I), diag::lex_comment_start);
+    }
+    Diags.error(Loc, "free-form errors are not capped");
+
+    std::vector<DiagID> IDs;
+    for (const Diagnostic &Diag : Captured->Diagnostics)
+        IDs.push_back(Diag.ID);
+    const std::vector<DiagID> Expected = {
+        DiagID::lex_unterminated_block_comment, DiagID::lex_comment_start,
+        DiagID::lex_unterminated_block_comment, DiagID::diagnostic_kind_limit_reached, DiagID::lex_comment_start,
+        DiagID::diagnostic_kind_limit_reached, DiagID::error_message
+    };
+    EXPECT_EQ(Expected, IDs);
+    EXPECT_EQ(2u, Diags.getDiagnosticCount(DiagID::lex_unterminated_block_comment));
+    // The suppressed errors take their notes with them.
+    EXPECT_EQ(6u, Diags.getSuppressedCount());
+    EXPECT_FALSE(Diags.hasReachedErrorLimit());
+}
+
+TEST_F(DiagnosticEngineTest, ErrorLimitStopsReporting) {
+    DiagnosticLimits Limits;
+    Limits.MaxErrors = 3;
+    Diags.setLimits(Limits);
+
+    for (int I = 0; I != 5; ++I) {
+        EXPECT_EQ(I >= 3, Diags.hasReachedErrorLimit());
+        Diags.diagnose(SourceLocation(), diag::lex_invalid_character);
+    }
+    Diags.warning(SourceLocation(), "suppressed too");
+
+    ASSERT_EQ(4u, Captured->Diagnostics.size());
+    EXPECT_EQ(DiagID::error_limit_reached, Captured->Diagnostics[3].ID);
+    EXPECT_EQ("too many errors emitted, stopping now", Captured->Diagnostics[3].Message);
+    EXPECT_TRUE(Diags.hasReachedErrorLimit());
+    EXPECT_EQ(3u, Diags.getSuppressedCount());
+}
+
+TEST_F(DiagnosticEngineTest, AdjacentDiagnosticsCollapse) {
+    DiagnosticLimits Limits;
+    Limits.CollapseAdjacent = true;
+    Diags.setLimits(Limits);
+
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(std::string(100, ' '), "runs.swift");
+    const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferID);
+    for (int I = 0; I != 4; ++I)
+        Diags.diagnose(Loc.getAdvancedLoc(I), diag::lex_nul_character);
+    // Too far from the run to continue it.
+    Diags.diagnose(Loc.getAdvancedLoc(20), diag::lex_nul_character);
+    // Diagnostics with arguments never collapse.
+    const llvm::StringRef Digit = SourceMgr.getBufferContent(BufferID).substr(30, 1);
+    Diags.diagnose(Loc.getAdvancedLoc(30), diag::lex_invalid_digit_in_int_literal, Digit);
+    Diags.diagnose(Loc.getAdvancedLoc(31), diag::lex_invalid_digit_in_int_literal, Digit);
+    Diags.diagnose(Loc.getAdvancedLoc(40), diag::lex_invalid_character);
+    EXPECT_EQ(4u, Captured->Diagnostics.size());
+    Diags.flush();
+
+    ASSERT_EQ(5u, Captured->Diagnostics.size());
+    EXPECT_EQ(Loc, Captured->Diagnostics[0].Location);
+    EXPECT_EQ(Loc.getAdvancedLoc(3), Captured->Diagnostics[0].LastLocation);
+    EXPECT_EQ(4u, Captured->Diagnostics[0].Count);
+    EXPECT_EQ(1u, Captured->Diagnostics[1].Count);
+    EXPECT_EQ(DiagID::lex_invalid_digit_in_int_literal, Captured->Diagnostics[3].ID);
+    EXPECT_EQ(DiagID::lex_invalid_character, Captured->Diagnostics[4].ID);
+    EXPECT_EQ(5u, Diags.getErrorCount());
+}
+
+TEST_F(DiagnosticEngineTest, ConcurrentDiagnosticsMergeInOrder) {
+    std::vector<unsigned> BufferIDs;
+    for (int I = 0; I != 8; ++I)
+        BufferIDs.push_back(SourceMgr.addMemBufferCopy(std::string(64, ' '), "concurrent" + std::to_string(I) + ".swift"));
+
+    auto Run = [&](unsigned Threads) {
+        Captured->Diagnostics.clear();
+        const unsigned ErrorsBefore = Diags.getErrorCount();
+        Diags.beginConcurrentDiagnostics();
+        std::vector<std::thread> Workers;
+        for (unsigned T = 0; T != Threads; ++T) {
+            Workers.emplace_back([&, T] {
+                for (size_t B = T; B < BufferIDs.size(); B += Threads) {
+                    const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferIDs[B]);
+                    // Out of order within the buffer, with a note that stays
+                    // with its error.
+                    Diags.diagnose(Loc.getAdvancedLoc(40), diag::lex_unterminated_block_comment);
+                    Diags.diagnose(Loc, diag::lex_comment_start);
+                    Diags.diagnose(Loc.getAdvancedLoc(8), diag::lex_invalid_character);
+                    Diags.warning(Loc.getAdvancedLoc(8), "same place");
+                }
+            });
+        }
+        for (std::thread &Worker : Workers)
+            Worker.join();
+        EXPECT_TRUE(Captured->Diagnostics.empty());
+        EXPECT_EQ(ErrorsBefore + 2 * BufferIDs.size(), Diags.getErrorCount());
+        Diags.mergeConcurrentDiagnostics();
+
+        std::vector<std::pair<SourceLocation, DiagID>> Merged;
+        for (const Diagnostic &Diag : Captured->Diagnostics)
+            Merged.emplace_back(Diag.Location, Diag.ID);
+        return Merged;
+    };
+
+    const auto Serial = Run(1);
+    ASSERT_EQ(4 * BufferIDs.size(), Serial.size());
+    const SourceLocation First = SourceMgr.getLocForBufferStart(BufferIDs[0]);
+    EXPECT_EQ(std::make_pair(First.getAdvancedLoc(8), DiagID::warning_message), Serial[0]);
+    EXPECT_EQ(std::make_pair(First.getAdvancedLoc(8), DiagID::lex_invalid_character), Serial[1]);
+    EXPECT_EQ(std::make_pair(First.getAdvancedLoc(40), DiagID::lex_unterminated_block_comment), Serial[2]);
+    EXPECT_EQ(std::make_pair(First, DiagID::lex_comment_start), Serial[3]);
+    for (unsigned Threads : {2u, 3u, 8u})
+        EXPECT_EQ(Serial, Run(Threads)) << Threads << " threads";
+    EXPECT_FALSE(Diags.isConcurrent());
+}
+
+TEST_F(DiagnosticEngineTest, ConcurrentFloodIsCappedPerBuffer) {
+    DiagnosticLimits Limits;
+    Limits.MaxPerKind = 3;
+    Diags.setLimits(Limits);
+    std::vector<unsigned> BufferIDs;
+    for (int I = 0; I != 4; ++I)
+        BufferIDs.push_back(SourceMgr.addMemBufferCopy(std::string(256, ' '), "flood" + std::to_string(I) + ".swift"));
+
+    Diags.beginConcurrentDiagnostics();
+    std::vector<std::thread> Workers;
+    for (unsigned T = 0; T != 2; ++T) {
+        Workers.emplace_back([&, T] {
+            for (size_t B = T; B < BufferIDs.size(); B += 2) {
+                const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferIDs[B]);
+                for (int I = 0; I != 100; ++I) {
+                    Diags.diagnose(Loc.getAdvancedLoc(2 * I), diag::lex_unterminated_block_comment);
+                    Diags.diagnose(Loc.getAdvancedLoc(2 * I), diag::lex_comment_start);
+                }
+            }
+        });
+    }
+    for (std::thread &Worker : Workers)
+        Worker.join();
+    // Only what the merge could report was kept.
+    EXPECT_EQ(3 * BufferIDs.size(), Diags.getErrorCount());
+    EXPECT_EQ(6 * BufferIDs.size(), Diags.getTotalDiagnosticCount());
+    Diags.mergeConcurrentDiagnostics();
+
+    // The first three errors and notes of the first buffer, each kind
+    // followed by its limit.
+    ASSERT_EQ(8u, Captured->Diagnostics.size());
+    const SourceLocation First = SourceMgr.getLocForBufferStart(BufferIDs[0]);
+    EXPECT_EQ(First.getAdvancedLoc(4), Captured->Diagnostics[4].Location);
+    EXPECT_EQ(DiagID::diagnostic_kind_limit_reached, Captured->Diagnostics[5].ID);
+    EXPECT_EQ(DiagID::lex_comment_start, Captured->Diagnostics[6].ID);
+    EXPECT_EQ(DiagID::diagnostic_kind_limit_reached, Captured->Diagnostics[7].ID);
+    EXPECT_EQ(3u, Diags.getErrorCount());
+    EXPECT_EQ(2 * 100 * BufferIDs.size() - 6, Diags.getSuppressedCount());
+}
+
+TEST_F(DiagnosticEngineTest, MergePassesDiagnosticsInOneBatch) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(std::string(16, ' '), "batch.swift");
+    const SourceLocation Loc = SourceMgr.getLocForBufferStart(BufferID);
+    Diags.diagnose(Loc, diag::lex_invalid_character);
+
+    Diags.beginConcurrentDiagnostics();
+    std::thread Worker([&] {
+        for (int I = 3; I != 0; --I)
+            Diags.diagnose(Loc.getAdvancedLoc(2 * I), diag::lex_nul_character);
+    });
+    Worker.join();
+    EXPECT_EQ(1u, Captured->Diagnostics.size());
+    Diags.mergeConcurrentDiagnostics();
+
+    ASSERT_EQ(4u, Captured->Diagnostics.size());
+    EXPECT_EQ(1u, Captured->Batches);
+    EXPECT_EQ(Loc.getAdvancedLoc(2), Captured->Diagnostics[1].Location);
+    EXPECT_EQ(Loc.getAdvancedLoc(6), Captured->Diagnostics[3].Location);
+
+    EXPECT_FALSE(Captured->Finished);
+    Diags.finishProcessing();
+    EXPECT_TRUE(Captured->Finished);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <swift/Lexer/IncrementalLexer.h>
+#include <swift/Source/SourceManager.h>
+
+#include <random>
+
+using namespace swift;
+
+class IncrementalLexerTest : public ::testing::Test {
+public:
+    LangOptions LangOpts;
+    SourceManager SourceMgr;
+
+    /// Checks the incremental tokens against lexing the current text from
+    /// scratch.
+    void expectMatchesFullLex(const IncrementalLexer &Incremental, CommentRetentionMode Mode) {
+        Lexer L(LangOpts, SourceMgr, Incremental.getBufferID(), /*Diags=*/nullptr, LexerMode::Swift,
+                HashbangMode::Allowed, Mode);
+        std::vector<Token> Expected;
+        Token Tok;
+        for (L.lex(Tok); Tok.isNot(tok::eof); L.lex(Tok))
+            Expected.push_back(Tok);
+
+        llvm::ArrayRef<Token> Actual = Incremental.getTokens();
+        ASSERT_EQ(Expected.size(), Actual.size()) << Incremental.getBufferText().str();
+        for (size_t I = 0; I != Expected.size(); ++I) {
+            ASSERT_EQ(Expected[I].getKind(), Actual[I].getKind()) << "i = " << I;
+            ASSERT_EQ(Expected[I].getRawText().data(), Actual[I].getRawText().data()) << "i = " << I;
+            ASSERT_EQ(Expected[I].getRawText().size(), Actual[I].getRawText().size()) << "i = " << I;
+            ASSERT_EQ(Expected[I].isAtStartOfLine(), Actual[I].isAtStartOfLine()) << "i = " << I;
+            ASSERT_EQ(Expected[I].getCommentLength(), Actual[I].getCommentLength()) << "i = " << I;
+            ASSERT_EQ(Expected[I].isMultilineString(), Actual[I].isMultilineString()) << "i = " << I;
+        }
+    }
+};
+
+TEST_F(IncrementalLexerTest, EditWithinLine) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy("let a = 1\nlet b = 2\nlet c = 3\n",
+                                                         "source.swift");
+    IncrementalLexer Incremental(LangOpts, SourceMgr, BufferID);
+    ASSERT_EQ(12u, Incremental.getTokens().size());
+
+    // "b" -> "bee": lexing restarts at the last token of the line before and
+    // stops at the "=" after the edit.
+    IncrementalLexer::EditResult Result = Incremental.applyEdit(14, 1, "bee");
+    EXPECT_EQ("let a = 1\nlet bee = 2\nlet c = 3\n", Incremental.getBufferText());
+    EXPECT_EQ(3u, Result.FirstToken);
+    EXPECT_EQ(3u, Result.RemovedTokens);
+    EXPECT_EQ(3u, Result.InsertedTokens);
+    EXPECT_EQ("bee", Incremental.getTokens()[5].getText());
+    expectMatchesFullLex(Incremental, CommentRetentionMode::ReturnAsTokens);
+}
+
+TEST_F(IncrementalLexerTest, EditChangesLexingDownstream) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy("let a = 1\nlet b = 2\nlet c = 3\n",
+                                                         "source.swift");
+    IncrementalLexer Incremental(LangOpts, SourceMgr, BufferID);
+
+    // Opening a block comment swallows the rest of the file...
+    IncrementalLexer::EditResult Result = Incremental.applyEdit(10, 0, "/* ");
+    EXPECT_EQ(5u, Incremental.getTokens().size());
+    EXPECT_EQ(Incremental.getTokens().size(), Result.FirstToken + Result.InsertedTokens);
+    expectMatchesFullLex(Incremental, CommentRetentionMode::ReturnAsTokens);
+
+    // ...and closing it brings the tokens back.
+    Incremental.applyEdit(22, 0, " */");
+    EXPECT_EQ("let a = 1\n/* let b = 2 */\nlet c = 3\n", Incremental.getBufferText());
+    EXPECT_EQ(9u, Incremental.getTokens().size());
+    expectMatchesFullLex(Incremental, CommentRetentionMode::ReturnAsTokens);
+
+    // The same for a multi-line string.
+    Incremental.applyEdit(0, 0, "let s = \"\"\"\n");
+    expectMatchesFullLex(Incremental, CommentRetentionMode::ReturnAsTokens);
+    Incremental.applyEdit(Incremental.getBufferText().size(), 0, "\"\"\"\n");
+    expectMatchesFullLex(Incremental, CommentRetentionMode::ReturnAsTokens);
+}
+
+TEST_F(IncrementalLexerTest, TwoLexersOnOneBuffer) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy("let a = 1\n", "shared.swift");
+    IncrementalLexer First(LangOpts, SourceMgr, BufferID);
+    IncrementalLexer Second(LangOpts, SourceMgr, BufferID);
+
+    First.applyEdit(4, 1, "first");
+    Second.applyEdit(4, 1, "second");
+    EXPECT_NE(First.getBufferID(), Second.getBufferID());
+    EXPECT_EQ("let first = 1\n", First.getBufferText());
+    EXPECT_EQ("let second = 1\n", Second.getBufferText());
+    expectMatchesFullLex(First, CommentRetentionMode::ReturnAsTokens);
+    expectMatchesFullLex(Second, CommentRetentionMode::ReturnAsTokens);
+
+    // Each edit frees the revision it replaces; the original stays.
+    const std::string Superseded = SourceMgr.getMemoryBuffer(First.getBufferID())->getBufferIdentifier().str();
+    First.applyEdit(4, 5, "third");
+    EXPECT_FALSE(SourceMgr.getIDForBufferIdentifier(Superseded).has_value());
+    EXPECT_EQ("let third = 1\n", First.getBufferText());
+    EXPECT_EQ("let second = 1\n", Second.getBufferText());
+    EXPECT_EQ("let a = 1\n", SourceMgr.getBufferContent(BufferID));
+    expectMatchesFullLex(First, CommentRetentionMode::ReturnAsTokens);
+}
+
+TEST_F(IncrementalLexerTest, RandomEdits) {
+    const char *Snippets[] = {"/*", "*/", "\"", "\"\"\"\n", "//", "\n", " ", "x", "1.", "5",
+                              "+", "(", ")", "\\(", "#", "`", "let ", "\t", "\"\"\""};
+    std::string Source;
+    for (unsigned I = 0; I != 20; ++I)
+        Source += "/* c */ let v" + std::to_string(I) + " = \"s \\(x)\" + 1.5 // t\n"
+                  "let m = \"\"\"\n  line\n  \"\"\"\n";
+
+    for (CommentRetentionMode Mode : {CommentRetentionMode::ReturnAsTokens,
+                                      CommentRetentionMode::AttachToNextToken,
+                                      CommentRetentionMode::None}) {
+        const unsigned BufferID = SourceMgr.addMemBufferCopy(
+            Source, "random" + std::to_string(static_cast<int>(Mode)) + ".swift");
+        IncrementalLexer Incremental(LangOpts, SourceMgr, BufferID, Mode);
+        std::mt19937 Random(42);
+        for (unsigned Edit = 0; Edit != 300; ++Edit) {
+            unsigned Size = Incremental.getBufferText().size();
+            unsigned Offset = Random() % (Size + 1);
+            unsigned Removed = std::min<unsigned>(Random() % 4, Size - Offset);
+            const char *Inserted = Random() % 3 ? Snippets[Random() % std::size(Snippets)] : "";
+            Incremental.applyEdit(Offset, Removed, Inserted);
+            expectMatchesFullLex(Incremental, Mode);
+            if (HasFatalFailure()) {
+                ADD_FAILURE() << "edit " << Edit << ": " << Offset << ", " << Removed << ", \""
+                              << Inserted << "\"";
+                return;
+            }
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <swift/Lexer/Lexer.h>
 #include <swift/Lexer/Token.h>
+#include <swift/Source/ByteScan.h>
 #include <swift/Source/SourceManager.h>
 #include <swift/Diagnostic/DiagnosticEngine.h>
 #include "llvm/Support/MemoryBuffer.h"
@@ -74,6 +75,455 @@ TEST_F(LexerTest, EOFTokenLengthIsZero) {
     EXPECT_EQ(Toks[1].getLength(), 0U);
 }
 
+TEST_F(LexerTest, LastTokenEndsAtBufferEnd) {
+    std::vector<Token> Toks = checkLex("x = 42", {tok::identifier, tok::equal, tok::integer_literal, tok::eof},
+                                       /*KeepComments=*/false, /*KeepEOF=*/true);
+    EXPECT_EQ("42", Toks[2].getText());
+}
+
+TEST_F(LexerTest, LexersOnDifferentBuffersAreIndependent) {
+    const unsigned First = SourceMgr.addMemBufferCopy("let first = 1", "first.swift");
+    const unsigned Second = SourceMgr.addMemBufferCopy("var second = 22", "second.swift");
+    Lexer L1(LangOpts, SourceMgr, First, /*Diags=*/nullptr, LexerMode::Swift);
+    Lexer L2(LangOpts, SourceMgr, Second, /*Diags=*/nullptr, LexerMode::Swift);
+
+    const char *FirstTexts[] = {"let", "first", "=", "1", ""};
+    const char *SecondTexts[] = {"var", "second", "=", "22", ""};
+    Token Tok1, Tok2;
+    for (unsigned I = 0; I != 5; ++I) {
+        L1.lex(Tok1);
+        L2.lex(Tok2);
+        EXPECT_EQ(FirstTexts[I], Tok1.getText()) << "i = " << I;
+        EXPECT_EQ(SecondTexts[I], Tok2.getText()) << "i = " << I;
+    }
+    EXPECT_TRUE(Tok1.is(tok::eof));
+    EXPECT_TRUE(Tok2.is(tok::eof));
+}
+
+TEST_F(LexerTest, KindOfIdentifier) {
+#define SIL_KEYWORD(kw)
+#define KEYWORD(kw) \
+    EXPECT_EQ(tok::kw_##kw, Lexer::kindOfIdentifier(#kw, false)) << #kw; \
+    EXPECT_EQ(tok::kw_##kw, Lexer::kindOfIdentifier(#kw, true)) << #kw;
+#include "swift/Lexer/TokenKinds.def"
+
+    // SIL keywords are only recognized in SIL mode.
+#define SIL_KEYWORD(kw) \
+    EXPECT_EQ(tok::identifier, Lexer::kindOfIdentifier(#kw, false)) << #kw; \
+    EXPECT_EQ(tok::kw_##kw, Lexer::kindOfIdentifier(#kw, true)) << #kw;
+#include "swift/Lexer/TokenKinds.def"
+
+    for (const char *Ident : {"", "x", "le", "lets", "Let", "selfs", "sil_", "sil_stag",
+                              "__", "inouts", "sil_default_override_tables"}) {
+        EXPECT_EQ(tok::identifier, Lexer::kindOfIdentifier(Ident, false)) << Ident;
+        EXPECT_EQ(tok::identifier, Lexer::kindOfIdentifier(Ident, true)) << Ident;
+    }
+}
+
+TEST_F(LexerTest, EveryLeadByte) {
+    // The first token of a buffer holding just the byte. Whitespace, control
+    // characters, an embedded NUL and bytes that are not valid UTF-8 on their
+    // own are all trivia, leaving only the end of the buffer.
+    std::array<tok, 256> Expected;
+    Expected.fill(tok::eof);
+    auto expect = [&](llvm::StringRef Bytes, tok Kind) {
+        for (char C : Bytes)
+            Expected[(unsigned char)C] = Kind;
+    };
+    expect("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ$", tok::identifier);
+    expect("_", tok::kw__);
+    expect("0123456789", tok::integer_literal);
+    expect("!%&*+-/<>^|~", tok::oper_binary_spaced);
+    expect("=", tok::equal);
+    expect(".", tok::period);
+    expect("?", tok::question_infix);
+    expect("'\"", tok::unknown);
+    expect("#", tok::pound);
+    expect("`", tok::backtick);
+    expect("@", tok::at_sign);
+    expect("{", tok::l_brace);
+    expect("[", tok::l_square);
+    expect("(", tok::l_paren);
+    expect("}", tok::r_brace);
+    expect("]", tok::r_square);
+    expect(")", tok::r_paren);
+    expect(",", tok::comma);
+    expect(";", tok::semi);
+    expect(":", tok::colon);
+    expect("\\", tok::backslash);
+    expect("\xFE\xFF", tok::unknown);
+
+    for (unsigned Byte = 0; Byte != 256; ++Byte) {
+        const unsigned BufferID = SourceMgr.addMemBufferCopy(std::string(1, char(Byte)),
+                                                             "byte" + std::to_string(Byte) + ".swift");
+        Lexer L(LangOpts, SourceMgr, BufferID, /*Diags=*/nullptr, LexerMode::Swift);
+        Token Tok;
+        L.lex(Tok);
+        EXPECT_EQ(Expected[Byte], Tok.getKind()) << "byte " << Byte;
+        EXPECT_EQ(Expected[Byte] == tok::eof ? 0u : 1u, Tok.getLength()) << "byte " << Byte;
+    }
+
+    // Valid multi-byte sequences start identifiers and operators.
+    const std::pair<const char *, tok> Sequences[] = {
+        {"\xC3\xA9", tok::identifier},            // U+00E9
+        {"\xE2\x86\x92", tok::oper_binary_spaced}, // U+2192
+        {"\xF0\x9F\x98\x80", tok::identifier},    // U+1F600
+    };
+    for (const auto &[Text, Kind] : Sequences) {
+        const unsigned BufferID = SourceMgr.addMemBufferCopy(Text, Text);
+        Lexer L(LangOpts, SourceMgr, BufferID, /*Diags=*/nullptr, LexerMode::Swift);
+        Token Tok;
+        L.lex(Tok);
+        EXPECT_EQ(Kind, Tok.getKind()) << Text;
+        EXPECT_EQ(Text, Tok.getText());
+    }
+}
+
+TEST_F(LexerTest, LongWhitespaceRuns) {
+    // Runs longer than a vector block, newlines at every position in a block,
+    // and whitespace that ends right before the scalar-only trivia characters.
+    std::string Source = "a" + std::string(40, ' ') + "b";
+    Source += std::string(37, '\t') + "\r\n" + std::string(20, ' ') + "c";
+    Source += "\v\f \t" + std::string(33, ' ') + "d /* x */" + std::string(50, ' ') + "e";
+    Source += std::string(31, ' ') + "\n" + std::string(64, ' ') + "// y\n" + std::string(17, ' ') + "f";
+    Source += std::string(16, ' ') + "\r" + std::string(15, ' ');
+
+    const std::vector<tok> ExpectedTokens = {
+        tok::identifier, tok::identifier, tok::identifier, tok::identifier,
+        tok::identifier, tok::identifier, tok::eof
+    };
+    std::vector<Token> Toks = checkLex(Source, ExpectedTokens, false, true);
+    const bool AtStartOfLine[] = {true, false, true, false, false, true, true};
+    for (unsigned I = 0; I != ExpectedTokens.size(); ++I)
+        EXPECT_EQ(AtStartOfLine[I], Toks[I].isAtStartOfLine()) << "i = " << I;
+    EXPECT_EQ("f", Toks[5].getText());
+}
+
+TEST_F(LexerTest, LongAndUnicodeIdentifiers) {
+    // Identifiers longer than a vector block, ending on a block boundary, and
+    // with non-ASCII characters at the start, in the middle and at the end.
+    const std::string Long = "value$" + std::string(40, 'x') + "_9";
+    const std::string Sixteen = "abcdefghijklmnop";
+    const std::string Middle = "caf\xC3\xA9_" + std::string(20, 'b');
+    const std::string Start = "\xC3\xA9t\xC3\xA9";
+    const std::string End = std::string(17, 'c') + "\xCE\xB1";
+    std::string Source = Long + " " + Sixteen + "+" + Middle + " " + Start + "." + End + "\n";
+
+    const std::vector<tok> ExpectedTokens = {
+        tok::identifier, tok::identifier, tok::oper_binary_unspaced, tok::identifier,
+        tok::identifier, tok::period, tok::identifier, tok::eof
+    };
+    std::vector<Token> Toks = checkLex(Source, ExpectedTokens, false, true);
+    EXPECT_EQ(Long, Toks[0].getText());
+    EXPECT_EQ(Sixteen, Toks[1].getText());
+    EXPECT_EQ(Middle, Toks[3].getText());
+    EXPECT_EQ(Start, Toks[4].getText());
+    EXPECT_EQ(End, Toks[6].getText());
+}
+
+TEST_F(LexerTest, UnicodeIdentifiersAndOperators) {
+    // Greek letters, an emoji identifier, operators from the math and arrow
+    // blocks, and an operator continued by a variation selector.
+    std::string Source = "\xCE\xB1 \xE2\x88\x98 \xCE\xB2\n"        // α ∘ β
+                         "\xF0\x9F\x98\x80 \xE2\x86\x92 x\n"       // 😀 → x
+                         "a \xE2\x8A\x95\xEF\xB8\x8E b\n";          // a ⊕︎ b
+
+    const std::vector<tok> ExpectedTokens = {
+        tok::identifier, tok::oper_binary_spaced, tok::identifier,
+        tok::identifier, tok::oper_binary_spaced, tok::identifier,
+        tok::identifier, tok::oper_binary_spaced, tok::identifier, tok::eof
+    };
+    std::vector<Token> Toks = checkLex(Source, ExpectedTokens, false, true);
+    EXPECT_EQ("\xF0\x9F\x98\x80", Toks[3].getText());
+    EXPECT_EQ("\xE2\x8A\x95\xEF\xB8\x8E", Toks[7].getText());
+}
+
+TEST_F(LexerTest, RecordsStringInterpolations) {
+    const char *Source = "\"a\\(b)c\\((d))\" \"plain\" \"\\(\"e\\(f)\")\"";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+
+    StringSegmentTable Table(SourceMgr, BufferID);
+    Lexer L(LangOpts, SourceMgr, BufferID, /*Diags=*/nullptr, LexerMode::Swift);
+    L.setStringSegmentTable(&Table);
+    L.resetToOffset(0);
+    Token Tok;
+    do
+        L.lex(Tok);
+    while (Tok.isNot(tok::eof));
+
+    // The nested literal is only lexed when the outer expression is.
+    ASSERT_EQ(3u, Table.size());
+    auto First = Table.lookup(0);
+    ASSERT_TRUE(First);
+    ASSERT_EQ(2u, First->size());
+    EXPECT_EQ(3u, (*First)[0].Begin);
+    EXPECT_EQ(6u, (*First)[0].End);
+    EXPECT_EQ(8u, (*First)[1].Begin);
+    EXPECT_EQ(13u, (*First)[1].End);
+    ASSERT_TRUE(Table.lookup(15));
+    EXPECT_TRUE(Table.lookup(15)->empty());
+    EXPECT_EQ(1u, Table.lookup(23)->size());
+    EXPECT_FALSE(Table.lookup(26));
+
+    // Lexing the expression records the literal nested in it.
+    Lexer::SubrangeState Saved = L.beginSubrange(25, 33);
+    do
+        L.lex(Tok);
+    while (Tok.isNot(tok::eof));
+    L.endSubrange(std::move(Saved));
+    EXPECT_EQ(4u, Table.size());
+    ASSERT_TRUE(Table.lookup(26));
+    ASSERT_EQ(1u, Table.lookup(26)->size());
+    EXPECT_EQ(29u, (*Table.lookup(26))[0].Begin);
+}
+
+TEST_F(LexerTest, StringLiteralSegmentsFromTable) {
+    const char *Source = "\"a\\(b)c\\((d))\" #\"x\\#(y)\\(z)\"# \"\"\"\n  p\\(q)\n  \"\"\"";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+
+    StringSegmentTable Table(SourceMgr, BufferID);
+    Lexer L(LangOpts, SourceMgr, BufferID, /*Diags=*/nullptr, LexerMode::Swift);
+    L.setStringSegmentTable(&Table);
+    L.resetToOffset(0);
+    unsigned Literals = 0;
+    Token Tok;
+    for (L.lex(Tok); Tok.isNot(tok::eof); L.lex(Tok)) {
+        ASSERT_EQ(tok::string_literal, Tok.getKind());
+        ++Literals;
+        llvm::SmallVector<Lexer::StringSegment, 4> Scanned, Recorded;
+        Lexer::getStringLiteralSegments(Tok, Scanned, /*Diags=*/nullptr);
+        Lexer::getStringLiteralSegments(Tok, Recorded, /*Diags=*/nullptr, &Table);
+        ASSERT_EQ(Scanned.size(), Recorded.size());
+        for (size_t I = 0; I != Scanned.size(); ++I) {
+            EXPECT_EQ(Scanned[I].Kind, Recorded[I].Kind) << "i = " << I;
+            EXPECT_EQ(Scanned[I].Loc, Recorded[I].Loc) << "i = " << I;
+            EXPECT_EQ(Scanned[I].Length, Recorded[I].Length) << "i = " << I;
+            EXPECT_EQ(Scanned[I].IndentToStrip, Recorded[I].IndentToStrip) << "i = " << I;
+            EXPECT_EQ(Scanned[I].CustomDelimiterLen, Recorded[I].CustomDelimiterLen) << "i = " << I;
+            EXPECT_EQ(Scanned[I].IsFirstSegment, Recorded[I].IsFirstSegment) << "i = " << I;
+            EXPECT_EQ(Scanned[I].IsLastSegment, Recorded[I].IsLastSegment) << "i = " << I;
+        }
+    }
+    EXPECT_EQ(3u, Literals);
+}
+
+TEST_F(LexerTest, LocForStartOfTokenInInterpolation) {
+    const char *Source = "let s = \"a \\(foo + \"\\(bar)\") b\"";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+    llvm::StringRef Text = SourceMgr.getBufferContent(BufferID);
+
+    auto startOf = [&](llvm::StringRef Needle, unsigned Delta) {
+        unsigned Offset = Text.find(Needle) + Delta;
+        return SourceMgr.getLocOffsetInBuffer(
+            Lexer::getLocForStartOfToken(SourceMgr, BufferID, Offset), BufferID);
+    };
+    EXPECT_EQ(Text.find("foo"), startOf("foo", 2));
+    EXPECT_EQ(Text.find("bar"), startOf("bar", 1));
+    EXPECT_EQ(Text.find("\"a"), startOf("a ", 0));
+    EXPECT_EQ(Text.find("let"), startOf("let", 2));
+}
+
+TEST(ByteScanTest, SkipIdentifierBodyStopsAtOtherBytes) {
+    for (unsigned C = 0; C != 256; ++C) {
+        const bool IsBody = isAsciiIdentifierContinue(C, /*AllowDollar=*/true);
+        for (unsigned Length : {0u, 5u, 16u, 31u, 40u}) {
+            std::string Text = std::string(Length, 'a') + char(C) + "zz";
+            const char *End = Text.data() + Text.size();
+            const char *Stop = bytescan::skipIdentifierBody(Text.data(), End);
+            EXPECT_EQ(IsBody ? End : Text.data() + Length, Stop) << "byte " << C << " after " << Length;
+        }
+    }
+}
+
+TEST(ByteScanTest, SkipWhitespaceMatchesScalar) {
+    const std::string Pattern = " \t\n \v\f\r  x";
+    for (unsigned Length = 0; Length != 80; ++Length) {
+        for (unsigned Stop = 0; Stop <= Length; ++Stop) {
+            std::string Buffer(Length, ' ');
+            for (unsigned I = 0; I != Length; ++I)
+                Buffer[I] = Pattern[(I * 7 + Length) % (Pattern.size() - 1)];
+            if (Stop != Length)
+                Buffer[Stop] = 'x';
+
+            bool ExpectedNewline = false;
+            unsigned Expected = 0;
+            for (; Expected != Length && isWhitespace(Buffer[Expected]); ++Expected)
+                ExpectedNewline |= Buffer[Expected] == '\n' || Buffer[Expected] == '\r';
+
+            bool SawNewline = false;
+            const char *End = Buffer.data() + Length;
+            EXPECT_EQ(Buffer.data() + Expected, bytescan::skipWhitespace(Buffer.data(), End, SawNewline))
+                << "length " << Length << ", stop " << Stop;
+            EXPECT_EQ(ExpectedNewline, SawNewline) << "length " << Length << ", stop " << Stop;
+        }
+    }
+}
+
+TEST(ByteScanTest, CommentBodiesStopAtSpecialBytes) {
+    for (char Special : {'\n', '\r', '*', '/', '\0', '\x80', '\xC3', '\xFF'}) {
+        for (unsigned Length = 1; Length != 70; ++Length) {
+            for (unsigned Stop = 0; Stop != Length; ++Stop) {
+                std::string Buffer(Length, 'a');
+                Buffer[Stop] = Special;
+                const char *Begin = Buffer.data(), *End = Begin + Length;
+                bool LineStop = Special != '*' && Special != '/';
+                EXPECT_EQ(LineStop ? Begin + Stop : End, bytescan::skipLineCommentBody(Begin, End));
+                EXPECT_EQ(Begin + Stop, bytescan::skipBlockCommentBody(Begin, End));
+            }
+        }
+    }
+}
+
+TEST_F(LexerTest, LongNestedBlockComments) {
+    std::string Body(45, 'x');
+    std::string Source = "a /*" + Body + "/*" + Body + "*" + Body + "*/" + Body + "*/ b";
+    Source += " /*" + Body + "\n" + Body + "*/ c // " + Body + "*/" + Body + "\r\nd\n";
+
+    const std::vector<tok> ExpectedTokens = {
+        tok::identifier, tok::identifier, tok::identifier, tok::identifier, tok::eof
+    };
+    std::vector<Token> Toks = checkLex(Source, ExpectedTokens, false, true);
+    EXPECT_EQ("b", Toks[1].getText());
+    EXPECT_FALSE(Toks[1].isAtStartOfLine());
+    EXPECT_TRUE(Toks[2].isAtStartOfLine());
+    EXPECT_TRUE(Toks[3].isAtStartOfLine());
+}
+
+namespace {
+    /// Records the message of every diagnostic.
+    class CapturingDiagnosticConsumer : public DiagnosticConsumer {
+    public:
+        std::vector<std::string> Messages;
+
+        void handleDiagnostic(const Diagnostic &Diag, const SourceManager &) override {
+            Messages.push_back(Diag.Message);
+        }
+    };
+} // end anonymous namespace
+
+TEST_F(LexerTest, CommentDiagnosticsInLongComments) {
+    std::string Padding(40, ' ');
+    std::string Source = "//" + Padding + "\xFF" + Padding + "\n/*" + Padding;
+    Source += std::string("\0", 1) + Padding + "\xC3\xA9" + Padding + "\xC3*/ x\n";
+
+    DiagnosticEngine Diags(SourceMgr);
+    auto Consumer = std::make_unique<CapturingDiagnosticConsumer>();
+    CapturingDiagnosticConsumer *Captured = Consumer.get();
+    Diags.addConsumer(std::move(Consumer));
+
+    unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "comments.swift");
+    Lexer L(LangOpts, SourceMgr, BufferID, &Diags, LexerMode::Swift);
+    Token Tok;
+    L.lex(Tok);
+    EXPECT_EQ(tok::identifier, Tok.getKind());
+    L.lex(Tok);
+    EXPECT_EQ(tok::eof, Tok.getKind());
+
+    const std::vector<std::string> Expected = {
+        "invalid UTF-8", "nul character embedded in source file", "invalid UTF-8"
+    };
+    EXPECT_EQ(Expected, Captured->Messages);
+}
+
+TEST_F(LexerTest, ValidUTF8SkipsPerCharacterValidation) {
+    std::string Padding(20, ' ');
+    std::string Source = "// r\xC3\xA9sum\xC3\xA9" + Padding + "\xF0\x9F\x98\x80\n/* \xE2\x82\xAC" + Padding;
+    Source += "*/ \"\xC3\xA9\xE2\x82\xAC\" \"\xF0\x9F\x98\x80\"\n";
+
+    DiagnosticEngine Diags(SourceMgr);
+    auto Consumer = std::make_unique<CapturingDiagnosticConsumer>();
+    CapturingDiagnosticConsumer *Captured = Consumer.get();
+    Diags.addConsumer(std::move(Consumer));
+
+    unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "valid.swift");
+    ASSERT_TRUE(SourceMgr.getBufferTextInfo(BufferID).isValidUTF8());
+    Lexer L(LangOpts, SourceMgr, BufferID, &Diags, LexerMode::Swift);
+    Token Tok;
+    for (tok Expected : {tok::string_literal, tok::string_literal, tok::eof}) {
+        L.lex(Tok);
+        EXPECT_EQ(Expected, Tok.getKind());
+    }
+    EXPECT_TRUE(Captured->Messages.empty());
+}
+
+TEST_F(LexerTest, OnlyInvalidRangesAreValidated) {
+    // One bad byte, in the middle comment, among valid text on both sides
+    // and in the same comment.
+    std::string Source = "// r\xC3\xA9sum\xC3\xA9\n/* \xE2\x82\xAC \xFF \xC3\xA9 */ \"\xF0\x9F\x98\x80\"\n// \xE2\x82\xAC\n";
+
+    DiagnosticEngine Diags(SourceMgr);
+    auto Consumer = std::make_unique<CapturingDiagnosticConsumer>();
+    CapturingDiagnosticConsumer *Captured = Consumer.get();
+    Diags.addConsumer(std::move(Consumer));
+
+    unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "invalid.swift");
+    ASSERT_EQ(1u, SourceMgr.getBufferTextInfo(BufferID).InvalidRanges.size());
+    Lexer L(LangOpts, SourceMgr, BufferID, &Diags, LexerMode::Swift);
+    Token Tok;
+    for (tok Expected : {tok::string_literal, tok::eof}) {
+        L.lex(Tok);
+        EXPECT_EQ(Expected, Tok.getKind());
+    }
+    const std::vector<std::string> Expected = {"invalid UTF-8"};
+    EXPECT_EQ(Expected, Captured->Messages);
+}
+
+TEST_F(LexerTest, QueuedDiagnosticsAreEmittedWhenTokenIsConsumed) {
+    DiagnosticEngine Diags(SourceMgr);
+    auto Consumer = std::make_unique<CapturingDiagnosticConsumer>();
+    CapturingDiagnosticConsumer *Captured = Consumer.get();
+    Diags.addConsumer(std::move(Consumer));
+
+    unsigned BufferID = SourceMgr.addMemBufferCopy("let x = 0x1g + 1\n", "queued.swift");
+    Lexer L(LangOpts, SourceMgr, BufferID, &Diags, LexerMode::Swift);
+    Token Tok;
+    L.lex(Tok);
+    L.lex(Tok);
+    ASSERT_EQ("x", Tok.getText());
+    const LexerState AtX = L.getStateForBeginningOfToken(Tok);
+
+    // The literal has been lexed ahead, but its error waits until it is
+    // returned, and backtracking drops it.
+    L.lex(Tok);
+    ASSERT_EQ(tok::equal, Tok.getKind());
+    EXPECT_TRUE(Captured->Messages.empty());
+    L.restoreState(AtX);
+    L.lex(Tok);
+    L.lex(Tok);
+    EXPECT_TRUE(Captured->Messages.empty());
+
+    L.lex(Tok);
+    EXPECT_EQ("0x1g", Tok.getText());
+    const std::vector<std::string> Expected = {"invalid digit 'g' in integer literal"};
+    EXPECT_EQ(Expected, Captured->Messages);
+    EXPECT_EQ(1u, Diags.getErrorCount());
+}
+
+TEST_F(LexerTest, ErrorLimitCutsOffLexing) {
+    DiagnosticEngine Diags(SourceMgr);
+    auto Consumer = std::make_unique<CapturingDiagnosticConsumer>();
+    CapturingDiagnosticConsumer *Captured = Consumer.get();
+    Diags.addConsumer(std::move(Consumer));
+    DiagnosticLimits Limits;
+    Limits.MaxErrors = 2;
+    Diags.setLimits(Limits);
+
+    std::string Source;
+    for (int I = 0; I != 100; ++I)
+        Source += "a \x01 ";
+    unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "binary.swift");
+    Lexer L(LangOpts, SourceMgr, BufferID, &Diags, LexerMode::Swift);
+    Token Tok;
+    unsigned Tokens = 0;
+    for (L.lex(Tok); Tok.isNot(tok::eof); L.lex(Tok))
+        ++Tokens;
+
+    EXPECT_LT(Tokens, 10u);
+    EXPECT_TRUE(L.lexingCutOffOffset().has_value());
+    ASSERT_EQ(3u, Captured->Messages.size());
+    EXPECT_EQ("too many errors emitted, stopping now", Captured->Messages.back());
+}
+
 // TEST_F(LexerTest, BrokenStringLiteral1) {
 //   llvm::StringRef Source("\"meow\0", 6);
 //   std::vector<tok> ExpectedTokens{ tok::unknown, tok::eof };
@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+#include <swift/Source/SourceManager.h>
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace swift;
+
+class SourceManagerTest : public ::testing::Test {
+public:
+    SourceManager SourceMgr;
+
+    unsigned addBuffer(llvm::StringRef Text) {
+        static unsigned Counter = 0;
+        return SourceMgr.addMemBufferCopy(Text, "buffer" + std::to_string(Counter++));
+    }
+};
+
+TEST_F(SourceManagerTest, ASCIIBuffer) {
+    std::string Text(1000, 'a');
+    const BufferTextInfo &Info = SourceMgr.getBufferTextInfo(addBuffer(Text));
+    EXPECT_EQ(BufferTextInfo::EncodingKind::ASCII, Info.Encoding);
+    EXPECT_TRUE(Info.isValidUTF8());
+    EXPECT_TRUE(Info.InvalidRanges.empty());
+}
+
+TEST_F(SourceManagerTest, ValidUTF8Buffer) {
+    // Two, three and four byte sequences, placed across vector block edges.
+    std::string Text = std::string(63, 'a') + "\xC3\xA9" + std::string(14, 'b') + "\xE2\x82\xAC" +
+                       std::string(30, 'c') + "\xF0\x9F\x98\x80" + "\xF4\x8F\xBF\xBF";
+    const BufferTextInfo &Info = SourceMgr.getBufferTextInfo(addBuffer(Text));
+    EXPECT_EQ(BufferTextInfo::EncodingKind::ValidUTF8, Info.Encoding);
+    EXPECT_TRUE(Info.InvalidRanges.empty());
+}
+
+TEST_F(SourceManagerTest, InvalidUTF8Ranges) {
+    std::string Text = std::string(70, 'a');
+    Text += "\xC0\xAF";                    // 70: overlong '/'
+    Text += "x\xED\xA0\x80";               // 73: surrogate
+    Text += "y\xF4\x90\x80\x80";           // 77: above U+10FFFF
+    Text += "z\xFF";                       // 82: never valid
+    Text += "\xC3\xA9";                    // 83: valid
+    Text += "\xE2\x82";                    // 85: truncated at end of buffer
+
+    const BufferTextInfo &Info = SourceMgr.getBufferTextInfo(addBuffer(Text));
+    EXPECT_EQ(BufferTextInfo::EncodingKind::InvalidUTF8, Info.Encoding);
+    EXPECT_FALSE(Info.isValidUTF8());
+    const std::vector<std::pair<unsigned, unsigned>> Expected = {
+        {70, 72}, {73, 76}, {77, 81}, {82, 83}, {85, 87}
+    };
+    EXPECT_EQ(Expected, Info.InvalidRanges);
+
+    EXPECT_TRUE(Info.isRangeValidUTF8(0, 70));
+    EXPECT_FALSE(Info.isRangeValidUTF8(0, 71));
+    EXPECT_FALSE(Info.isRangeValidUTF8(71, 72));
+    EXPECT_TRUE(Info.isRangeValidUTF8(72, 73));
+    EXPECT_TRUE(Info.isRangeValidUTF8(83, 85));
+    EXPECT_FALSE(Info.isRangeValidUTF8(83, 86));
+}
+
+TEST_F(SourceManagerTest, BuffersAreNulTerminated) {
+    // A view into the middle of a larger string is not NUL-terminated.
+    const std::string Backing = "let x = 1;let y = 2";
+    auto View = llvm::MemoryBuffer::getMemBuffer(llvm::StringRef(Backing).take_front(9), "view.swift",
+                                                 /*RequiresNullTerminator=*/false);
+    const unsigned BufferID = SourceMgr.addNewSourceBuffer(std::move(View));
+    const llvm::MemoryBuffer *Buffer = SourceMgr.getMemoryBuffer(BufferID);
+    EXPECT_EQ("let x = 1", Buffer->getBuffer());
+    EXPECT_EQ('\0', *Buffer->getBufferEnd());
+    EXPECT_NE(Backing.data(), Buffer->getBufferStart());
+    EXPECT_EQ(BufferID, SourceMgr.getIDForBufferIdentifier("view.swift"));
+
+    // Buffers known to be terminated are registered as they are.
+    auto Copy = llvm::MemoryBuffer::getMemBufferCopy("let z = 3", "copy.swift");
+    const char *CopyStart = Copy->getBufferStart();
+    const unsigned CopyID = SourceMgr.addNewSourceBuffer(std::move(Copy), /*IsNullTerminated=*/true);
+    EXPECT_EQ(CopyStart, SourceMgr.getMemoryBuffer(CopyID)->getBufferStart());
+
+    // Others are copied even if they happen to be followed by a NUL.
+    const std::string Whole = "let w = 4";
+    auto Unknown = llvm::MemoryBuffer::getMemBuffer(Whole, "unknown.swift", /*RequiresNullTerminator=*/false);
+    const unsigned UnknownID = SourceMgr.addNewSourceBuffer(std::move(Unknown));
+    EXPECT_NE(Whole.data(), SourceMgr.getMemoryBuffer(UnknownID)->getBufferStart());
+    EXPECT_EQ(Whole, SourceMgr.getBufferContent(UnknownID));
+}
+
+TEST_F(SourceManagerTest, ExtractTextIncludesLastByte) {
+    const unsigned BufferID = addBuffer("let x = 42");
+    EXPECT_EQ("let x = 42", SourceMgr.extractText(SourceMgr.getRangeForBuffer(BufferID)));
+
+    const SourceLocation Start = SourceMgr.getLocForBufferStart(BufferID);
+    EXPECT_EQ("x", SourceMgr.extractText(CharSourceRange(Start.getAdvancedLoc(4), 1)));
+    EXPECT_EQ("42", SourceMgr.extractText(CharSourceRange(Start.getAdvancedLoc(8), 2)));
+    EXPECT_EQ("", SourceMgr.extractText(CharSourceRange(Start.getAdvancedLoc(3), 0)));
+}
+
+TEST_F(SourceManagerTest, LineAndColumn) {
+    // Long lines so that newlines fall at different positions within vector
+    // blocks, plus an empty line, a CRLF and no newline at the end.
+    std::string Text;
+    for (unsigned Line = 0; Line != 50; ++Line)
+        Text += std::string(Line * 3, 'x') + "\n";
+    Text += "\r\nlast";
+    const unsigned BufferID = addBuffer(Text);
+
+    unsigned Line = 1, Col = 1;
+    for (unsigned Offset = 0; Offset <= Text.size(); ++Offset) {
+        SourceLocation Loc = SourceMgr.getLocForOffset(BufferID, Offset);
+        EXPECT_EQ(std::make_pair(Line, Col), SourceMgr.getLineAndColumn(Loc)) << "offset " << Offset;
+        EXPECT_EQ(Loc, SourceMgr.getLocForLineCol(BufferID, Line, Col)) << "offset " << Offset;
+        if (Offset != Text.size() && Text[Offset] == '\n') {
+            ++Line;
+            Col = 1;
+        } else {
+            ++Col;
+        }
+    }
+}
+
+TEST_F(SourceManagerTest, LocForLineColOutOfRange) {
+    const unsigned BufferID = addBuffer("ab\ncd");
+    EXPECT_TRUE(SourceMgr.getLocForLineCol(BufferID, 1, 3).isValid());
+    EXPECT_FALSE(SourceMgr.getLocForLineCol(BufferID, 1, 4).isValid());
+    EXPECT_TRUE(SourceMgr.getLocForLineCol(BufferID, 2, 3).isValid());
+    EXPECT_FALSE(SourceMgr.getLocForLineCol(BufferID, 2, 4).isValid());
+    EXPECT_FALSE(SourceMgr.getLocForLineCol(BufferID, 3, 1).isValid());
+    EXPECT_FALSE(SourceMgr.getLocForLineCol(BufferID, 0, 1).isValid());
+    EXPECT_FALSE(SourceMgr.getLocForLineCol(BufferID, 1, 0).isValid());
+}
+
+TEST_F(SourceManagerTest, LineText) {
+    const unsigned BufferID = addBuffer("ab\r\n\ncd");
+    EXPECT_EQ("ab", SourceMgr.getLineText(BufferID, 1));
+    EXPECT_EQ("", SourceMgr.getLineText(BufferID, 2));
+    EXPECT_EQ("cd", SourceMgr.getLineText(BufferID, 3));
+    EXPECT_EQ("", SourceMgr.getLineText(BufferID, 4));
+    EXPECT_EQ("", SourceMgr.getLineText(BufferID, 0));
+}
+
+TEST_F(SourceManagerTest, FindBufferContainingLocManyBuffers) {
+    std::vector<unsigned> BufferIDs;
+    for (unsigned I = 0; I != 500; ++I)
+        BufferIDs.push_back(addBuffer(std::string(I % 7, 'x')));
+
+    // Start, middle and end of every buffer, visited out of order so that
+    // lookups alternate between the cached buffer and a search.
+    for (unsigned Step = 0; Step != 3; ++Step) {
+        for (unsigned I = Step; I < BufferIDs.size(); I += 3) {
+            const unsigned BufferID = BufferIDs[I];
+            const unsigned Size = SourceMgr.getBufferContent(BufferID).size();
+            for (unsigned Offset : {0u, Size / 2, Size}) {
+                SourceLocation Loc = SourceMgr.getLocForOffset(BufferID, Offset);
+                EXPECT_EQ(BufferID, SourceMgr.findBufferContainingLoc(Loc));
+                EXPECT_EQ(BufferID, SourceMgr.findBufferContainingLoc(Loc));
+            }
+        }
+    }
+
+    EXPECT_EQ(~0U, SourceMgr.findBufferContainingLoc(SourceLocation()));
+    const char Outside = 0;
+    EXPECT_EQ(~0U, SourceMgr.findBufferContainingLoc(
+                       SourceLocation(llvm::SMLoc::getFromPointer(&Outside))));
+}
+
+TEST_F(SourceManagerTest, LocationPointerRoundTrip) {
+#if SWIFT_COMPACT_SOURCE_LOCATIONS
+    EXPECT_EQ(4u, sizeof(SourceLocation));
+#endif
+    // Buffers of a source manager that is gone must not be confused with
+    // the ones registered after it.
+    {
+        SourceManager Other;
+        Other.addMemBufferCopy("let gone = 1", "gone.swift");
+    }
+    const unsigned First = addBuffer("let a = 1\n");
+    const unsigned Second = addBuffer("let b = 2\n");
+    for (unsigned BufferID : {First, Second}) {
+        const llvm::StringRef Text = SourceMgr.getBufferContent(BufferID);
+        const SourceLocation Start = SourceMgr.getLocForBufferStart(BufferID);
+        for (unsigned Offset = 0; Offset <= Text.size(); ++Offset) {
+            const SourceLocation Loc(llvm::SMLoc::getFromPointer(Text.data() + Offset));
+            EXPECT_EQ(Start.getAdvancedLoc(Offset), Loc);
+            EXPECT_EQ(Text.data() + Offset, Loc.getPointer());
+            EXPECT_EQ(ptrdiff_t(Offset), Loc.getOffsetFrom(Start));
+            EXPECT_EQ(BufferID, SourceMgr.findBufferContainingLoc(Loc));
+        }
+    }
+}
+
+TEST_F(SourceManagerTest, RemoveSourceBuffer) {
+    const unsigned First = SourceMgr.addMemBufferCopy("let a = 1", "removed.swift");
+    const unsigned Second = addBuffer("let b = 2");
+    const SourceLocation FirstStart = SourceMgr.getLocForBufferStart(First);
+    const SourceLocation SecondStart = SourceMgr.getLocForBufferStart(Second);
+    EXPECT_EQ(First, SourceMgr.findBufferContainingLoc(FirstStart));
+
+    SourceMgr.removeSourceBuffer(First);
+    EXPECT_FALSE(SourceMgr.getIDForBufferIdentifier("removed.swift").has_value());
+    EXPECT_EQ(Second, SourceMgr.findBufferContainingLoc(SecondStart));
+    EXPECT_EQ("let b = 2", SourceMgr.getBufferContent(Second));
+
+    // The identifier can be used again, for a buffer with a new ID.
+    const unsigned Again = SourceMgr.addMemBufferCopy("let c = 3", "removed.swift");
+    EXPECT_NE(First, Again);
+    EXPECT_EQ("let c = 3", SourceMgr.getBufferContent(Again));
+    EXPECT_EQ(Again, SourceMgr.findBufferContainingLoc(SourceMgr.getLocForBufferStart(Again)));
+}
+
+TEST_F(SourceManagerTest, MappedFilesAreNulTerminated) {
+    SourceMgr.setFileLoadMode(FileLoadMode::Mapped);
+    const size_t PageSize = llvm::sys::Process::getPageSizeEstimate();
+
+    // Sizes within a page, ending exactly on a page boundary, and empty,
+    // which cannot be mapped.
+    std::vector<llvm::SmallString<128>> Paths;
+    for (size_t Size : {size_t(100), PageSize, 2 * PageSize, size_t(0)}) {
+        int FD;
+        llvm::SmallString<128> Path;
+        ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("mapped", "swift", FD, Path));
+        {
+            llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+            for (size_t I = 0; I != Size; ++I)
+                OS << (I % 64 == 63 ? '\n' : 'x');
+        }
+        Paths.push_back(Path);
+
+        const unsigned BufferID = SourceMgr.getOrOpenBuffer(Path);
+        ASSERT_NE(~0U, BufferID);
+        const llvm::StringRef Text = SourceMgr.getBufferContent(BufferID);
+        EXPECT_EQ(Size, Text.size());
+        EXPECT_EQ(std::string::npos, Text.find('\0'));
+        EXPECT_EQ('\0', *Text.end());
+    }
+
+    const FileLoadStats &Stats = SourceMgr.getFileLoadStats();
+#if defined(__unix__) || defined(__APPLE__)
+    EXPECT_EQ(3u, Stats.FilesMapped);
+    EXPECT_EQ(100 + 3 * PageSize, Stats.BytesMapped);
+    EXPECT_EQ(1u, Stats.FilesCopied);
+    EXPECT_EQ(0u, Stats.BytesCopied);
+#else
+    EXPECT_EQ(4u, Stats.FilesMapped + Stats.FilesCopied);
+#endif
+
+    for (const llvm::SmallString<128> &Path : Paths)
+        llvm::sys::fs::remove(Path);
+}
+
+TEST_F(SourceManagerTest, MappedModeReadsOtherFileSystems) {
+    // The file only exists in memory, so it cannot be mapped from disk.
+    auto FS = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    FS->addFile("/virtual/only.swift", 0, llvm::MemoryBuffer::getMemBufferCopy("let v = 1"));
+    SourceMgr.setFileSystem(FS);
+    SourceMgr.setFileLoadMode(FileLoadMode::Mapped);
+
+    const unsigned BufferID = SourceMgr.getOrOpenBuffer("/virtual/only.swift");
+    ASSERT_NE(~0U, BufferID);
+    EXPECT_EQ("let v = 1", SourceMgr.getBufferContent(BufferID));
+    EXPECT_EQ(0u, SourceMgr.getFileLoadStats().FilesMapped);
+    EXPECT_EQ(1u, SourceMgr.getFileLoadStats().FilesCopied);
+
+    std::error_code Error;
+    EXPECT_EQ(~0U, SourceMgr.getOrOpenBuffer("/virtual/missing.swift", &Error));
+    EXPECT_EQ(std::errc::no_such_file_or_directory, Error);
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <swift/Lexer/Lexer.h>
+#include <swift/Lexer/TokenBuffer.h>
+#include <swift/Source/SourceManager.h>
+
+using namespace swift;
+
+class TokenBufferTest : public ::testing::Test {
+public:
+    LangOptions LangOpts;
+    SourceManager SourceMgr;
+
+    static void expectSameToken(const Token &Expected, const Token &Actual, size_t Index) {
+        EXPECT_EQ(Expected.getKind(), Actual.getKind()) << "i = " << Index;
+        EXPECT_EQ(Expected.getRawText().data(), Actual.getRawText().data()) << "i = " << Index;
+        EXPECT_EQ(Expected.getRawText().size(), Actual.getRawText().size()) << "i = " << Index;
+        EXPECT_EQ(Expected.getText(), Actual.getText()) << "i = " << Index;
+        EXPECT_EQ(Expected.isAtStartOfLine(), Actual.isAtStartOfLine()) << "i = " << Index;
+        EXPECT_EQ(Expected.isEscapedIdentifier(), Actual.isEscapedIdentifier()) << "i = " << Index;
+        EXPECT_EQ(Expected.getCommentLength(), Actual.getCommentLength()) << "i = " << Index;
+        EXPECT_EQ(Expected.isMultilineString(), Actual.isMultilineString()) << "i = " << Index;
+        EXPECT_EQ(Expected.getCustomDelimiterLen(), Actual.getCustomDelimiterLen()) << "i = " << Index;
+    }
+};
+
+TEST_F(TokenBufferTest, MatchesTokenize) {
+    const char *Source = "// leading comment\n"
+                         "let `class` = #\"raw \\ string\"#\n"
+                         "/* block */ var x = \"\"\"\n  multiline\n  \"\"\"\n"
+                         "func f() -> Int { return 42 }";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+
+    for (bool KeepComments : {false, true}) {
+        std::vector<Token> Expected = tokenize(LangOpts, SourceMgr, BufferID, 0, 0, nullptr, KeepComments,
+                                               /*TokenizeInterpolatedString=*/false);
+        TokenBuffer Tokens = tokenizeToBuffer(LangOpts, SourceMgr, BufferID, 0, 0, nullptr, KeepComments,
+                                              /*TokenizeInterpolatedString=*/false);
+        ASSERT_EQ(Expected.size(), Tokens.size());
+        for (size_t I = 0; I != Expected.size(); ++I) {
+            expectSameToken(Expected[I], Tokens[I], I);
+            EXPECT_EQ(Expected[I].getLoc(), Tokens.getLoc(I));
+            EXPECT_EQ(Expected[I].getKind(), Tokens.getKind(I));
+        }
+
+        size_t Count = 0;
+        for (const Token &Tok : Tokens) {
+            expectSameToken(Expected[Count], Tok, Count);
+            ++Count;
+        }
+        EXPECT_EQ(Expected.size(), Count);
+    }
+}
+
+TEST_F(TokenBufferTest, FindKind) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy("let a = 1\nlet b = 2\nvar c = 3\n", "find.swift");
+    TokenBuffer Tokens = tokenizeToBuffer(LangOpts, SourceMgr, BufferID);
+
+    std::vector<size_t> Lets;
+    for (size_t I = Tokens.find(tok::kw_let); I != TokenBuffer::npos; I = Tokens.find(tok::kw_let, I + 1))
+        Lets.push_back(I);
+    EXPECT_EQ((std::vector<size_t>{0, 4}), Lets);
+    EXPECT_EQ(8u, Tokens.find(tok::kw_var));
+    EXPECT_EQ(TokenBuffer::npos, Tokens.find(tok::kw_func));
+    EXPECT_EQ(TokenBuffer::npos, Tokens.find(tok::kw_let, Tokens.size()));
+    EXPECT_EQ("c", Tokens.getRawText(9));
+    EXPECT_TRUE(Tokens.isAtStartOfLine(8));
+    EXPECT_FALSE(Tokens.isAtStartOfLine(9));
+}
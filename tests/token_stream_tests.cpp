@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include <swift/Lexer/TokenStream.h>
+#include <swift/Source/SourceManager.h>
+
+using namespace swift;
+
+class TokenStreamTest : public ::testing::Test {
+public:
+    LangOptions LangOpts;
+    SourceManager SourceMgr;
+
+    std::vector<Token> lexRaw(unsigned BufferID) {
+        Lexer L(LangOpts, SourceMgr, BufferID, /*Diags=*/nullptr, LexerMode::Swift,
+                HashbangMode::Allowed, CommentRetentionMode::ReturnAsTokens);
+        std::vector<Token> Tokens;
+        Token Tok;
+        for (L.lex(Tok); Tok.isNot(tok::eof); L.lex(Tok))
+            Tokens.push_back(Tok);
+        return Tokens;
+    }
+};
+
+TEST_F(TokenStreamTest, MatchesLexer) {
+    const char *Source = "// comment\n"
+                         "func f(x: Int) -> Int {\n"
+                         "  return x + \"plain\".count\n"
+                         "}";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+
+    std::vector<Token> Expected = lexRaw(BufferID);
+    TokenizeOptions Options;
+    Options.TokenizeInterpolatedString = false;
+    TokenStream Stream(LangOpts, SourceMgr, BufferID, Options);
+
+    size_t Count = 0;
+    for (const Token &Tok : Stream) {
+        ASSERT_LT(Count, Expected.size());
+        EXPECT_EQ(Expected[Count].getKind(), Tok.getKind()) << "i = " << Count;
+        EXPECT_EQ(Expected[Count].getText(), Tok.getText()) << "i = " << Count;
+        ++Count;
+    }
+    EXPECT_EQ(Expected.size(), Count);
+
+    // The stream is exhausted and stays that way.
+    Token Tok;
+    EXPECT_FALSE(Stream.next(Tok));
+}
+
+TEST_F(TokenStreamTest, MatchesTokenize) {
+    const char *Source = "let s = \"a \\(b + 1) c\"\nprint(s)";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+
+    std::vector<Token> Expected = tokenize(LangOpts, SourceMgr, BufferID, 0, 0);
+    TokenStream Stream(LangOpts, SourceMgr, BufferID);
+    std::vector<Token> Actual(Stream.begin(), Stream.end());
+    ASSERT_EQ(Expected.size(), Actual.size());
+    for (size_t I = 0; I != Expected.size(); ++I) {
+        EXPECT_EQ(Expected[I].getKind(), Actual[I].getKind()) << "i = " << I;
+        EXPECT_EQ(Expected[I].getText(), Actual[I].getText()) << "i = " << I;
+    }
+}
+
+TEST_F(TokenStreamTest, InterpolatedStrings) {
+    const char *Source = "let s = #\"a\\#(x + \"b\\(y)\") c\"#\n"
+                         "print(\"\"\"\n  \\(s)!\n  \"\"\")";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+
+    TokenStream Stream(LangOpts, SourceMgr, BufferID);
+    std::vector<Token> Tokens(Stream.begin(), Stream.end());
+    const std::vector<llvm::StringRef> Expected = {
+        "let", "s", "=",
+        "#\"a", "(", "x", "+", "\"b", "(", "y", ")", "\"", ")", " c\"#",
+        "print", "(", "\"\"\"\n  ", "(", "s", ")", "!\n  \"\"\"", ")"
+    };
+    ASSERT_EQ(Expected.size(), Tokens.size());
+    for (size_t I = 0; I != Expected.size(); ++I)
+        EXPECT_EQ(Expected[I], Tokens[I].getRawText()) << "i = " << I;
+
+    // Every literal piece keeps the delimiters of its string.
+    EXPECT_EQ(1u, Tokens[3].getCustomDelimiterLen());
+    EXPECT_EQ(1u, Tokens[13].getCustomDelimiterLen());
+    EXPECT_EQ(0u, Tokens[7].getCustomDelimiterLen());
+    EXPECT_TRUE(Tokens[16].isMultilineString());
+    EXPECT_TRUE(Tokens[20].isMultilineString());
+    EXPECT_TRUE(Tokens[14].isAtStartOfLine());
+}
+
+TEST_F(TokenStreamTest, SplitTokens) {
+    const char *Source = "a >> b";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+    llvm::StringRef Text = SourceMgr.getBufferContent(BufferID);
+
+    Token Split(tok::r_angle, Text.substr(2, 1));
+    TokenizeOptions Options;
+    Options.SplitTokens = llvm::ArrayRef<Token>(Split);
+
+    TokenStream Stream(LangOpts, SourceMgr, BufferID, Options);
+    std::vector<Token> Tokens(Stream.begin(), Stream.end());
+    ASSERT_EQ(4u, Tokens.size());
+    EXPECT_EQ(tok::identifier, Tokens[0].getKind());
+    EXPECT_EQ(tok::r_angle, Tokens[1].getKind());
+    EXPECT_EQ(Text.data() + 2, Tokens[1].getText().data());
+    EXPECT_EQ(">", Tokens[2].getText());
+    EXPECT_EQ("b", Tokens[3].getText());
+}
+
+TEST_F(TokenStreamTest, SplitTokensAreMergedInOrder) {
+    const char *Source = "a >> b // >>\nc >> d";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+    llvm::StringRef Text = SourceMgr.getBufferContent(BufferID);
+
+    // The middle split token sits inside a comment and is never reached.
+    std::vector<Token> Splits;
+    for (size_t Offset : {2, 10, 15})
+        Splits.emplace_back(tok::r_angle, Text.substr(Offset, 1));
+    TokenizeOptions Options;
+    Options.KeepComments = false;
+    Options.SplitTokens = Splits;
+
+    TokenStream Stream(LangOpts, SourceMgr, BufferID, Options);
+    std::vector<Token> Tokens(Stream.begin(), Stream.end());
+    ASSERT_EQ(8u, Tokens.size());
+    EXPECT_EQ(tok::r_angle, Tokens[1].getKind());
+    EXPECT_EQ(">", Tokens[2].getText());
+    EXPECT_EQ("b", Tokens[3].getText());
+    EXPECT_EQ("c", Tokens[4].getText());
+    EXPECT_EQ(tok::r_angle, Tokens[5].getKind());
+    EXPECT_EQ(Text.data() + 15, Tokens[5].getText().data());
+    EXPECT_EQ(">", Tokens[6].getText());
+    EXPECT_EQ("d", Tokens[7].getText());
+}
+
+TEST_F(TokenStreamTest, StopsEarly) {
+    const unsigned BufferID = SourceMgr.addMemBufferCopy("a b c d", "source.swift");
+
+    TokenStream Stream(LangOpts, SourceMgr, BufferID);
+    Token Tok;
+    ASSERT_TRUE(Stream.next(Tok));
+    EXPECT_EQ("a", Tok.getText());
+    ASSERT_TRUE(Stream.next(Tok));
+    EXPECT_EQ("b", Tok.getText());
+}
+
+TEST_F(TokenStreamTest, StopToken) {
+    const char *Source = "a b\n/* x */ c d";
+    const unsigned BufferID = SourceMgr.addMemBufferCopy(Source, "source.swift");
+
+    TokenizeOptions Options;
+    Options.KeepComments = false;
+    Options.EndOffset = 4;
+    TokenStream Stream(LangOpts, SourceMgr, BufferID, Options);
+    std::vector<Token> Tokens(Stream.begin(), Stream.end());
+    ASSERT_EQ(2u, Tokens.size());
+
+    const Token &Stop = Stream.getStopToken();
+    EXPECT_TRUE(Stop.is(tok::identifier));
+    EXPECT_EQ("c", Stop.getText());
+    EXPECT_TRUE(Stop.isAtStartOfLine());
+    EXPECT_EQ(8u, Stop.getCommentLength());
+}
+
+TEST_F(TokenStreamTest, ParallelMatchesTokenize) {
+    // Enough text for several chunks, with multi-line strings and comments
+    // that the guessed chunk boundaries are likely to fall into.
+    std::string Source;
+    for (unsigned I = 0; Source.size() < 1024 * 1024; ++I) {
+        std::string N = std::to_string(I);
+        Source += "/* block comment " + N + "\n   spanning\n   lines */\n"
+                  "func f" + N + "(x: Int) -> String {\n"
+                  "    let s = \"\"\"\n"
+                  "        line one \\(x + " + N + ")\n"
+                  "        line two\n"
+                  "        \"\"\"\n"
+                  "    return s + \"\\(x)\" // trailing\n"
+                  "}\n";
+    }
+
+    // A number after a period at the end of the previous line is lexed
+    // differently from one at the start of a chunk.
+    std::string Periods;
+    while (Periods.size() < 1024 * 1024)
+        Periods += "t .\n0.1;";
+
+    for (const auto &[Text, Name] : {std::pair(Source, "source.swift"),
+                                     std::pair(Periods, "periods.swift")}) {
+        const unsigned BufferID = SourceMgr.addMemBufferCopy(Text, Name);
+
+        for (bool KeepComments : {true, false}) {
+            std::vector<Token> Expected = tokenize(LangOpts, SourceMgr, BufferID, 0, 0,
+                                                   nullptr, KeepComments);
+            for (unsigned Threads : {1u, 2u, 3u, 8u}) {
+                std::vector<Token> Actual = tokenizeParallel(LangOpts, SourceMgr, BufferID,
+                                                             Threads, KeepComments);
+                ASSERT_EQ(Expected.size(), Actual.size()) << "threads = " << Threads;
+                for (size_t I = 0; I != Expected.size(); ++I) {
+                    ASSERT_EQ(Expected[I].getKind(), Actual[I].getKind()) << "i = " << I;
+                    ASSERT_EQ(Expected[I].getRawText().data(), Actual[I].getRawText().data())
+                        << "i = " << I;
+                    ASSERT_EQ(Expected[I].getLength(), Actual[I].getLength()) << "i = " << I;
+                    ASSERT_EQ(Expected[I].isAtStartOfLine(), Actual[I].isAtStartOfLine())
+                        << "i = " << I;
+                    ASSERT_EQ(Expected[I].getCommentLength(), Actual[I].getCommentLength())
+                        << "i = " << I;
+                }
+            }
+        }
+    }
+}
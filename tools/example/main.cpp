@@ -1,65 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <system_error>
 
-#include "swift/Lexer/Lexer.h"
+#include "swift/Lexer/TokenStream.h"
 #include "swift/Source/SourceManager.h"
+#include "swift/Diagnostic/DiagnosticConsumers.h"
 #include "swift/Diagnostic/DiagnosticEngine.h"
 
-// Custom diagnostic consumer to capture diagnostics
-class MyDiagnosticConsumer : public swift::DiagnosticConsumer {
-public:
-    bool hadError = false;
-
-    void handleDiagnostic(const swift::Diagnostic &Diag, const swift::SourceManager &SM) override {
-        std::string severity;
-        switch (Diag.Severity) {
-            case swift::DiagnosticSeverity::Error:
-                severity = "error";
-                hadError = true;
-                break;
-            case swift::DiagnosticSeverity::Warning:
-                severity = "warning";
-                break;
-            case swift::DiagnosticSeverity::Note:
-                severity = "note";
-                break;
-            case swift::DiagnosticSeverity::Remark:
-                severity = "remark";
-                break;
-        }
-
-        std::cout << "Diagnostic [" << severity << "]: " << Diag.Message << std::endl;
-
-        // Only try to get location info if location is valid
-        if (Diag.Location.isValid()) {
-            try {
-                unsigned BufferID = SM.findBufferContainingLoc(Diag.Location);
-                if (BufferID != ~0U) {
-                    unsigned Offset = SM.getLocOffsetInBuffer(Diag.Location, BufferID);
-
-                    // Calculate line and column from offset
-                    llvm::StringRef BufferStr = SM.getBufferContent(BufferID);
-                    unsigned Line = 1;
-                    unsigned LastLineStart = 0;
-
-                    for (unsigned i = 0; i < Offset && i < BufferStr.size(); ++i) {
-                        if (BufferStr[i] == '\n') {
-                            ++Line;
-                            LastLineStart = i + 1;
-                        }
-                    }
-
-                    unsigned Column = Offset - LastLineStart + 1;
-                    std::cout << "  at line " << Line << ", column " << Column << std::endl;
-                }
-            } catch (...) {
-                std::cout << "  (location information unavailable)" << std::endl;
-            }
-        }
-    }
-};
-
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0] << " <swift-file-path>" << std::endl;
@@ -76,44 +24,38 @@ int main(int argc, char *argv[]) {
     // Set up source manager
     swift::SourceManager sourceMgr;
 
-    // Set up diagnostic engine with custom consumer
-    auto diagConsumer = std::make_unique<MyDiagnosticConsumer>();
-    MyDiagnosticConsumer *diagConsumerPtr = diagConsumer.get(); // Keep a pointer for later use
+    // Set up diagnostic engine, printing diagnostics with the source line
     swift::DiagnosticEngine diagEngine(sourceMgr);
-    diagEngine.addConsumer(std::move(diagConsumer));
+    diagEngine.addConsumer(std::make_unique<swift::TextDiagnosticConsumer>(std::cout));
 
-    // Load file into buffer
-    auto fileBufferOrError = llvm::MemoryBuffer::getFile(filePath);
-    if (std::error_code EC = fileBufferOrError.getError()) {
+    // Map the file into the source manager rather than copying it
+    sourceMgr.setFileLoadMode(swift::FileLoadMode::Mapped);
+    std::error_code EC;
+    unsigned bufferID = sourceMgr.getOrOpenBuffer(filePath, &EC);
+    if (bufferID == ~0U) {
         std::cerr << "Error opening file: " << EC.message() << std::endl;
         return 1;
     }
 
-    // Add buffer to source manager
-    unsigned bufferID = sourceMgr.addNewSourceBuffer(std::move(fileBufferOrError.get()));
-
-    // Create the lexer with default options
+    // Lex the buffer in a single pass, keeping only the tokens we print.
+    // Only print first 50 tokens to avoid overwhelming output
+    const size_t MAX_TOKENS_TO_PRINT = 50;
     swift::LangOptions langOpts;
-    swift::Lexer lexer(langOpts, sourceMgr, bufferID, &diagEngine,
-                       swift::LexerMode::Swift,
-                       swift::HashbangMode::Allowed,
-                       swift::CommentRetentionMode::ReturnAsTokens);
-
-    // Tokenize the input
-    int tokenCount = 0;
-    swift::Token token;
+    swift::TokenizeOptions tokenizeOpts;
+    tokenizeOpts.Diags = &diagEngine;
+    tokenizeOpts.TokenizeInterpolatedString = false;
+
+    size_t tokenCount = 0;
     std::vector<swift::Token> tokens;
+    tokens.reserve(MAX_TOKENS_TO_PRINT);
 
     try {
-        do {
-            lexer.lex(token);
-
-            // Store token if it's valid
-            if (token.getKind() != swift::tok::NUM_TOKENS) {
+        for (const swift::Token &token : swift::TokenStream(langOpts, sourceMgr, bufferID, tokenizeOpts)) {
+            if (tokens.size() < MAX_TOKENS_TO_PRINT) {
                 tokens.push_back(token);
-                tokenCount++;
             }
-        } while (token.isNot(swift::tok::eof));
+            tokenCount++;
+        }
     } catch (const std::exception &e) {
         std::cerr << "Exception during lexing: " << e.what() << std::endl;
         return 1;
@@ -122,8 +64,11 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Write out the buffered diagnostics before the results
+    diagEngine.finishProcessing();
+
     // Report results
-    if (diagConsumerPtr->hadError) {
+    if (diagEngine.hasErrors()) {
         std::cout << "-------------------" << std::endl;
         std::cout << "Lexing failed with errors" << std::endl;
         std::cout << "-------------------" << std::endl;
@@ -133,12 +78,8 @@ int main(int argc, char *argv[]) {
         std::cout << "Lexing successful! Found " << tokenCount << " tokens:" << std::endl;
         std::cout << "-------------------" << std::endl;
 
-        // Only print first 50 tokens to avoid overwhelming output
-        const size_t MAX_TOKENS_TO_PRINT = 50;
-        const size_t tokensToPrint = std::min(tokens.size(), MAX_TOKENS_TO_PRINT);
-
         // Print tokens
-        for (size_t i = 0; i < tokensToPrint; i++) {
+        for (size_t i = 0; i < tokens.size(); i++) {
             const auto &tok = tokens[i];
 
             std::cout << "Token " << i + 1 << ": Kind=" << static_cast<int>(tok.getKind());
@@ -164,8 +105,8 @@ int main(int argc, char *argv[]) {
             std::cout << std::endl;
         }
 
-        if (tokens.size() > MAX_TOKENS_TO_PRINT) {
-            std::cout << "... and " << (tokens.size() - MAX_TOKENS_TO_PRINT) << " more tokens" << std::endl;
+        if (tokenCount > tokens.size()) {
+            std::cout << "... and " << (tokenCount - tokens.size()) << " more tokens" << std::endl;
         }
     }
 
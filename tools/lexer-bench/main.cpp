@@ -0,0 +1,914 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "swift/Lexer/IncrementalLexer.h"
+#include "swift/Lexer/Lexer.h"
+#include "swift/Source/ByteScan.h"
+#include "swift/Source/SourceManager.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Microbenchmarks for the lexer hot paths.
+//
+// Usage: swift-lexer-bench <benchmark> [swift-files...]
+//
+// Benchmarks that need input use the given files, or a synthetic buffer when
+// none are given.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point Start) {
+    return std::chrono::duration<double>(Clock::now() - Start).count();
+}
+
+// Keeps results observable so the timed loops are not optimized away.
+volatile unsigned Sink = 0;
+
+struct SourceFile {
+    std::string Name;
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+};
+
+std::vector<SourceFile> loadFiles(const std::vector<std::string> &Paths) {
+    std::vector<SourceFile> Files;
+    for (const std::string &Path : Paths) {
+        auto BufferOrError = llvm::MemoryBuffer::getFile(Path);
+        if (std::error_code EC = BufferOrError.getError()) {
+            std::cerr << "Error opening file " << Path << ": " << EC.message() << std::endl;
+            continue;
+        }
+        Files.push_back({Path, std::move(BufferOrError.get())});
+    }
+    return Files;
+}
+
+//===----------------------------------------------------------------------===//
+// keywords: Lexer::kindOfIdentifier against the original if-chain
+//===----------------------------------------------------------------------===//
+
+// The classifier kindOfIdentifier used before the keyword hash table.
+swift::tok kindOfIdentifierChain(llvm::StringRef Str, bool InSILMode) {
+#define SIL_KEYWORD(kw)
+#define KEYWORD(kw) if (Str == #kw) return swift::tok::kw_##kw;
+#include "swift/Lexer/TokenKinds.def"
+    if (InSILMode) {
+#define SIL_KEYWORD(kw) if (Str == #kw) return swift::tok::kw_##kw;
+#include "swift/Lexer/TokenKinds.def"
+    }
+    return swift::tok::identifier;
+}
+
+// Collects the spelling of every identifier and keyword token in the inputs.
+std::vector<std::string> collectWords(const std::vector<SourceFile> &Files) {
+    std::vector<std::string> Words;
+    swift::LangOptions LangOpts;
+    for (const SourceFile &File : Files) {
+        swift::SourceManager SM;
+        swift::DiagnosticEngine Diags(SM);
+        unsigned BufferID = SM.addMemBufferCopy(File.Buffer.get());
+        swift::Lexer L(LangOpts, SM, BufferID, &Diags, swift::LexerMode::Swift);
+        swift::Token Tok;
+        do {
+            L.lex(Tok);
+            if (Tok.is(swift::tok::identifier) || Tok.isKeyword())
+                Words.push_back(Tok.getText().str());
+        } while (Tok.isNot(swift::tok::eof));
+    }
+    return Words;
+}
+
+std::vector<std::string> syntheticWords() {
+    std::vector<std::string> Words;
+#define KEYWORD(kw) Words.push_back(#kw);
+#include "swift/Lexer/TokenKinds.def"
+    for (const char *Ident : {"x", "value", "count", "index", "result", "lhs", "rhs",
+                              "element", "makeIterator", "description", "sil_foo",
+                              "selfish", "initialize", "letter", "variable"})
+        Words.push_back(Ident);
+    return Words;
+}
+
+int benchKeywords(const std::vector<SourceFile> &Files) {
+    std::vector<std::string> Words = Files.empty() ? syntheticWords() : collectWords(Files);
+    if (Words.empty()) {
+        std::cerr << "No identifiers found in input" << std::endl;
+        return 1;
+    }
+
+    // Both classifiers must agree before their speed is worth comparing.
+    for (const std::string &Word : Words) {
+        for (bool InSILMode : {false, true}) {
+            if (swift::Lexer::kindOfIdentifier(Word, InSILMode) !=
+                kindOfIdentifierChain(Word, InSILMode)) {
+                std::cerr << "Mismatch classifying '" << Word << "'" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    const size_t Iterations = std::max<size_t>(1, 20000000 / Words.size());
+    auto run = [&](const char *Name, swift::tok (*Classify)(llvm::StringRef, bool)) {
+        unsigned Keywords = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Iterations; ++I)
+            for (const std::string &Word : Words)
+                Keywords += Classify(Word, false) != swift::tok::identifier;
+        double Seconds = secondsSince(Start);
+        Sink = Sink + Keywords;
+        double Lookups = double(Iterations) * Words.size();
+        std::cout << "  " << Name << ": " << (Seconds * 1e9 / Lookups) << " ns/lookup, "
+                  << (Lookups / Seconds / 1e6) << " M lookups/s" << std::endl;
+    };
+
+    std::cout << "keywords: " << Words.size() << " words x " << Iterations << " iterations" << std::endl;
+    run("if-chain  ", kindOfIdentifierChain);
+    run("hash table", swift::Lexer::kindOfIdentifier);
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// trivia: whitespace skipping and end-to-end lexing throughput
+//===----------------------------------------------------------------------===//
+
+// Deeply indented code with blank lines, the shape bulk skipping targets.
+std::string syntheticIndentedSource() {
+    std::string Source;
+    for (unsigned Func = 0; Func != 2000; ++Func) {
+        Source += "func f" + std::to_string(Func) + "() {\n";
+        for (unsigned Depth = 1; Depth != 8; ++Depth)
+            Source += std::string(Depth * 4, ' ') + "if x {\n\n";
+        for (unsigned Depth = 8; Depth-- != 1;)
+            Source += std::string(Depth * 4, ' ') + "}\n";
+        Source += "}\n\n";
+    }
+    return Source;
+}
+
+std::vector<SourceFile> filesOrSynthetic(const std::vector<SourceFile> &Files,
+                                         std::string (*Synthesize)()) {
+    std::vector<SourceFile> Result;
+    if (Files.empty()) {
+        Result.push_back({"<synthetic>", llvm::MemoryBuffer::getMemBufferCopy(Synthesize(), "<synthetic>")});
+        return Result;
+    }
+    for (const SourceFile &File : Files)
+        Result.push_back({File.Name, llvm::MemoryBuffer::getMemBufferCopy(File.Buffer->getBuffer(), File.Name)});
+    return Result;
+}
+
+// Lexes every input Iterations times; returns tokens lexed and seconds taken.
+std::pair<size_t, double> lexAll(const std::vector<SourceFile> &Files, size_t Iterations,
+                                 swift::CommentRetentionMode RetainComments) {
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    swift::DiagnosticEngine Diags(SM);
+    std::vector<unsigned> BufferIDs;
+    for (const SourceFile &File : Files)
+        BufferIDs.push_back(SM.addMemBufferCopy(File.Buffer->getBuffer(), File.Name));
+
+    size_t Tokens = 0;
+    auto Start = Clock::now();
+    for (size_t I = 0; I != Iterations; ++I) {
+        for (unsigned BufferID : BufferIDs) {
+            swift::Lexer L(LangOpts, SM, BufferID, &Diags, swift::LexerMode::Swift,
+                           swift::HashbangMode::Allowed, RetainComments);
+            swift::Token Tok;
+            do {
+                L.lex(Tok);
+                ++Tokens;
+            } while (Tok.isNot(swift::tok::eof));
+        }
+    }
+    return {Tokens, secondsSince(Start)};
+}
+
+size_t totalBytes(const std::vector<SourceFile> &Files) {
+    size_t Bytes = 0;
+    for (const SourceFile &File : Files)
+        Bytes += File.Buffer->getBufferSize();
+    return Bytes;
+}
+
+void reportLexing(const char *Name, const std::vector<SourceFile> &Files, size_t Iterations,
+                  std::pair<size_t, double> Result) {
+    double Bytes = double(totalBytes(Files)) * Iterations;
+    std::cout << "  " << Name << ": " << (Bytes / Result.second / 1e6) << " MB/s, "
+              << (Result.first / Result.second / 1e6) << " M tokens/s" << std::endl;
+}
+
+size_t iterationsFor(const std::vector<SourceFile> &Files, size_t TargetBytes) {
+    return std::max<size_t>(1, TargetBytes / std::max<size_t>(1, totalBytes(Files)));
+}
+
+int benchTrivia(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticIndentedSource);
+
+    // Time the skipper alone over every whitespace run in the input, against
+    // the byte-at-a-time loop lexTrivia used before.
+    size_t Iterations = iterationsFor(Files, 200000000);
+    auto runSkipper = [&](const char *Name, const char *(*Skip)(const char *, const char *, bool &)) {
+        size_t Newlines = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Iterations; ++I) {
+            for (const SourceFile &File : Files) {
+                const char *Ptr = File.Buffer->getBufferStart(), *End = File.Buffer->getBufferEnd();
+                while (Ptr != End) {
+                    // Like lexTrivia, only start skipping at whitespace.
+                    if (!swift::isWhitespace(*Ptr)) {
+                        ++Ptr;
+                        continue;
+                    }
+                    bool SawNewline = false;
+                    Ptr = Skip(Ptr, End, SawNewline);
+                    Newlines += SawNewline;
+                }
+            }
+        }
+        double Seconds = secondsSince(Start);
+        Sink = Sink + unsigned(Newlines);
+        double Bytes = double(totalBytes(Files)) * Iterations;
+        std::cout << "  " << Name << ": " << (Bytes / Seconds / 1e6) << " MB/s" << std::endl;
+    };
+
+    std::cout << "trivia: " << totalBytes(Files) << " bytes, scanner: "
+              << swift::bytescan::getImplementationName() << std::endl;
+    runSkipper("scalar skip", [](const char *Ptr, const char *End, bool &SawNewline) {
+        for (; Ptr != End; ++Ptr) {
+            if (*Ptr == '\n' || *Ptr == '\r')
+                SawNewline = true;
+            else if (*Ptr != ' ' && *Ptr != '\t' && *Ptr != '\v' && *Ptr != '\f')
+                break;
+        }
+        return Ptr;
+    });
+    runSkipper("block skip ", swift::bytescan::skipWhitespace);
+
+    Iterations = iterationsFor(Files, 50000000);
+    reportLexing("lex        ", Files, Iterations,
+                 lexAll(Files, Iterations, swift::CommentRetentionMode::None));
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// comments: lexing comment-dense input
+//===----------------------------------------------------------------------===//
+
+// License headers, doc comments and nested block comments around a little
+// code, with some non-ASCII text so UTF-8 validation stays on the path.
+std::string syntheticCommentSource() {
+    std::string Source;
+    for (unsigned Chunk = 0; Chunk != 500; ++Chunk) {
+        Source += "//===--- File" + std::to_string(Chunk) +
+                  ".swift - Part of the example project -----------------===//\n"
+                  "//\n"
+                  "// Licensed under the Apache License v2.0 with Runtime Library Exception\n"
+                  "// See https://swift.org/LICENSE.txt for license information\n"
+                  "//\n"
+                  "//===----------------------------------------------------------------------===//\n\n"
+                  "/**\n"
+                  " * Computes the résumé score for the given input values.\n"
+                  " *\n"
+                  " * - Parameter values: the inputs to combine; /* nested remark */ see below.\n"
+                  " * - Returns: the combined score, or zero when there are no values.\n"
+                  " */\n"
+                  "/// Doc comment lines are usually long enough to cover several vector blocks.\n"
+                  "/// They rarely contain anything the lexer needs to look at twice.\n"
+                  "func score" + std::to_string(Chunk) + "(_ values: [Int]) -> Int { // trailing note\n"
+                  "    return values.count /* inline */ + 1\n"
+                  "}\n\n";
+    }
+    return Source;
+}
+
+int benchComments(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticCommentSource);
+    size_t Iterations = iterationsFor(Files, 100000000);
+    std::cout << "comments: " << totalBytes(Files) << " bytes x " << Iterations
+              << " iterations, scanner: " << swift::bytescan::getImplementationName() << std::endl;
+    reportLexing("skip comments  ", Files, Iterations,
+                 lexAll(Files, Iterations, swift::CommentRetentionMode::None));
+    reportLexing("attach comments", Files, Iterations,
+                 lexAll(Files, Iterations, swift::CommentRetentionMode::AttachToNextToken));
+    reportLexing("comment tokens ", Files, Iterations,
+                 lexAll(Files, Iterations, swift::CommentRetentionMode::ReturnAsTokens));
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// utf8: buffer registration with up-front UTF-8 validation
+//===----------------------------------------------------------------------===//
+
+int benchUTF8(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticCommentSource);
+    size_t Iterations = iterationsFor(Files, 500000000);
+
+    // addNewSourceBuffer validates the buffer; time a plain copy alongside so
+    // the validation cost can be read off the difference.
+    auto Start = Clock::now();
+    for (size_t I = 0; I != Iterations; ++I)
+        for (const SourceFile &File : Files)
+            Sink = Sink + unsigned(llvm::MemoryBuffer::getMemBufferCopy(File.Buffer->getBuffer())->getBufferSize());
+    double CopySeconds = secondsSince(Start);
+
+    unsigned Invalid = 0;
+    Start = Clock::now();
+    for (size_t I = 0; I != Iterations; ++I) {
+        swift::SourceManager SM;
+        for (const SourceFile &File : Files) {
+            unsigned BufferID = SM.addNewSourceBuffer(llvm::MemoryBuffer::getMemBufferCopy(File.Buffer->getBuffer()),
+                                                              /*IsNullTerminated=*/true);
+            Invalid += !SM.getBufferTextInfo(BufferID).isValidUTF8();
+        }
+    }
+    double RegisterSeconds = secondsSince(Start);
+    Sink = Sink + Invalid;
+
+    double Bytes = double(totalBytes(Files)) * Iterations;
+    std::cout << "utf8: " << totalBytes(Files) << " bytes x " << Iterations
+              << " iterations, scanner: " << swift::bytescan::getImplementationName() << std::endl;
+    std::cout << "  copy only        : " << (Bytes / CopySeconds / 1e6) << " MB/s" << std::endl;
+    std::cout << "  copy and register: " << (Bytes / RegisterSeconds / 1e6) << " MB/s" << std::endl;
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// identifiers: identifier scanning and identifier-heavy lexing
+//===----------------------------------------------------------------------===//
+
+// Long descriptive names, as in generated or heavily namespaced code.
+std::string syntheticIdentifierSource() {
+    std::string Source;
+    for (unsigned Decl = 0; Decl != 5000; ++Decl) {
+        std::string N = std::to_string(Decl);
+        Source += "let configurationValue" + N + " = defaultConfigurationProvider.currentValue(for: keyPath" + N +
+                  ", fallback: initialConfigurationValue" + N + ")\n";
+    }
+    return Source;
+}
+
+// Offsets of the identifier and keyword tokens in one buffer.
+std::vector<unsigned> identifierOffsets(const SourceFile &File) {
+    std::vector<unsigned> Offsets;
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    swift::DiagnosticEngine Diags(SM);
+    unsigned BufferID = SM.addMemBufferCopy(File.Buffer.get());
+    const char *Start = SM.getMemoryBuffer(BufferID)->getBufferStart();
+    swift::Lexer L(LangOpts, SM, BufferID, &Diags, swift::LexerMode::Swift);
+    swift::Token Tok;
+    do {
+        L.lex(Tok);
+        if (Tok.is(swift::tok::identifier) || Tok.isKeyword())
+            Offsets.push_back(unsigned(Tok.getText().data() - Start));
+    } while (Tok.isNot(swift::tok::eof));
+    return Offsets;
+}
+
+int benchIdentifiers(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticIdentifierSource);
+    std::vector<std::vector<unsigned>> Offsets;
+    size_t Identifiers = 0;
+    for (const SourceFile &File : Files) {
+        Offsets.push_back(identifierOffsets(File));
+        Identifiers += Offsets.back().size();
+    }
+    if (Identifiers == 0) {
+        std::cerr << "No identifiers found in input" << std::endl;
+        return 1;
+    }
+
+    // Time the body scan alone at every identifier, against the decode-each-
+    // character loop lexIdentifier used before.
+    size_t Iterations = std::max<size_t>(1, 20000000 / Identifiers);
+    auto runScanner = [&](const char *Name, const char *(*Scan)(const char *, const char *)) {
+        size_t Length = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Iterations; ++I) {
+            for (size_t F = 0; F != Files.size(); ++F) {
+                const char *Buffer = Files[F].Buffer->getBufferStart(), *End = Files[F].Buffer->getBufferEnd();
+                for (unsigned Offset : Offsets[F])
+                    Length += size_t(Scan(Buffer + Offset + 1, End) - Buffer) - Offset;
+            }
+        }
+        double Seconds = secondsSince(Start);
+        Sink = Sink + unsigned(Length);
+        double Scanned = double(Identifiers) * Iterations;
+        std::cout << "  " << Name << ": " << (Scanned / Seconds / 1e6) << " M identifiers/s" << std::endl;
+    };
+
+    std::cout << "identifiers: " << Identifiers << " identifiers in " << totalBytes(Files)
+              << " bytes, scanner: " << swift::bytescan::getImplementationName() << std::endl;
+    runScanner("decode scan", [](const char *Ptr, const char *End) {
+        while (true) {
+            const char *Next = Ptr;
+            uint32_t C = swift::validateUTF8CharacterAndAdvance(Next, End);
+            if (C >= 0x80 || !swift::isAsciiIdentifierContinue(C, /*AllowDollar=*/true))
+                return Ptr;
+            Ptr = Next;
+        }
+    });
+    runScanner("block scan ", swift::bytescan::skipIdentifierBody);
+
+    Iterations = iterationsFor(Files, 50000000);
+    auto Result = lexAll(Files, Iterations, swift::CommentRetentionMode::None);
+    double Lexed = double(Identifiers) * Iterations;
+    std::cout << "  lex        : " << (Lexed / Result.second / 1e6) << " M identifiers/s, "
+              << (double(totalBytes(Files)) * Iterations / Result.second / 1e6) << " MB/s" << std::endl;
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// unicode: lexing non-Latin identifiers and Unicode operators
+//===----------------------------------------------------------------------===//
+
+// Greek, Cyrillic and CJK identifiers, emoji, and operators from the math
+// and arrow blocks: every character goes through the code point tables.
+std::string syntheticUnicodeSource() {
+    std::string Source;
+    for (unsigned Line = 0; Line != 5000; ++Line) {
+        Source += "let \xCF\x84\xCE\xB9\xCE\xBC\xCE\xAE" + std::to_string(Line) +  // τιμή
+                  " = \xD0\xB7\xD0\xBD\xD0\xB0\xD1\x87\xD0\xB5\xD0\xBD\xD0\xB8\xD0\xB5 "  // значение
+                  "\xE2\x8A\x95 \xE5\x80\xA4\xE6\x95\xB0 \xE2\x86\x92 "                      // ⊕ 値数 →
+                  "\xF0\x9F\x98\x80\xF0\x9F\x8E\x89 \xE2\x89\xA0 \xCE\xB1\xCE\xB2\xCE\xB3\n";  // 😀🎉 ≠ αβγ
+    }
+    return Source;
+}
+
+int benchUnicode(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticUnicodeSource);
+    size_t Iterations = iterationsFor(Files, 50000000);
+    std::cout << "unicode: " << totalBytes(Files) << " bytes x " << Iterations << " iterations" << std::endl;
+    reportLexing("lex", Files, Iterations, lexAll(Files, Iterations, swift::CommentRetentionMode::None));
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// tokens: memory and scan cost of token arrays
+//===----------------------------------------------------------------------===//
+
+int benchTokens(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticIdentifierSource);
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    swift::DiagnosticEngine Diags(SM);
+    std::vector<std::vector<swift::Token>> Vectors;
+    std::vector<swift::TokenBuffer> Buffers;
+    size_t VectorBytes = 0, BufferBytes = 0, Tokens = 0;
+    for (const SourceFile &File : Files) {
+        unsigned BufferID = SM.addMemBufferCopy(File.Buffer->getBuffer(), File.Name);
+        // Interpolated strings are left whole; only the storage is compared.
+        Vectors.push_back(swift::tokenize(LangOpts, SM, BufferID, 0, 0, &Diags, true,
+                                          /*TokenizeInterpolatedString=*/false));
+        Vectors.back().shrink_to_fit();
+        Buffers.push_back(swift::tokenizeToBuffer(LangOpts, SM, BufferID, 0, 0, &Diags, true,
+                                                  /*TokenizeInterpolatedString=*/false));
+        VectorBytes += Vectors.back().capacity() * sizeof(swift::Token);
+        BufferBytes += Buffers.back().getMemoryUsage();
+        Tokens += Vectors.back().size();
+    }
+    if (Tokens == 0) {
+        std::cerr << "No tokens found in input" << std::endl;
+        return 1;
+    }
+
+    std::cout << "tokens: " << Tokens << " tokens in " << totalBytes(Files) << " bytes" << std::endl;
+    std::cout << "  std::vector<Token>: " << VectorBytes << " bytes, "
+              << (double(VectorBytes) / Tokens) << " bytes/token" << std::endl;
+    std::cout << "  TokenBuffer       : " << BufferBytes << " bytes, "
+              << (double(BufferBytes) / Tokens) << " bytes/token" << std::endl;
+
+    // Count one kind across every token array, the shape of a project-wide
+    // "find all 'func'" query.
+    size_t Iterations = std::max<size_t>(1, 200000000 / Tokens);
+    auto runScan = [&](const char *Name, auto &&Count) {
+        size_t Found = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Iterations; ++I)
+            Found += Count();
+        double Seconds = secondsSince(Start);
+        Sink = Sink + unsigned(Found);
+        std::cout << "  " << Name << ": " << (double(Tokens) * Iterations / Seconds / 1e9)
+                  << " G tokens/s" << std::endl;
+    };
+    runScan("scan vector", [&] {
+        size_t Found = 0;
+        for (const std::vector<swift::Token> &Vector : Vectors)
+            for (const swift::Token &Tok : Vector)
+                Found += Tok.is(swift::tok::kw_func);
+        return Found;
+    });
+    runScan("scan buffer", [&] {
+        size_t Found = 0;
+        for (const swift::TokenBuffer &Buffer : Buffers)
+            for (size_t I = Buffer.find(swift::tok::kw_func); I != swift::TokenBuffer::npos;
+                 I = Buffer.find(swift::tok::kw_func, I + 1))
+                ++Found;
+        return Found;
+    });
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// interpolation: tokenize() splitting interpolated string literals
+//===----------------------------------------------------------------------===//
+
+std::string syntheticInterpolationSource() {
+    std::string Source;
+    for (unsigned Line = 0; Line != 20000; ++Line)
+        Source += "print(\"item \\(name) costs \\(price * Double(count)) (\\(\"\\(count)x\"))\")\n";
+    return Source;
+}
+
+int benchInterpolation(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticInterpolationSource);
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    swift::DiagnosticEngine Diags(SM);
+    std::vector<unsigned> BufferIDs;
+    for (const SourceFile &File : Files)
+        BufferIDs.push_back(SM.addMemBufferCopy(File.Buffer->getBuffer(), File.Name));
+
+    size_t Iterations = iterationsFor(Files, 50000000);
+    std::cout << "interpolation: " << totalBytes(Files) << " bytes x " << Iterations << " iterations" << std::endl;
+    auto runTokenize = [&](const char *Name, bool TokenizeInterpolatedString) {
+        size_t Tokens = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Iterations; ++I)
+            for (unsigned BufferID : BufferIDs)
+                Tokens += swift::tokenize(LangOpts, SM, BufferID, 0, 0, &Diags, true,
+                                          TokenizeInterpolatedString).size();
+        reportLexing(Name, Files, Iterations, {Tokens, secondsSince(Start)});
+    };
+    runTokenize("literals whole", false);
+    runTokenize("literals split", true);
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// split: re-tokenizing with parser-split '>>' tokens
+//===----------------------------------------------------------------------===//
+
+std::string syntheticGenericSource() {
+    std::string Source;
+    for (unsigned Line = 0; Line != 20000; ++Line)
+        Source += "let v" + std::to_string(Line) + ": Array<Array<Int>> = Dictionary<String, Set<Int>>()\n";
+    return Source;
+}
+
+int benchSplit(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticGenericSource);
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    swift::DiagnosticEngine Diags(SM);
+
+    // Split every '>>' into two '>', the way the parser does when it closes
+    // two generic argument lists.
+    std::vector<unsigned> BufferIDs;
+    std::vector<std::vector<swift::Token>> Splits;
+    size_t SplitCount = 0;
+    for (const SourceFile &File : Files) {
+        unsigned BufferID = SM.addMemBufferCopy(File.Buffer->getBuffer(), File.Name);
+        BufferIDs.push_back(BufferID);
+        Splits.emplace_back();
+        for (const swift::Token &Tok : swift::tokenize(LangOpts, SM, BufferID, 0, 0, &Diags, false,
+                                                       /*TokenizeInterpolatedString=*/false))
+            if (Tok.isAnyOperator() && Tok.getText() == ">>")
+                Splits.back().emplace_back(swift::tok::r_angle, Tok.getText().substr(0, 1));
+        SplitCount += Splits.back().size();
+    }
+
+    size_t Iterations = iterationsFor(Files, 50000000);
+    std::cout << "split: " << totalBytes(Files) << " bytes, " << SplitCount << " split tokens x "
+              << Iterations << " iterations" << std::endl;
+    auto runTokenize = [&](const char *Name, bool UseSplits) {
+        size_t Tokens = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Iterations; ++I)
+            for (size_t F = 0; F != BufferIDs.size(); ++F)
+                Tokens += swift::tokenize(LangOpts, SM, BufferIDs[F], 0, 0, &Diags, false,
+                                          /*TokenizeInterpolatedString=*/false,
+                                          UseSplits ? llvm::ArrayRef<swift::Token>(Splits[F])
+                                                    : llvm::ArrayRef<swift::Token>()).size();
+        reportLexing(Name, Files, Iterations, {Tokens, secondsSince(Start)});
+    };
+    runTokenize("tokenize", false);
+    runTokenize("tokenize with splits", true);
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// parallel: tokenizeParallel() scaling from one thread to all of them
+//===----------------------------------------------------------------------===//
+
+// Multi-line strings and block comments, so that some guessed chunk
+// boundaries fall inside them and the chunk has to be lexed again.
+std::string syntheticParallelSource() {
+    std::string Source;
+    for (unsigned Line = 0; Source.size() < 16 * 1024 * 1024; ++Line) {
+        std::string N = std::to_string(Line);
+        Source += "/* Entry " + N + ".\n   Spans two lines. */\n"
+                  "func entry" + N + "(x: Int) -> String {\n"
+                  "    let text = \"\"\"\n"
+                  "        value \\(x * " + N + ")\n"
+                  "        \"\"\"\n"
+                  "    return text + \"!\" // done\n"
+                  "}\n";
+    }
+    return Source;
+}
+
+int benchParallel(const std::vector<SourceFile> &Inputs) {
+    // Chunks are cut from a single buffer, so lex the inputs as one.
+    std::vector<SourceFile> Files;
+    if (Inputs.empty()) {
+        Files = filesOrSynthetic(Inputs, syntheticParallelSource);
+    } else {
+        std::string Joined;
+        for (const SourceFile &File : Inputs)
+            Joined += File.Buffer->getBuffer().str() + "\n";
+        Files.push_back({"<joined>", llvm::MemoryBuffer::getMemBufferCopy(Joined, "<joined>")});
+    }
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    unsigned BufferID = SM.addMemBufferCopy(Files[0].Buffer->getBuffer(), Files[0].Name);
+
+    std::vector<swift::Token> Serial = swift::tokenize(LangOpts, SM, BufferID, 0, 0);
+    unsigned MaxThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t Iterations = iterationsFor(Files, 200000000);
+    std::cout << "parallel: " << totalBytes(Files) << " bytes x " << Iterations << " iterations, "
+              << MaxThreads << " hardware threads" << std::endl;
+
+    double SerialSeconds = 0;
+    for (unsigned Threads = 1; Threads <= MaxThreads; ++Threads) {
+        size_t Tokens = 0;
+        bool Identical = true;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Iterations; ++I) {
+            std::vector<swift::Token> Result = swift::tokenizeParallel(LangOpts, SM, BufferID, Threads);
+            Tokens += Result.size();
+            Identical &= Result.size() == Serial.size() &&
+                         std::equal(Result.begin(), Result.end(), Serial.begin(),
+                                    [](const swift::Token &A, const swift::Token &B) {
+                                        return A.getKind() == B.getKind() &&
+                                               A.getRawText() == B.getRawText() &&
+                                               A.getRawText().data() == B.getRawText().data() &&
+                                               A.isAtStartOfLine() == B.isAtStartOfLine();
+                                    });
+        }
+        double Seconds = secondsSince(Start);
+        if (Threads == 1)
+            SerialSeconds = Seconds;
+        std::string Name = std::to_string(Threads) + (Threads == 1 ? " thread " : " threads");
+        reportLexing(Name.c_str(), Files, Iterations, {Tokens, Seconds});
+        std::cout << "    speedup " << (SerialSeconds / Seconds) << "x" << std::endl;
+        if (!Identical) {
+            std::cerr << "error: parallel result differs from serial tokenize()" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// incremental: re-lexing after single-character edits
+//===----------------------------------------------------------------------===//
+
+int benchIncremental(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticGenericSource);
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+
+    // Type and then delete a character on every line, like an editor would
+    // report keystrokes.
+    const size_t Edits = 2000;
+    for (const SourceFile &File : Files) {
+        unsigned BufferID = SM.addMemBufferCopy(File.Buffer->getBuffer(), File.Name);
+        std::vector<unsigned> LineStarts = {0};
+        llvm::StringRef Text = File.Buffer->getBuffer();
+        for (size_t I = 0; I != Text.size(); ++I)
+            if (Text[I] == '\n' && I + 1 != Text.size())
+                LineStarts.push_back(I + 1);
+        std::cout << "incremental: " << File.Name << ", " << Text.size() << " bytes, " << Edits
+                  << " edits" << std::endl;
+
+        swift::IncrementalLexer Incremental(LangOpts, SM, BufferID);
+        size_t Relexed = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Edits; ++I) {
+            unsigned Offset = LineStarts[(I / 2 * 7919) % LineStarts.size()];
+            auto Result = I % 2 ? Incremental.applyEdit(Offset, 1, "")
+                                : Incremental.applyEdit(Offset, 0, "x");
+            Relexed += Result.InsertedTokens;
+        }
+        double Seconds = secondsSince(Start);
+        std::cout << "  incremental: " << (Seconds / Edits * 1e6) << " us/edit, "
+                  << (double(Relexed) / Edits) << " tokens lexed/edit" << std::endl;
+
+        Start = Clock::now();
+        size_t Tokens = 0;
+        for (size_t I = 0; I != Edits / 20; ++I)
+            Tokens += swift::tokenize(LangOpts, SM, Incremental.getBufferID(), 0, 0, nullptr, true,
+                                      /*TokenizeInterpolatedString=*/false).size();
+        Seconds = secondsSince(Start);
+        std::cout << "  full re-lex: " << (Seconds / (Edits / 20) * 1e6) << " us/edit, "
+                  << (double(Tokens) / (Edits / 20)) << " tokens lexed/edit" << std::endl;
+        Sink = Sink + unsigned(Tokens);
+    }
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// lines: offset to line and column conversion
+//===----------------------------------------------------------------------===//
+
+int benchLines(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticIndentedSource);
+    std::cout << "lines: " << totalBytes(Files) << " bytes, scanner: "
+              << swift::bytescan::getImplementationName() << std::endl;
+
+    // Building the table is a one-off cost per buffer, so time it on fresh
+    // buffers.
+    size_t Iterations = iterationsFor(Files, 500000000);
+    size_t Lines = 0;
+    auto Start = Clock::now();
+    for (size_t I = 0; I != Iterations; ++I) {
+        for (const SourceFile &File : Files) {
+            std::vector<uint32_t> LineStarts;
+            swift::bytescan::appendLineStarts(File.Buffer->getBufferStart(), File.Buffer->getBufferEnd(),
+                                              LineStarts);
+            Lines += LineStarts.size();
+        }
+    }
+    double Seconds = secondsSince(Start);
+    std::cout << "  build line table: " << (double(totalBytes(Files)) * Iterations / Seconds / 1e6)
+              << " MB/s, " << (Lines / Seconds / 1e6) << " M lines/s" << std::endl;
+
+    // Look up the location of every token, as a consumer printing one
+    // diagnostic per token would.
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    std::vector<swift::SourceLocation> Locs;
+    for (const SourceFile &File : Files) {
+        unsigned BufferID = SM.addMemBufferCopy(File.Buffer->getBuffer(), File.Name);
+        for (const swift::Token &Tok : swift::tokenize(LangOpts, SM, BufferID, 0, 0))
+            Locs.push_back(Tok.getLoc());
+    }
+    unsigned Sum = 0;
+    Start = Clock::now();
+    for (swift::SourceLocation Loc : Locs)
+        Sum += SM.getLineAndColumn(Loc).first;
+    Seconds = secondsSince(Start);
+    Sink = Sink + Sum;
+    std::cout << "  getLineAndColumn: " << (Seconds / Locs.size() * 1e9) << " ns/lookup over "
+              << Locs.size() << " locations" << std::endl;
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// diagnostics: lexing input that produces many diagnostics
+//===----------------------------------------------------------------------===//
+
+// Number literals with a bad digit: one diagnostic every few tokens.
+std::string syntheticDiagnosticSource() {
+    std::string Source;
+    for (unsigned Line = 0; Line != 20000; ++Line)
+        Source += "let v" + std::to_string(Line) + " = 0x1g + 0b102 + 1e_\n";
+    return Source;
+}
+
+int benchDiagnostics(const std::vector<SourceFile> &Inputs) {
+    std::vector<SourceFile> Files = filesOrSynthetic(Inputs, syntheticDiagnosticSource);
+    std::cout << "diagnostics: " << totalBytes(Files) << " bytes" << std::endl;
+
+    size_t Iterations = iterationsFor(Files, 100000000);
+    reportLexing("lex with diagnostics", Files, Iterations,
+                 lexAll(Files, Iterations, swift::CommentRetentionMode::None));
+
+    // Backtrack to every token: each restore lexes the token again, queueing
+    // its diagnostics, which the restore then drops.
+    swift::SourceManager SM;
+    swift::LangOptions LangOpts;
+    swift::DiagnosticEngine Diags(SM);
+    size_t Restores = 0;
+    double Seconds = 0;
+    for (const SourceFile &File : Files) {
+        unsigned BufferID = SM.addMemBufferCopy(File.Buffer->getBuffer(), File.Name);
+        swift::Lexer L(LangOpts, SM, BufferID, &Diags, swift::LexerMode::Swift);
+        std::vector<swift::LexerState> States;
+        swift::Token Tok;
+        for (L.lex(Tok); Tok.isNot(swift::tok::eof); L.lex(Tok))
+            States.push_back(L.getStateForBeginningOfToken(Tok));
+        auto Start = Clock::now();
+        for (const swift::LexerState &State : States)
+            L.restoreState(State);
+        Seconds += secondsSince(Start);
+        Restores += States.size();
+    }
+    std::cout << "  restoreState: " << (Seconds / Restores * 1e9) << " ns/restore, "
+              << Diags.getErrorCount() << " errors emitted" << std::endl;
+    return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// buffers: finding the buffer that contains a location
+//===----------------------------------------------------------------------===//
+
+// The lookup findBufferContainingLoc used before the sorted range index.
+unsigned findBufferLinear(const swift::SourceManager &SM, unsigned NumBuffers, swift::SourceLocation Loc) {
+    const char *Ptr = Loc.getPointer();
+    for (unsigned BufferID = 1; BufferID <= NumBuffers; ++BufferID) {
+        const llvm::MemoryBuffer *Buffer = SM.getMemoryBuffer(BufferID);
+        if (Ptr >= Buffer->getBufferStart() && Ptr <= Buffer->getBufferEnd())
+            return BufferID;
+    }
+    return ~0U;
+}
+
+int benchBuffers(const std::vector<SourceFile> &) {
+    const unsigned NumBuffers = 10000;
+    swift::SourceManager SM;
+    for (unsigned I = 0; I != NumBuffers; ++I)
+        SM.addMemBufferCopy("let value" + std::to_string(I) + " = " + std::to_string(I) + "\n",
+                            "buffer" + std::to_string(I) + ".swift");
+    std::cout << "buffers: " << NumBuffers << " buffers" << std::endl;
+
+    // Every location of every buffer, in buffer order as a consumer walking
+    // one file's diagnostics would see them, and shuffled.
+    std::vector<swift::SourceLocation> InOrder;
+    for (unsigned BufferID = 1; BufferID <= NumBuffers; ++BufferID)
+        for (unsigned Offset = 0, Size = SM.getBufferContent(BufferID).size(); Offset <= Size; ++Offset)
+            InOrder.push_back(SM.getLocForOffset(BufferID, Offset));
+    std::vector<swift::SourceLocation> Shuffled = InOrder;
+    unsigned Seed = 1;
+    for (size_t I = Shuffled.size(); I > 1; --I) {
+        Seed = Seed * 1103515245 + 12345;
+        std::swap(Shuffled[I - 1], Shuffled[(Seed >> 8) % I]);
+    }
+
+    auto Run = [&](const char *Name, const std::vector<swift::SourceLocation> &Locs, auto Find) {
+        size_t Count = std::min<size_t>(Locs.size(), 200000);
+        unsigned Sum = 0;
+        auto Start = Clock::now();
+        for (size_t I = 0; I != Count; ++I)
+            Sum += Find(Locs[I]);
+        double Seconds = secondsSince(Start);
+        Sink = Sink + Sum;
+        std::cout << "  " << Name << ": " << (Seconds / Count * 1e9) << " ns/lookup" << std::endl;
+    };
+    auto Indexed = [&](swift::SourceLocation Loc) { return SM.findBufferContainingLoc(Loc); };
+    auto Linear = [&](swift::SourceLocation Loc) { return findBufferLinear(SM, NumBuffers, Loc); };
+    Run("in order, indexed", InOrder, Indexed);
+    Run("in order, linear scan", InOrder, Linear);
+    Run("shuffled, indexed", Shuffled, Indexed);
+    Run("shuffled, linear scan", Shuffled, Linear);
+    return 0;
+}
+
+struct Benchmark {
+    const char *Name;
+    const char *Description;
+    int (*Run)(const std::vector<SourceFile> &Files);
+};
+
+const Benchmark Benchmarks[] = {
+    {"keywords", "keyword classification: hash table vs. if-chain", benchKeywords},
+    {"trivia", "whitespace skipping: block scanner vs. byte loop", benchTrivia},
+    {"comments", "lexing throughput on comment-dense input", benchComments},
+    {"utf8", "UTF-8 validation when buffers are registered", benchUTF8},
+    {"identifiers", "identifier scanning and identifiers lexed per second", benchIdentifiers},
+    {"unicode", "lexing throughput on non-ASCII identifiers and operators", benchUnicode},
+    {"tokens", "token array memory and kind scans: TokenBuffer vs. std::vector<Token>", benchTokens},
+    {"interpolation", "tokenize() throughput splitting interpolated strings", benchInterpolation},
+    {"split", "tokenize() throughput with and without parser-split tokens", benchSplit},
+    {"parallel", "tokenizeParallel() scaling from 1 to N threads", benchParallel},
+    {"incremental", "IncrementalLexer edits vs. re-lexing the whole buffer", benchIncremental},
+    {"lines", "line table construction and line/column lookups", benchLines},
+    {"diagnostics", "lexing and backtracking over diagnostic-dense input", benchDiagnostics},
+    {"buffers", "findBufferContainingLoc over 10k buffers: range index vs. linear scan", benchBuffers},
+};
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <benchmark> [swift-files...]" << std::endl;
+        std::cerr << "Benchmarks:" << std::endl;
+        for (const Benchmark &B : Benchmarks)
+            std::cerr << "  " << B.Name << " - " << B.Description << std::endl;
+        return 1;
+    }
+
+    std::vector<SourceFile> Files = loadFiles(std::vector<std::string>(argv + 2, argv + argc));
+    for (const Benchmark &B : Benchmarks)
+        if (std::strcmp(B.Name, argv[1]) == 0)
+            return B.Run(Files);
+
+    std::cerr << "Unknown benchmark: " << argv[1] << std::endl;
+    return 1;
+}